@@ -2,10 +2,126 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "assert.h"
+#include "cache.h"
+#include "codeword_io.h"
 #include "compress40.h"
+#include "compress40ext.h"
+#include "profile.h"
 
 static void (*compress_or_decompress)(FILE *input) = compress40;
 
+/* Region given with --crop x,y,w,h (decoded with -d, else cut out of the
+ * COMP40 image without decoding) */
+static int      crop = 0;
+static unsigned crop_x, crop_y, crop_w, crop_h;
+
+/* Tile side in blocks given with --tiles N (compress only, 0 is format 2) */
+static unsigned tiles = 0;
+
+/* Tile coding: "huff" with --entropy, "rle" with --rle (compress only,
+ * implies tiles) */
+static const char *coding = NULL;
+
+/* Old COMP40 file given with --base FILE, and sidecar of row hashes to write
+ * given with --rows FILE (compress only) */
+static const char *base = NULL;
+static const char *rows = NULL;
+
+/* Stream of frames given with --stream (either direction), sending only the
+ * changed blocks of each frame with --temporal (compress only) */
+static int stream   = 0;
+static int temporal = 0;
+
+/* Preview given with --scale 1/N (decompress only, N is 2, 4 or 8) */
+static unsigned scale = 1;
+
+/* Lossless transform of a COMP40 image given with --transform NAME */
+static const char *transform = NULL;
+
+/* Tone adjustment of a COMP40 image given with --brightness B (added to luma
+ * in [0, 1]), --contrast C (factor around mid-gray) and --gray */
+static int   tone       = 0;
+static float brightness = 0.0;
+static float contrast   = 1.0;
+static int   gray       = 0;
+
+/* Statistics of a COMP40 image given with --stats */
+static int stats = 0;
+
+/* Other COMP40 image to compare with given with --diff FILE, also decoding
+ * both with --exact */
+static const char *diff  = NULL;
+static int         exact = 0;
+
+/* Prefix of the levels' files given with --pyramid PREFIX (written in the
+ * format chosen with --tiles, --entropy or --rle) */
+static const char *pyramid = NULL;
+
+/* COMP40 images given after --hstack or --vstack, joined without decoding */
+static int hstack = 0;
+static int vstack = 0;
+
+/* Piece size given with --split WxH PREFIX, cut without decoding */
+static unsigned    split_w = 0, split_h = 0;
+static const char *split_prefix = NULL;
+
+/* Codeword layouts to evaluate given with --sweep A/BCD/C[,...] */
+static const char *sweep = NULL;
+
+/* Round trip check given with -c --verify, of a fraction F of the blocks
+ * only with --sample F, reported on standard error and failing if the (maybe
+ * estimated) RMS error exceeds --max-rms E (in [0, 1]) */
+static int    verify  = 0;
+static double sample  = 1;
+static double max_rms = -1;
+
+/* Result cache directory given with --cache DIR, bounded to --cache-max MB
+ * (either direction, not with --stream, --base or --rows) */
+static const char *cache     = NULL;
+static uint64_t    cache_max = CACHE_DEFAULT_MAX;
+
+/* Per-stage times of the pipelines, printed on standard error with --profile
+ * (as JSON with --profile-json), with hardware counters if --counters */
+static int profile          = 0;
+static int profile_json     = 0;
+static int profile_counters = 0;
+
+/* Chrome trace of every stage, tile, frame and queue wait, with --trace */
+static const char *trace = NULL;
+
+static void run(FILE *fp, void *cl);
+
+static void usage(const char *progname)
+{
+        fprintf(stderr, "Usage: %s -d [--crop x,y,w,h | --scale 1/N] "
+                "[filename]\n"
+                "       %s -c [--tiles N] [--entropy | --rle] "
+                "[--verify [--sample F] [--max-rms E]]\n"
+                "          [filename]\n"
+                "       %s -c [--base old.c40] [--rows FILE] [filename]\n"
+                "       %s -c | -d --stream [--temporal] [filename]\n"
+                "       %s --transform fliph | flipv | transpose | rot90 | "
+                "rot180 | rot270 [filename]\n"
+                "       %s --crop x,y,w,h | --split WxH PREFIX [filename]\n"
+                "       %s --hstack | --vstack filename...\n"
+                "       %s [--brightness B] [--contrast C] [--gray] "
+                "[filename]\n"
+                "       %s --stats [filename]\n"
+                "       %s --diff other.c40 [--exact] [filename]\n"
+                "       %s --pyramid PREFIX [--tiles N] [--entropy | --rle] "
+                "[filename]\n"
+                "       %s --sweep A/BCD/C[,A/BCD/C...] [filename]\n"
+                "       add [--cache DIR [--cache-max MB]] to reuse results\n"
+                "       add --profile or --profile-json to time each stage and "
+                "count its allocations,\n"
+                "       and --counters for its hardware counters\n"
+                "       add --trace FILE to write a Chrome trace of every "
+                "stage\n",
+                progname, progname, progname, progname, progname, progname,
+                progname, progname, progname, progname, progname, progname);
+        exit(1);
+}
+
 int main(int argc, char *argv[])
 {
         int i;
@@ -15,26 +131,380 @@ int main(int argc, char *argv[])
                         compress_or_decompress = compress40;
                 } else if (strcmp(argv[i], "-d") == 0) {
                         compress_or_decompress = decompress40;
+                } else if (strcmp(argv[i], "--crop") == 0) {
+                        if (++i == argc ||
+                            sscanf(argv[i], "%u,%u,%u,%u", &crop_x, &crop_y,
+                                   &crop_w, &crop_h) != 4) {
+                                usage(argv[0]);
+                        }
+                        crop = 1;
+                } else if (strcmp(argv[i], "--tiles") == 0) {
+                        if (++i == argc ||
+                            sscanf(argv[i], "%u", &tiles) != 1 || tiles == 0) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "--entropy") == 0 ||
+                           strcmp(argv[i], "--rle") == 0) {
+                        const char *name = argv[i][2] == 'e' ? "huff" : "rle";
+                        if (coding != NULL && strcmp(coding, name) != 0) {
+                                usage(argv[0]);
+                        }
+                        coding = name;
+                } else if (strcmp(argv[i], "--base") == 0) {
+                        if (++i == argc) {
+                                usage(argv[0]);
+                        }
+                        base = argv[i];
+                } else if (strcmp(argv[i], "--rows") == 0) {
+                        if (++i == argc) {
+                                usage(argv[0]);
+                        }
+                        rows = argv[i];
+                } else if (strcmp(argv[i], "--stream") == 0) {
+                        stream = 1;
+                } else if (strcmp(argv[i], "--temporal") == 0) {
+                        temporal = 1;
+                } else if (strcmp(argv[i], "--scale") == 0) {
+                        if (++i == argc ||
+                            sscanf(argv[i], "1/%u", &scale) != 1 ||
+                            (scale != 1 && scale != 2 && scale != 4 &&
+                             scale != 8)) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "--transform") == 0) {
+                        if (++i == argc || !known_transform(argv[i])) {
+                                usage(argv[0]);
+                        }
+                        transform = argv[i];
+                } else if (strcmp(argv[i], "--brightness") == 0) {
+                        if (++i == argc ||
+                            sscanf(argv[i], "%f", &brightness) != 1) {
+                                usage(argv[0]);
+                        }
+                        tone = 1;
+                } else if (strcmp(argv[i], "--contrast") == 0) {
+                        if (++i == argc ||
+                            sscanf(argv[i], "%f", &contrast) != 1 ||
+                            contrast < 0) {
+                                usage(argv[0]);
+                        }
+                        tone = 1;
+                } else if (strcmp(argv[i], "--gray") == 0) {
+                        gray = 1;
+                        tone = 1;
+                } else if (strcmp(argv[i], "--diff") == 0) {
+                        if (++i == argc) {
+                                usage(argv[0]);
+                        }
+                        diff = argv[i];
+                } else if (strcmp(argv[i], "--exact") == 0) {
+                        exact = 1;
+                } else if (strcmp(argv[i], "--pyramid") == 0) {
+                        if (++i == argc) {
+                                usage(argv[0]);
+                        }
+                        pyramid = argv[i];
+                } else if (strcmp(argv[i], "--stats") == 0) {
+                        stats = 1;
+                } else if (strcmp(argv[i], "--hstack") == 0) {
+                        hstack = 1;
+                } else if (strcmp(argv[i], "--vstack") == 0) {
+                        vstack = 1;
+                } else if (strcmp(argv[i], "--split") == 0) {
+                        if (i + 2 >= argc ||
+                            sscanf(argv[i + 1], "%ux%u", &split_w,
+                                   &split_h) != 2 ||
+                            split_w == 0 || split_h == 0) {
+                                usage(argv[0]);
+                        }
+                        split_prefix = argv[i + 2];
+                        i += 2;
+                } else if (strcmp(argv[i], "--sweep") == 0) {
+                        if (++i == argc || !known_layouts(argv[i])) {
+                                usage(argv[0]);
+                        }
+                        sweep = argv[i];
+                } else if (strcmp(argv[i], "--verify") == 0) {
+                        verify = 1;
+                } else if (strcmp(argv[i], "--sample") == 0) {
+                        if (++i == argc ||
+                            sscanf(argv[i], "%lf", &sample) != 1 ||
+                            sample <= 0 || sample > 1) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "--max-rms") == 0) {
+                        if (++i == argc ||
+                            sscanf(argv[i], "%lf", &max_rms) != 1 ||
+                            max_rms < 0) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "--profile") == 0 ||
+                           strcmp(argv[i], "--profile-json") == 0 ||
+                           strcmp(argv[i], "--counters") == 0) {
+                        if (!profile_compiled()) {
+                                fprintf(stderr, "%s: built without "
+                                        "COMP40_PROFILE (make profile)\n",
+                                        argv[0]);
+                                exit(1);
+                        }
+                        profile           = 1;
+                        profile_json     |= strcmp(argv[i],
+                                                   "--profile-json") == 0;
+                        profile_counters |= strcmp(argv[i], "--counters") == 0;
+                } else if (strcmp(argv[i], "--trace") == 0) {
+                        if (++i == argc) {
+                                usage(argv[0]);
+                        }
+                        if (!profile_compiled()) {
+                                fprintf(stderr, "%s: built without "
+                                        "COMP40_PROFILE (make profile)\n",
+                                        argv[0]);
+                                exit(1);
+                        }
+                        trace = argv[i];
+                } else if (strcmp(argv[i], "--cache") == 0) {
+                        if (++i == argc) {
+                                usage(argv[0]);
+                        }
+                        cache = argv[i];
+                } else if (strcmp(argv[i], "--cache-max") == 0) {
+                        unsigned mb;
+                        if (++i == argc || sscanf(argv[i], "%u", &mb) != 1) {
+                                usage(argv[0]);
+                        }
+                        cache_max = (uint64_t)mb << 20;
                 } else if (*argv[i] == '-') {
                         fprintf(stderr, "%s: unknown option '%s'\n",
                                 argv[0], argv[i]);
                         exit(1);
+                } else if (hstack || vstack) {
+                        break;
                 } else if (argc - i > 2) {
-                        fprintf(stderr, "Usage: %s -d [filename]\n"
-                                "       %s -c [filename]\n",
-                                argv[0], argv[0]);
-                        exit(1);
+                        usage(argv[0]);
                 } else {
                         break;
                 }
         }
+        if (scale != 1 && compress_or_decompress != decompress40) {
+                fprintf(stderr, "%s: --scale requires -d\n", argv[0]);
+                exit(1);
+        }
+        int edit = (crop && compress_or_decompress != decompress40) ||
+                   hstack || vstack || split_prefix != NULL || tone || stats ||
+                   diff != NULL || sweep != NULL;
+        if (edit && ((crop != 0) + hstack + vstack + (split_prefix != NULL) +
+                     tone + stats + (diff != NULL) + (sweep != NULL) > 1 ||
+                     compress_or_decompress == decompress40 || tiles != 0 ||
+                     coding != NULL || stream || base != NULL ||
+                     rows != NULL || transform != NULL)) {
+                fprintf(stderr, "%s: --crop (without -d), --hstack, --vstack, "
+                        "--split, --stats, --diff, --sweep and tone options "
+                        "cannot be combined with other options\n", argv[0]);
+                exit(1);
+        }
+        if (exact && diff == NULL) {
+                fprintf(stderr, "%s: --exact requires --diff\n", argv[0]);
+                exit(1);
+        }
+        if ((crop_x | crop_y | crop_w | crop_h) % 2 != 0 && edit) {
+                fprintf(stderr, "%s: --crop without -d needs even x, y, w "
+                        "and h\n", argv[0]);
+                exit(1);
+        }
+        if (split_prefix != NULL && (split_w % 2 != 0 || split_h % 2 != 0)) {
+                fprintf(stderr, "%s: --split needs even W and H\n", argv[0]);
+                exit(1);
+        }
+        if ((tiles != 0 || coding != NULL) &&
+            compress_or_decompress != compress40) {
+                fprintf(stderr, "%s: --tiles, --entropy and --rle require "
+                        "-c\n", argv[0]);
+                exit(1);
+        }
+        if (coding != NULL && tiles == 0) {
+                tiles = DEFAULT_TILE;
+        }
+        if (crop && scale != 1) {
+                fprintf(stderr, "%s: --crop cannot be combined with --scale\n",
+                        argv[0]);
+                exit(1);
+        }
+        if (stream && (crop || scale != 1 || tiles != 0 || coding != NULL)) {
+                fprintf(stderr, "%s: --stream cannot be combined with other "
+                        "options\n", argv[0]);
+                exit(1);
+        }
+        if (temporal && (!stream || compress_or_decompress != compress40)) {
+                fprintf(stderr, "%s: --temporal requires -c --stream\n",
+                        argv[0]);
+                exit(1);
+        }
+        if ((base != NULL || rows != NULL) &&
+            (compress_or_decompress != compress40 || stream || tiles != 0 ||
+             coding != NULL)) {
+                fprintf(stderr, "%s: --base and --rows require -c, without "
+                        "--tiles, --entropy, --rle or --stream\n", argv[0]);
+                exit(1);
+        }
+        if (transform != NULL &&
+            (crop || scale != 1 || tiles != 0 || coding != NULL || stream ||
+             base != NULL || rows != NULL)) {
+                fprintf(stderr, "%s: --transform cannot be combined with "
+                        "other options\n", argv[0]);
+                exit(1);
+        }
+        if (pyramid != NULL &&
+            (compress_or_decompress == decompress40 || crop || scale != 1 ||
+             stream || base != NULL || rows != NULL || transform != NULL ||
+             edit)) {
+                fprintf(stderr, "%s: --pyramid can only be combined with "
+                        "--tiles, --entropy and --rle\n", argv[0]);
+                exit(1);
+        }
+        if ((max_rms >= 0 || sample != 1) && !verify) {
+                fprintf(stderr, "%s: --sample and --max-rms require "
+                        "--verify\n", argv[0]);
+                exit(1);
+        }
+        if (verify && (compress_or_decompress != compress40 || crop ||
+                       stream || base != NULL || rows != NULL ||
+                       transform != NULL || edit || pyramid != NULL ||
+                       cache != NULL)) {
+                fprintf(stderr, "%s: --verify can only be combined with -c, "
+                        "--tiles, --entropy and --rle\n", argv[0]);
+                exit(1);
+        }
+        if (cache != NULL && (stream || base != NULL || rows != NULL ||
+                              hstack || vstack || split_prefix != NULL ||
+                              pyramid != NULL || diff != NULL ||
+                              sweep != NULL)) {
+                fprintf(stderr, "%s: --cache cannot be combined with "
+                        "--stream, --base, --rows, --hstack, --vstack, "
+                        "--split, --pyramid, --diff or --sweep\n", argv[0]);
+                exit(1);
+        }
+        if (hstack || vstack) {
+                if (i == argc) {
+                        usage(argv[0]);
+                }
+                unsigned n = argc - i;
+                FILE **inputs = malloc(n * sizeof(*inputs));
+                assert(inputs != NULL);
+                for (unsigned k = 0; k < n; k++) {
+                        inputs[k] = fopen(argv[i + k], "r");
+                        assert(inputs[k] != NULL);
+                }
+                stack40(inputs, n, hstack);
+                for (unsigned k = 0; k < n; k++) {
+                        fclose(inputs[k]);
+                }
+                free(inputs);
+                return 0;
+        }
         assert(argc - i <= 1);    /* at most one file on command line */
+
+        FILE *fp = stdin;
         if (i < argc) {
-                FILE *fp = fopen(argv[i], "r");
+                fp = fopen(argv[i], "r");
                 assert(fp != NULL);
-                compress_or_decompress(fp);
+        }
+
+        FILE *trace_file = NULL;
+        if (trace != NULL) {
+                trace_file = fopen(trace, "w");
+                assert(trace_file != NULL);
+        }
+        if (profile) {
+                profile_enable(profile_counters);
+        }
+        if (trace_file != NULL) {
+                profile_trace();
+        }
+        if (cache != NULL) {
+                /* Everything that changes the output, in a fixed form;
+                 * under 256 characters with every number at its widest,
+                 * and never cut short, which could make another run's */
+                char options[256];
+                int  length = snprintf(options, sizeof(options),
+                         "%s crop=%d,%u,%u,%u,%u "
+                         "scale=%u tiles=%u coding=%s transform=%s "
+                         "tone=%d,%a,%a,%d stats=%d",
+                         compress_or_decompress == compress40 ? "-c" : "-d",
+                         crop, crop_x, crop_y, crop_w, crop_h, scale, tiles,
+                         coding != NULL ? coding : "raw",
+                         transform != NULL ? transform : "none",
+                         tone, brightness, contrast, gray, stats);
+                assert(length >= 0 && (size_t)length < sizeof(options));
+                cache_run(cache, cache_max, options, fp, run, NULL);
+        } else {
+                run(fp, NULL);
+        }
+        if (profile) {
+                profile_print(stderr, profile_json);
+        }
+        if (trace_file != NULL) {
+                profile_trace_write(trace_file);
+                fclose(trace_file);
+        }
+
+        if (fp != stdin) {
                 fclose(fp);
+        }
+}
+
+/* Runs the job chosen on the command line on fp (a Cache_job) */
+static void run(FILE *fp, void *cl)
+{
+        (void)cl;
+        if (stream) {
+                if (compress_or_decompress == compress40) {
+                        compress40_stream(fp, temporal);
+                } else {
+                        decompress40_stream(fp);
+                }
+        } else if (transform != NULL) {
+                transform40(fp, transform);
+        } else if (base != NULL || rows != NULL) {
+                compress40_incremental(fp, base, rows);
+        } else if (diff != NULL) {
+                FILE *other = fopen(diff, "r");
+                assert(other != NULL);
+                diff40(fp, other, exact);
+                fclose(other);
+        } else if (sweep != NULL) {
+                sweep40(fp, sweep);
+        } else if (pyramid != NULL) {
+                pyramid40(fp, pyramid, tiles, coding != NULL ? coding : "raw");
+        } else if (stats) {
+                stats40(fp);
+        } else if (tone) {
+                tone40(fp, brightness, contrast, gray);
+        } else if (split_prefix != NULL) {
+                split40(fp, split_w, split_h, split_prefix);
+        } else if (crop && compress_or_decompress != decompress40) {
+                crop40(fp, crop_x, crop_y, crop_w, crop_h);
+        } else if (crop) {
+                decompress40_region(fp, crop_x, crop_y, crop_w, crop_h);
+        } else if (scale != 1) {
+                decompress40_preview(fp, scale);
+        } else if (verify) {
+                Comp40_quality q = compress40_verify(fp, tiles,
+                                                     coding != NULL ? coding
+                                                                    : "raw",
+                                                     sample);
+                fprintf(stderr, "verify rms %.4f low %.4f high %.4f sampled "
+                        "%u of %u\n", q.rms, q.rms_low, q.rms_high,
+                        q.sampled, q.blocks);
+                profile_quality(q.rms, q.rms_low, q.rms_high, q.sampled,
+                                q.blocks);
+                if (max_rms >= 0 && q.rms > max_rms) {
+                        fprintf(stderr, "verify failed: rms %.4f exceeds "
+                                "%.4f\n", q.rms, max_rms);
+                        exit(1);
+                }
+        } else if (tiles != 0) {
+                compress40_tiled(fp, tiles, coding != NULL ? coding : "raw");
         } else {
-                compress_or_decompress(stdin);
+                compress_or_decompress(fp);
         }
 }
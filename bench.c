@@ -0,0 +1,781 @@
+/*
+ *      bench.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Program that benchmarks compress40 and decompress40 on a corpus of
+ *        synthetic pixmaps, and prints their throughput (MB/s of 24-bit
+ *        pixmap, and ns per 2x2 block), end to end and per ImageMethods_T
+ *        stage
+ *      - Usage: 40bench [--sizes WxH[,WxH...]] [--kinds K[,K...]] [--runs N]
+ *                       [--json FILE] [--counters]
+ *              ~ Kinds are "gradient" (smooth ramps), "noise" (independent
+ *                random samples) and "ui" (flat windows with title bars and
+ *                lines of text-like marks); sizes must be even, and run up
+ *                to gigapixel as memory allows
+ *              ~ Every image is timed N times (5 by default); the median
+ *                and fastest run are reported, the MB/s and ns per block
+ *                from the median
+ *              ~ --json also writes the results to FILE ("-" for standard
+ *                output instead of the table), for tracking regressions
+ *              ~ --counters also reads the hardware counters (counters.h)
+ *                around each stage, reported per block as the mean of the
+ *                runs; if the system refuses them, this is said on
+ *                standard error and the benchmark runs without them
+ *      - Corpus: Images are generated from a fixed seed, so every run of
+ *                every build sees the same pixels
+ *      - Timing:
+ *              ~ End to end: compress40 on the pixmap's bytes and
+ *                decompress40 on the result's, from temporary files, with
+ *                standard output sent to /dev/null
+ *              ~ Stages: the same pipelines as compress_pixmap and
+ *                decompress_codewords, one method at a time (without the
+ *                sharing of identical blocks), "read" being the block
+ *                extraction (compress) or the codeword read (decompress),
+ *                and "write" the output to /dev/null
+ *      - Invariants:
+ *              ~ Times are CLOCK_MONOTONIC wall-clock seconds
+ *              ~ Generated images are never modified by the stages, since
+ *                scaling a maxval-255 pixmap and trimming an even one leave
+ *                it as it is
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "a2methods.h"
+#include "a2plain.h"
+#include "assert.h"
+#include "codeword_io.h"
+#include "compress40.h"
+#include "counters.h"
+#include "imagemethods.h"
+#include "mem.h"
+#include "pixelblock.h"
+#include "pnm.h"
+#include "uarray.h"
+
+static const char *STDOUT_NAME   = "-";
+static const char *DEFAULT_SIZES = "256x256,1024x1024,2048x2048";
+static const char *DEFAULT_KINDS = "gradient,noise,ui";
+static const unsigned DEFAULT_RUNS = 5;
+
+/* Seed of the corpus generator */
+static const uint64_t CORPUS_SEED = 0x2545f4914f6cdd1du;
+
+/* Directions, and the stages of each in pipeline order */
+enum { COMPRESS, DECOMPRESS, DIRECTIONS };
+#define STAGES 6
+static const char *DIRECTION_NAMES[DIRECTIONS] = { "compress", "decompress" };
+static const char *STAGE_NAMES[DIRECTIONS][STAGES] = {
+        { "read", "rgb_xyz", "chroma", "luma",    "pixpack", "write" },
+        { "read", "pixpack", "luma",   "chroma",  "rgb_xyz", "write" }
+};
+
+/* -- struct Pnm_ppm is from pnm.h -- */
+typedef struct Pnm_ppm *ppm;
+
+/* -- Times of every run of one image -- */
+struct bench_result {
+        char        kind[16];
+        unsigned    width, height;
+        long        c40_bytes;                   /* compressed size       */
+        double     *total[DIRECTIONS];           /* end to end, per run   */
+        double     *stage[DIRECTIONS][STAGES];   /* per stage, per run    */
+        uint64_t    counts[DIRECTIONS][STAGES][COUNTERS]; /* over all runs */
+};
+
+/* -- Summary of the runs of one measurement -- */
+struct summary {
+        double median, min;                      /* seconds               */
+        double mb_per_s, ns_per_block;           /* from the median       */
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* Hardware counters read around each stage (bit i for counter i) */
+static unsigned counting = 0;
+
+/* -- CORPUS FUNCTIONS -- */
+void     usage         (void);
+ppm      generate      (const char *kind, unsigned width, unsigned height);
+void     ui_pixel      (unsigned x, unsigned y, Pnm_rgb px);
+uint64_t corpus_random (uint64_t value);
+/* ^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- TIMING FUNCTIONS -- */
+void     bench_image   (ppm image, unsigned runs,
+                        struct bench_result *result, FILE *devnull);
+void     time_compress (ppm image, double stage[STAGES],
+                        uint64_t counts[STAGES][COUNTERS], FILE *devnull);
+void     time_decompress(FILE *c40_file, double stage[STAGES],
+                         uint64_t counts[STAGES][COUNTERS], FILE *devnull);
+double   time_run      (void (*run)(FILE *input), FILE *input,
+                        int output_fd);
+double   now           (void);
+double   checkpoint    (uint64_t counts[COUNTERS]);
+void     add_counts    (uint64_t counts[STAGES][COUNTERS],
+                        uint64_t marks[STAGES + 1][COUNTERS]);
+/* ^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- REPORT FUNCTIONS -- */
+int            compare_doubles(const void *a, const void *b);
+struct summary summarize   (const struct bench_result *result,
+                            const double *times, unsigned runs);
+void           print_table (FILE *out, const struct bench_result *results,
+                            unsigned n, unsigned runs);
+void           print_json  (FILE *out, const struct bench_result *results,
+                            unsigned n, unsigned runs);
+void           json_summary(FILE *out, const char *name, struct summary s,
+                            const uint64_t *counts, double blocks,
+                            const char *end);
+/* ^^^^^^^^^^^^^^^^^^^^ */
+
+int main(int argc, char *argv[])
+{
+        const char *sizes = DEFAULT_SIZES;
+        const char *kinds = DEFAULT_KINDS;
+        const char *json  = NULL;
+        unsigned    runs  = DEFAULT_RUNS;
+
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+                        sizes = argv[++i];
+                } else if (strcmp(argv[i], "--kinds") == 0 && i + 1 < argc) {
+                        kinds = argv[++i];
+                } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+                        json = argv[++i];
+                } else if (strcmp(argv[i], "--counters") == 0) {
+                        counting = counters_open();
+                        if (counting == 0) {
+                                fprintf(stderr, "40bench: hardware counters "
+                                        "unavailable (%s)\n",
+                                        counters_error());
+                        }
+                } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+                        char *end;
+                        runs = strtoul(argv[++i], &end, 10);
+                        if (*end != '\0' || runs == 0) {
+                                usage();
+                        }
+                } else {
+                        usage();
+                }
+        }
+
+        /* Counting the images: every size of every kind */
+        unsigned num_sizes = 1, num_kinds = 1;
+        for (const char *s = sizes; *s != '\0'; s++) {
+                num_sizes += *s == ',';
+        }
+        for (const char *s = kinds; *s != '\0'; s++) {
+                num_kinds += *s == ',';
+        }
+
+        FILE *devnull = fopen("/dev/null", "w");
+        assert(devnull != NULL);
+
+        unsigned             n       = 0;
+        struct bench_result *results = CALLOC(num_sizes * num_kinds,
+                                              sizeof(struct bench_result));
+        const char          *size    = sizes;
+        for (unsigned i = 0; i < num_sizes; i++) {
+                unsigned width, height;
+                int      used = 0;
+                if (sscanf(size, "%ux%u%n", &width, &height, &used) != 2 ||
+                    width == 0 || height == 0 || width % 2 != 0 ||
+                    height % 2 != 0 ||
+                    (size[used] != ',' && size[used] != '\0')) {
+                        usage();
+                }
+                size += used + (size[used] == ',');
+
+                const char *kind = kinds;
+                for (unsigned k = 0; k < num_kinds; k++) {
+                        size_t len = strcspn(kind, ",");
+                        char   name[16];
+                        if (len == 0 || len >= sizeof(name)) {
+                                usage();
+                        }
+                        memcpy(name, kind, len);
+                        name[len] = '\0';
+                        kind += len + (kind[len] == ',');
+
+                        ppm image = generate(name, width, height);
+                        bench_image(image, runs, &results[n], devnull);
+                        strcpy(results[n].kind, name);
+                        Pnm_ppmfree(&image);
+                        if (json == NULL ||
+                            strcmp(json, STDOUT_NAME) != 0) {
+                                print_table(stdout, &results[n], 1, runs);
+                                fflush(stdout);
+                        }
+                        n++;
+                }
+        }
+
+        if (json != NULL) {
+                FILE *out = strcmp(json, STDOUT_NAME) == 0 ?
+                            stdout : fopen(json, "w");
+                assert(out != NULL);
+                print_json(out, results, n, runs);
+                if (out != stdout) {
+                        fclose(out);
+                }
+        }
+
+        for (unsigned i = 0; i < n; i++) {
+                for (int dir = 0; dir < DIRECTIONS; dir++) {
+                        FREE(results[i].total[dir]);
+                        for (int s = 0; s < STAGES; s++) {
+                                FREE(results[i].stage[dir][s]);
+                        }
+                }
+        }
+        FREE(results);
+        fclose(devnull);
+
+        return 0;
+}
+
+/*--------------------------------------------------------------*
+ |                       CORPUS FUNCTIONS                       |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       usage
+ * [Parameters]: None
+ * [Return]:     void (exits)
+ * [Purpose]:    Prints how to run 40bench on standard error, then fails
+ * [Errors]:     None
+ */
+void usage(void)
+{
+        fprintf(stderr, "Usage: 40bench [--sizes WxH[,WxH...]] "
+                "[--kinds gradient,noise,ui] [--runs N] [--json FILE]\n"
+                "               [--counters]\n"
+                "       (sizes even, default %s)\n", DEFAULT_SIZES);
+        exit(1);
+}
+
+/*
+ * [Name]:       generate
+ * [Parameters]: 1 const char* (kind), 2 unsigned integers (width, height)
+ * [Return]:     a new width x height pixmap of the kind, maxval RGB_MAX
+ * [Purpose]:    Makes one image of the corpus; the same arguments always
+ *               give the same pixels
+ * [Errors]:     Exits with usage if kind is unknown
+ */
+ppm generate(const char *kind, unsigned width, unsigned height)
+{
+        int gradient = strcmp(kind, "gradient") == 0;
+        int noise    = strcmp(kind, "noise") == 0;
+        if (!gradient && !noise && strcmp(kind, "ui") != 0) {
+                usage();
+        }
+
+        ppm      image = new_ppm(width, height);
+        uint64_t state = CORPUS_SEED ^ ((uint64_t)width << 32 | height);
+        for (unsigned y = 0; y < height; y++) {
+                for (unsigned x = 0; x < width; x++) {
+                        Pnm_rgb px = image->methods->at(image->pixels, x, y);
+                        if (gradient) {
+                                px->red   = RGB_MAX * x / width;
+                                px->green = RGB_MAX * y / height;
+                                px->blue  = RGB_MAX * (x + y) /
+                                            (width + height);
+                        } else if (noise) {
+                                uint64_t r = corpus_random(state++);
+                                px->red   = r & 0xff;
+                                px->green = (r >> 8) & 0xff;
+                                px->blue  = (r >> 16) & 0xff;
+                        } else {
+                                ui_pixel(x, y, px);
+                        }
+                }
+        }
+
+        return image;
+}
+
+/*
+ * [Name]:       ui_pixel
+ * [Parameters]: 2 unsigned integers (x, y), 1 Pnm_rgb (px, set)
+ * [Return]:     void
+ * [Purpose]:    Colors a pixel of a screenshot-like image: a grid of 256x192
+ *               windows, each with a gray frame, a title bar of its own
+ *               color and a white body with lines of dark, word-like runs
+ * [Errors]:     None
+ */
+void ui_pixel(unsigned x, unsigned y, Pnm_rgb px)
+{
+        unsigned wx = x % 256, wy = y % 192;
+        uint64_t window = corpus_random(CORPUS_SEED + (x / 256) * 65537 +
+                                        y / 192);
+        unsigned value = 255;
+
+        if (wx < 4 || wy < 4) {
+                value = 200;
+        } else if (wy < 28) {
+                px->red   = window & 0xff;
+                px->green = (window >> 8) & 0xff;
+                px->blue  = (window >> 16) & 0xff;
+                return;
+        } else if ((wy - 28) % 14 < 8 && wx % 24 < 20 &&
+                   (corpus_random(window + (wy - 28) / 14 * 16 + wx / 24) &
+                    3) != 0) {
+                value = 32;
+        }
+
+        px->red = px->green = px->blue = value;
+}
+
+/*
+ * [Name]:       corpus_random
+ * [Parameters]: 1 uint64_t (value)
+ * [Return]:     a well-mixed 64-bit hash of value (the splitmix64 finalizer)
+ * [Purpose]:    Deterministic pseudo-random numbers for the corpus
+ * [Errors]:     None
+ */
+uint64_t corpus_random(uint64_t value)
+{
+        uint64_t z = value + 0x9e3779b97f4a7c15u;
+
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+
+        return z ^ (z >> 31);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                       TIMING FUNCTIONS                       |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       bench_image
+ * [Parameters]: 1 ppm (image), 1 unsigned (runs), 1 struct bench_result*
+ *               (result, filled), 1 FILE* (devnull)
+ * [Return]:     void
+ * [Purpose]:    Times image runs times end to end and stage by stage, in
+ *               both directions
+ * [Errors]:     CRE if temporary files cannot be made
+ */
+void bench_image(ppm image, unsigned runs, struct bench_result *result,
+                 FILE *devnull)
+{
+        result->width  = image->width;
+        result->height = image->height;
+        for (int dir = 0; dir < DIRECTIONS; dir++) {
+                result->total[dir] = CALLOC(runs, sizeof(double));
+                for (int s = 0; s < STAGES; s++) {
+                        result->stage[dir][s] = CALLOC(runs, sizeof(double));
+                }
+        }
+
+        /* The inputs of the end-to-end runs: the pixmap, and its COMP40 */
+        FILE *ppm_file = tmpfile();
+        FILE *c40_file = tmpfile();
+        assert(ppm_file != NULL && c40_file != NULL);
+        Pnm_ppmwrite(ppm_file, image);
+        fflush(ppm_file);
+        time_run(compress40, ppm_file, fileno(c40_file));
+        result->c40_bytes = lseek(fileno(c40_file), 0, SEEK_END);
+
+        for (unsigned r = 0; r < runs; r++) {
+                result->total[COMPRESS][r]   = time_run(compress40, ppm_file,
+                                                        fileno(devnull));
+                result->total[DECOMPRESS][r] = time_run(decompress40,
+                                                        c40_file,
+                                                        fileno(devnull));
+
+                double stage[STAGES];
+                time_compress(image, stage, result->counts[COMPRESS],
+                              devnull);
+                for (int s = 0; s < STAGES; s++) {
+                        result->stage[COMPRESS][s][r] = stage[s];
+                }
+                time_decompress(c40_file, stage, result->counts[DECOMPRESS],
+                                devnull);
+                for (int s = 0; s < STAGES; s++) {
+                        result->stage[DECOMPRESS][s][r] = stage[s];
+                }
+        }
+
+        fclose(ppm_file);
+        fclose(c40_file);
+}
+
+/*
+ * [Name]:       time_compress
+ * [Parameters]: 1 ppm (image), 1 double array (stage: set to the seconds
+ *               of each stage), 1 uint64_t array (counts: each stage's
+ *               hardware counts added), 1 FILE* (devnull)
+ * [Return]:     void
+ * [Purpose]:    Runs the compress methods one at a time, timing each
+ * [Errors]:     None
+ */
+void time_compress(ppm image, double stage[STAGES],
+                   uint64_t counts[STAGES][COUNTERS], FILE *devnull)
+{
+        ImageMethods_T img_m = compress;
+        unsigned       len   = (image->width / 2) * (image->height / 2);
+        uint64_t       marks[STAGES + 1][COUNTERS];
+
+        double t0 = checkpoint(marks[0]);
+        UArray_T rgb_blocks = img_m->new_blocks(len, sizeof(struct RGB_block));
+        rgb_blocks = img_m->read(rgb_blocks, image);
+        double t1 = checkpoint(marks[1]);
+        UArray_T xyz_blocks = img_m->new_blocks(len, sizeof(struct XYZ_block));
+        xyz_blocks = img_m->rgb_xyz(xyz_blocks, rgb_blocks);
+        double t2 = checkpoint(marks[2]);
+        UArray_T bit_blocks = img_m->new_blocks(len, sizeof(struct bit_block));
+        bit_blocks = img_m->chroma(bit_blocks, xyz_blocks);
+        double t3 = checkpoint(marks[3]);
+        bit_blocks = img_m->luma(bit_blocks, xyz_blocks);
+        double t4 = checkpoint(marks[4]);
+        UArray_T codewords = img_m->new_blocks(len, sizeof(uint32_t));
+        codewords = img_m->pixpack(codewords, bit_blocks);
+        double t5 = checkpoint(marks[5]);
+        write_header(devnull, image->width, image->height);
+        write_codewords(devnull, codewords);
+        fflush(devnull);
+        double t6 = checkpoint(marks[6]);
+
+        double times[STAGES] = { t1 - t0, t2 - t1, t3 - t2, t4 - t3,
+                                 t5 - t4, t6 - t5 };
+        memcpy(stage, times, sizeof(times));
+        add_counts(counts, marks);
+
+        img_m->free(rgb_blocks, xyz_blocks, bit_blocks, codewords, NULL);
+}
+
+/*
+ * [Name]:       time_decompress
+ * [Parameters]: 1 FILE* (c40_file, a format 2 image), 1 double array
+ *               (stage: set to the seconds of each stage), 1 uint64_t array
+ *               (counts: each stage's hardware counts added), 1 FILE*
+ *               (devnull)
+ * [Return]:     void
+ * [Purpose]:    Runs the decompress methods one at a time, timing each
+ * [Errors]:     CRE if c40_file is not a COMP40 image
+ */
+void time_decompress(FILE *c40_file, double stage[STAGES],
+                     uint64_t counts[STAGES][COUNTERS], FILE *devnull)
+{
+        ImageMethods_T img_m = decompress;
+        uint64_t       marks[STAGES + 1][COUNTERS];
+
+        double t0 = checkpoint(marks[0]);
+        rewind(c40_file);
+        Comp40_T      image  = Comp40_open(c40_file);
+        Comp40_header header = Comp40_info(image);
+        unsigned      bw     = header.width  / 2;
+        unsigned      bh     = header.height / 2;
+        UArray_T codewords = img_m->new_blocks(bw * bh, sizeof(uint32_t));
+        codewords = Comp40_rect(image, 0, 0, bw, bh, codewords);
+        Comp40_close(&image);
+        double t1 = checkpoint(marks[1]);
+        UArray_T bit_blocks = img_m->new_blocks(bw * bh,
+                                                sizeof(struct bit_block));
+        bit_blocks = img_m->pixpack(bit_blocks, codewords);
+        double t2 = checkpoint(marks[2]);
+        UArray_T xyz_blocks = img_m->new_blocks(bw * bh,
+                                                sizeof(struct XYZ_block));
+        xyz_blocks = img_m->luma(xyz_blocks, bit_blocks);
+        double t3 = checkpoint(marks[3]);
+        xyz_blocks = img_m->chroma(xyz_blocks, bit_blocks);
+        double t4 = checkpoint(marks[4]);
+        UArray_T rgb_blocks = img_m->new_blocks(bw * bh,
+                                                sizeof(struct RGB_block));
+        rgb_blocks = img_m->rgb_xyz(rgb_blocks, xyz_blocks);
+        double t5 = checkpoint(marks[5]);
+        ppm pixmap = new_ppm(header.width, header.height);
+        copy_blocks(rgb_blocks, bw, pixmap, 0, 0);
+        Pnm_ppmwrite(devnull, pixmap);
+        fflush(devnull);
+        double t6 = checkpoint(marks[6]);
+
+        double times[STAGES] = { t1 - t0, t2 - t1, t3 - t2, t4 - t3,
+                                 t5 - t4, t6 - t5 };
+        memcpy(stage, times, sizeof(times));
+        add_counts(counts, marks);
+
+        img_m->free(rgb_blocks, xyz_blocks, bit_blocks, codewords, NULL);
+        Pnm_ppmfree(&pixmap);
+}
+
+/*
+ * [Name]:       time_run
+ * [Parameters]: 1 function (run: compress40 or decompress40), 1 FILE*
+ *               (input, rewound first), 1 int (output_fd: where standard
+ *               output goes during the run)
+ * [Return]:     seconds the run took
+ * [Purpose]:    Times one end-to-end run, as 40image would make it
+ * [Errors]:     CRE if standard output cannot be redirected
+ */
+double time_run(void (*run)(FILE *input), FILE *input, int output_fd)
+{
+        rewind(input);
+        fflush(stdout);
+        int saved      = dup(STDOUT_FILENO);
+        int redirected = dup2(output_fd, STDOUT_FILENO);
+        assert(saved >= 0 && redirected >= 0);
+
+        double start = now();
+        run(input);
+        fflush(stdout);
+        double seconds = now() - start;
+
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+
+        return seconds;
+}
+
+/*
+ * [Name]:       now
+ * [Parameters]: None
+ * [Return]:     the monotonic clock, in seconds
+ * [Purpose]:    Time source of every measurement
+ * [Errors]:     None
+ */
+double now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * [Name]:       checkpoint
+ * [Parameters]: 1 uint64_t array (counts: set to the hardware counts so far)
+ * [Return]:     the monotonic clock, in seconds
+ * [Purpose]:    Marks the boundary between two stages: reads the counters
+ *               (if --counters found any), then the clock
+ * [Errors]:     None
+ */
+double checkpoint(uint64_t counts[COUNTERS])
+{
+        if (counting != 0) {
+                counters_read(counts);
+        } else {
+                memset(counts, 0, COUNTERS * sizeof(uint64_t));
+        }
+
+        return now();
+}
+
+/*
+ * [Name]:       add_counts
+ * [Parameters]: 2 uint64_t arrays (counts: per stage, added to; marks: the
+ *               counts at the STAGES + 1 checkpoints of one run)
+ * [Return]:     void
+ * [Purpose]:    Adds the counts of each stage of one run to its total
+ * [Errors]:     None
+ */
+void add_counts(uint64_t counts[STAGES][COUNTERS],
+                uint64_t marks[STAGES + 1][COUNTERS])
+{
+        for (int s = 0; s < STAGES; s++) {
+                for (int i = 0; i < COUNTERS; i++) {
+                        counts[s][i] += marks[s + 1][i] - marks[s][i];
+                }
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                       REPORT FUNCTIONS                       |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       compare_doubles
+ * [Parameters]: 2 const void* (doubles)
+ * [Return]:     negative, zero or positive as the first is less, equal or
+ *               greater
+ * [Purpose]:    qsort comparison for summarize
+ * [Errors]:     None
+ */
+int compare_doubles(const void *a, const void *b)
+{
+        double x = *(const double *)a, y = *(const double *)b;
+
+        return (x > y) - (x < y);
+}
+
+/*
+ * [Name]:       summarize
+ * [Parameters]: 1 const struct bench_result* (the image), 1 const double*
+ *               (times of runs runs), 1 unsigned (runs)
+ * [Return]:     the median and fastest time, and the throughput at the
+ *               median
+ * [Purpose]:    Reduces the runs of one measurement to what is reported
+ * [Errors]:     None
+ */
+struct summary summarize(const struct bench_result *result,
+                         const double *times, unsigned runs)
+{
+        double *sorted = ALLOC(runs * sizeof(double));
+        memcpy(sorted, times, runs * sizeof(double));
+        qsort(sorted, runs, sizeof(double), compare_doubles);
+
+        struct summary s;
+        s.min    = sorted[0];
+        s.median = runs % 2 != 0 ? sorted[runs / 2] :
+                   (sorted[runs / 2 - 1] + sorted[runs / 2]) / 2;
+        FREE(sorted);
+
+        double pixels = (double)result->width * result->height;
+        s.mb_per_s     = s.median > 0 ? 3 * pixels / 1e6 / s.median : 0;
+        s.ns_per_block = s.median * 1e9 / (pixels / 4);
+
+        return s;
+}
+
+/*
+ * [Name]:       print_table
+ * [Parameters]: 1 FILE* (out), 1 const struct bench_result array (results),
+ *               2 unsigned integers (n results, runs)
+ * [Return]:     void
+ * [Purpose]:    Prints one line per direction and stage of each result,
+ *               each stage followed by its hardware counts per block if
+ *               counters were read
+ * [Errors]:     None
+ */
+void print_table(FILE *out, const struct bench_result *results, unsigned n,
+                 unsigned runs)
+{
+        for (unsigned i = 0; i < n; i++) {
+                const struct bench_result *r = &results[i];
+                for (int dir = 0; dir < DIRECTIONS; dir++) {
+                        for (int s = -1; s < STAGES; s++) {
+                                const double *times = s < 0 ? r->total[dir]
+                                                            : r->stage[dir][s];
+                                struct summary sum = summarize(r, times, runs);
+                                fprintf(out, "%-8s %5ux%-5u %-10s %-7s "
+                                        "%9.4f s (min %9.4f) %9.2f MB/s "
+                                        "%9.1f ns/block\n", r->kind,
+                                        r->width, r->height,
+                                        DIRECTION_NAMES[dir],
+                                        s < 0 ? "total"
+                                              : STAGE_NAMES[dir][s],
+                                        sum.median, sum.min, sum.mb_per_s,
+                                        sum.ns_per_block);
+                                if (s < 0 || counting == 0) {
+                                        continue;
+                                }
+
+                                double blocks = (double)runs * r->width *
+                                                r->height / 4;
+                                fprintf(out, "%34s", "per block:");
+                                for (int i = 0; i < COUNTERS; i++) {
+                                        if ((counting & (1u << i)) != 0) {
+                                                fprintf(out, " %s %.2f",
+                                                        counter_name(i),
+                                                        r->counts[dir][s][i] /
+                                                        blocks);
+                                        }
+                                }
+                                fprintf(out, "\n");
+                        }
+                }
+        }
+}
+
+/*
+ * [Name]:       print_json
+ * [Parameters]: 1 FILE* (out), 1 const struct bench_result array (results),
+ *               2 unsigned integers (n results, runs)
+ * [Return]:     void
+ * [Purpose]:    Writes every result as one JSON document:
+ *               { "runs", "images": [ { "kind", "width", "height", "blocks",
+ *               "ppm_bytes", "c40_bytes", "compress" and "decompress": {
+ *               "total", "stages": { name: summary } } } ] }, each summary
+ *               holding "median_s", "min_s", "mb_per_s" and "ns_per_block"
+ *               (and for stages, if counters were read, "counters_per_block":
+ *               { name: mean count }); with --counters, "counters" lists the
+ *               counters read
+ * [Errors]:     None
+ */
+void print_json(FILE *out, const struct bench_result *results, unsigned n,
+                unsigned runs)
+{
+        fprintf(out, "{\n  \"program\": \"40bench\",\n  \"runs\": %u,\n",
+                runs);
+        if (counting != 0) {
+                fprintf(out, "  \"counters\": [");
+                for (int i = 0, listed = 0; i < COUNTERS; i++) {
+                        if ((counting & (1u << i)) != 0) {
+                                fprintf(out, "%s\"%s\"", listed++ ? ", " : "",
+                                        counter_name(i));
+                        }
+                }
+                fprintf(out, "],\n");
+        }
+        fprintf(out, "  \"images\": [\n");
+        for (unsigned i = 0; i < n; i++) {
+                const struct bench_result *r = &results[i];
+                uint64_t pixels = (uint64_t)r->width * r->height;
+                fprintf(out, "    {\n      \"kind\": \"%s\", \"width\": %u, "
+                        "\"height\": %u, \"blocks\": %llu,\n"
+                        "      \"ppm_bytes\": %llu, \"c40_bytes\": %ld,\n",
+                        r->kind, r->width, r->height,
+                        (unsigned long long)(pixels / 4),
+                        (unsigned long long)(3 * pixels), r->c40_bytes);
+                for (int dir = 0; dir < DIRECTIONS; dir++) {
+                        fprintf(out, "      \"%s\": {\n",
+                                DIRECTION_NAMES[dir]);
+                        json_summary(out, "total",
+                                     summarize(r, r->total[dir], runs),
+                                     NULL, 0,
+                                     ",\n        \"stages\": {\n");
+                        for (int s = 0; s < STAGES; s++) {
+                                fprintf(out, "  ");
+                                json_summary(out, STAGE_NAMES[dir][s],
+                                             summarize(r, r->stage[dir][s],
+                                                       runs),
+                                             r->counts[dir][s],
+                                             (double)runs * pixels / 4,
+                                             s + 1 < STAGES ? ",\n" : "\n");
+                        }
+                        fprintf(out, "        }\n      }%s\n",
+                                dir + 1 < DIRECTIONS ? "," : "");
+                }
+                fprintf(out, "    }%s\n", i + 1 < n ? "," : "");
+        }
+        fprintf(out, "  ]\n}\n");
+}
+
+/*
+ * [Name]:       json_summary
+ * [Parameters]: 1 FILE* (out), 1 const char* (name), 1 struct summary, 1
+ *               const uint64_t* (counts: hardware counts of every run, or
+ *               NULL), 1 double (blocks: of every run), 1 const char* (end:
+ *               printed after the object)
+ * [Return]:     void
+ * [Purpose]:    Writes "name": { ... } for one measurement
+ * [Errors]:     None
+ */
+void json_summary(FILE *out, const char *name, struct summary s,
+                  const uint64_t *counts, double blocks, const char *end)
+{
+        fprintf(out, "        \"%s\": { \"median_s\": %.6f, \"min_s\": %.6f, "
+                "\"mb_per_s\": %.3f, \"ns_per_block\": %.1f", name,
+                s.median, s.min, s.mb_per_s, s.ns_per_block);
+        if (counts != NULL && counting != 0) {
+                fprintf(out, ", \"counters_per_block\": {");
+                for (int i = 0, listed = 0; i < COUNTERS; i++) {
+                        if ((counting & (1u << i)) != 0) {
+                                fprintf(out, "%s\"%s\": %.3f",
+                                        listed++ ? ", " : "",
+                                        counter_name(i), counts[i] / blocks);
+                        }
+                }
+                fprintf(out, "}");
+        }
+        fprintf(out, " }%s", end);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
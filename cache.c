@@ -0,0 +1,425 @@
+/*
+ *      cache.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Component file defining all extern and helper functions for the
+ *        cache component
+ *      - Cache layout: one file per result in the cache directory, named by
+ *        the 128-bit key of the job (32 hex digits), holding exactly what
+ *        the job printed; plus a ".lock" file that serializes eviction
+ *      - Component-wide invariants:
+ *              ~ The key hashes CACHE_VERSION, the job's options and every
+ *                input byte, so a result is only reused for an identical
+ *                job; CACHE_VERSION changes whenever the codec's output does
+ *              ~ A result appears under its name only once complete: it is
+ *                written to a private "tmp." file and renamed into place,
+ *                so concurrent processes never see half a result
+ *              ~ A result's modification time is its last use; eviction
+ *                removes the least recently used results first
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "cache.h"
+#include "mem.h"
+
+/* Bumped whenever the output of any 40image job changes */
+static const char *CACHE_VERSION = "COMP40 cache 1";
+
+/* Leftover "tmp." files of crashed jobs older than this are removed */
+static const time_t STALE_SECONDS = 3600;
+
+/* -- A file in the cache directory, as seen by eviction -- */
+struct entry {
+        char            name[64];
+        off_t           size;
+        struct timespec used;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- KEY HELPER FUNCTIONS -- */
+unsigned char *read_all  (FILE *input, size_t *len);
+void           job_key   (const unsigned char *bytes, size_t len,
+                          const char *options, char name[33]);
+uint64_t       hash_bytes(const unsigned char *bytes, size_t len,
+                          uint64_t seed);
+uint64_t       mix       (uint64_t x);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- FILE HELPER FUNCTIONS -- */
+int  store_result(const char *dir, const char *path,
+                  const unsigned char *bytes, size_t len, Cache_job *job,
+                  void *cl);
+void send_result (int fd);
+void evict       (const char *dir, uint64_t max_bytes);
+int  older_first (const void *entry1, const void *entry2);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                        CACHE FUNCTION                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       cache_run
+ * [Parameters]: 1 const char* (dir), 1 uint64_t (max_bytes), 1 const char*
+ *               (options), 1 FILE* (input), 1 Cache_job*, 1 void* (closure
+ *               of job)
+ * [Return]:     void
+ * [Purpose]:    Reads all of input and looks its key up in dir. On a hit,
+ *               marks the result as used and copies it to standard output
+ *               in the kernel; on a miss, runs job with its standard output
+ *               going to a new result, then copies that out and evicts
+ * [Errors]:     CRE if any pointer is NULL
+ */
+void cache_run(const char *dir, uint64_t max_bytes, const char *options,
+               FILE *input, Cache_job *job, void *cl)
+{
+        assert(dir != NULL && options != NULL && input != NULL);
+        assert(job != NULL);
+
+        size_t         len;
+        unsigned char *bytes = read_all(input, &len);
+        char           name[33];
+        job_key(bytes, len, options, name);
+
+        char *path = ALLOC(strlen(dir) + sizeof(name) + 2);
+        sprintf(path, "%s/%s", dir, name);
+
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+                futimens(fd, NULL);
+                send_result(fd);
+                close(fd);
+        } else if (!store_result(dir, path, bytes, len, job, cl)) {
+                /* Unusable directory: the cache is only an optimization */
+                FILE *in = len > 0 ? fmemopen(bytes, len, "r") : tmpfile();
+                assert(in != NULL);
+                job(in, cl);
+                fclose(in);
+        } else {
+                evict(dir, max_bytes);
+        }
+
+        FREE(path);
+        FREE(bytes);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                     KEY HELPER FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       read_all
+ * [Parameters]: 1 FILE* (input), 1 size_t* (len, set to the size read)
+ * [Return]:     malloc'd buffer holding everything left on input
+ * [Purpose]:    Reads the job's input once, to key it and (on a miss) to
+ *               feed it to the job
+ * [Errors]:     None
+ */
+unsigned char *read_all(FILE *input, size_t *len)
+{
+        size_t         cap = 1 << 16;
+        unsigned char *buf = ALLOC(cap);
+        size_t         got;
+
+        *len = 0;
+        while ((got = fread(buf + *len, 1, cap - *len, input)) > 0) {
+                *len += got;
+                if (*len == cap) {
+                        cap *= 2;
+                        RESIZE(buf, cap);
+                }
+        }
+
+        return buf;
+}
+
+/*
+ * [Name]:       job_key
+ * [Parameters]: 1 const unsigned char* (input bytes), 1 size_t (len), 1
+ *               const char* (options), 1 char array (name, filled)
+ * [Return]:     void
+ * [Purpose]:    Names a job's result: two 64-bit hashes of the input, each
+ *               seeded by a different hash of the version and options
+ * [Errors]:     None
+ */
+void job_key(const unsigned char *bytes, size_t len, const char *options,
+             char name[33])
+{
+        size_t         info_len = strlen(CACHE_VERSION) + strlen(options) + 2;
+        unsigned char *info     = ALLOC(info_len);
+        sprintf((char *)info, "%s\n%s", CACHE_VERSION, options);
+
+        uint64_t seed1 = hash_bytes(info, info_len, 0x243f6a8885a308d3ULL);
+        uint64_t seed2 = hash_bytes(info, info_len, 0x13198a2e03707344ULL);
+        FREE(info);
+
+        sprintf(name, "%016llx%016llx",
+                (unsigned long long)hash_bytes(bytes, len, seed1),
+                (unsigned long long)hash_bytes(bytes, len, seed2));
+}
+
+/*
+ * [Name]:       hash_bytes
+ * [Parameters]: 1 const unsigned char* (bytes), 1 size_t (len), 1 uint64_t
+ *               (seed)
+ * [Return]:     64-bit hash of the bytes
+ * [Purpose]:    Hashes a word (8 bytes) at a time, so keying costs little
+ *               next to reading the input
+ * [Errors]:     None
+ */
+uint64_t hash_bytes(const unsigned char *bytes, size_t len, uint64_t seed)
+{
+        const uint64_t prime = 0x9e3779b97f4a7c15ULL;
+        uint64_t       hash  = seed ^ (len * prime);
+        size_t         i     = 0;
+
+        for (; i + 8 <= len; i += 8) {
+                uint64_t word;
+                memcpy(&word, bytes + i, 8);
+                hash = (hash ^ mix(word)) * prime;
+                hash = (hash << 27) | (hash >> 37);
+        }
+
+        uint64_t tail = 0;
+        for (; i < len; i++) {
+                tail = (tail << 8) | bytes[i];
+        }
+
+        return mix(hash ^ mix(tail ^ len));
+}
+
+/*
+ * [Name]:       mix
+ * [Parameters]: 1 uint64_t
+ * [Return]:     x with every input bit spread over every output bit
+ * [Purpose]:    Finalizer for hash_bytes
+ * [Errors]:     None
+ */
+uint64_t mix(uint64_t x)
+{
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+
+        return x;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                    FILE HELPER FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       store_result
+ * [Parameters]: 2 const char* (dir, path of the result), 1 const unsigned
+ *               char* (input bytes), 1 size_t (len), 1 Cache_job*, 1 void*
+ *               (closure of job)
+ * [Return]:     1 if job ran (and its result was printed), 0 if dir could
+ *               not be used and nothing was run
+ * [Purpose]:    Runs job on the input bytes with standard output redirected
+ *               into a private file in dir, publishes that file as the
+ *               result, and prints it
+ * [Errors]:     None
+ */
+int store_result(const char *dir, const char *path,
+                 const unsigned char *bytes, size_t len, Cache_job *job,
+                 void *cl)
+{
+        if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+                return 0;
+        }
+
+        char *tmp = ALLOC(strlen(dir) + sizeof("/tmp.XXXXXX"));
+        sprintf(tmp, "%s/tmp.XXXXXX", dir);
+        int fd = mkstemp(tmp);
+        if (fd < 0) {
+                FREE(tmp);
+                return 0;
+        }
+
+        FILE *in = len > 0 ? fmemopen((void *)bytes, len, "r") : tmpfile();
+        assert(in != NULL);
+
+        /* Job prints into the private file */
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        assert(saved >= 0);
+        dup2(fd, STDOUT_FILENO);
+        job(in, cl);
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        fclose(in);
+
+        if (rename(tmp, path) != 0) {
+                unlink(tmp);
+        }
+        FREE(tmp);
+
+        lseek(fd, 0, SEEK_SET);
+        send_result(fd);
+        close(fd);
+
+        return 1;
+}
+
+/*
+ * [Name]:       send_result
+ * [Parameters]: 1 int (fd of a result)
+ * [Return]:     void
+ * [Purpose]:    Copies a whole result to standard output without passing it
+ *               through user space: sendfile, else copy_file_range, else
+ *               (e.g. on old kernels) plain reads and writes
+ * [Errors]:     CRE if standard output cannot be written
+ */
+void send_result(int fd)
+{
+        struct stat info;
+        int err = fstat(fd, &info);
+        assert(err == 0);
+
+        off_t   offset = 0;
+        off_t   left   = info.st_size;
+        ssize_t sent   = 1;
+
+        fflush(stdout);
+        while (left > 0 && sent > 0) {
+                sent = sendfile(STDOUT_FILENO, fd, &offset, left);
+                left -= sent > 0 ? sent : 0;
+        }
+        for (sent = 1; left > 0 && sent > 0; left -= sent > 0 ? sent : 0) {
+                loff_t in_offset = offset;
+                sent = copy_file_range(fd, &in_offset, STDOUT_FILENO, NULL,
+                                       left, 0);
+                offset = in_offset;
+        }
+
+        char buf[1 << 16];
+        while (left > 0) {
+                ssize_t got = pread(fd, buf, sizeof(buf), offset);
+                assert(got > 0);
+                ssize_t put = write(STDOUT_FILENO, buf, got);
+                assert(put == got);
+                offset += got;
+                left   -= got;
+        }
+}
+
+/*
+ * [Name]:       evict
+ * [Parameters]: 1 const char* (dir), 1 uint64_t (max_bytes)
+ * [Return]:     void
+ * [Purpose]:    Removes the least recently used results until the results
+ *               in dir take at most max_bytes, and removes leftovers of
+ *               crashed jobs. Holds an exclusive lock on dir/.lock, so that
+ *               concurrent processes evict one at a time
+ *               Note: A result removed while another process is sending it
+ *                      stays readable to that process
+ * [Errors]:     None
+ */
+void evict(const char *dir, uint64_t max_bytes)
+{
+        char *lock_path = ALLOC(strlen(dir) + sizeof("/.lock"));
+        sprintf(lock_path, "%s/.lock", dir);
+        int lock = open(lock_path, O_CREAT | O_RDWR, 0666);
+        FREE(lock_path);
+        if (lock < 0 || flock(lock, LOCK_EX) != 0) {
+                if (lock >= 0) {
+                        close(lock);
+                }
+                return;
+        }
+
+        DIR *d = opendir(dir);
+        if (d == NULL) {
+                close(lock);
+                return;
+        }
+
+        size_t        len = 0, cap = 64;
+        struct entry *entries = ALLOC(cap * sizeof(*entries));
+        uint64_t      total   = 0;
+        time_t        now     = time(NULL);
+        char         *path    = ALLOC(strlen(dir) + sizeof(entries->name) + 2);
+
+        struct dirent *file;
+        while ((file = readdir(d)) != NULL) {
+                struct stat info;
+                if (file->d_name[0] == '.' ||
+                    strlen(file->d_name) >= sizeof(entries->name)) {
+                        continue;
+                }
+                sprintf(path, "%s/%s", dir, file->d_name);
+                if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+                        continue;
+                }
+
+                if (strncmp(file->d_name, "tmp.", 4) == 0) {
+                        if (now - info.st_mtime > STALE_SECONDS) {
+                                unlink(path);
+                        } else {
+                                total += info.st_size;
+                        }
+                        continue;
+                }
+
+                if (len == cap) {
+                        cap *= 2;
+                        RESIZE(entries, cap * sizeof(*entries));
+                }
+                strcpy(entries[len].name, file->d_name);
+                entries[len].size = info.st_size;
+                entries[len].used = info.st_mtim;
+                total += info.st_size;
+                len++;
+        }
+        closedir(d);
+
+        qsort(entries, len, sizeof(*entries), older_first);
+        for (size_t i = 0; i < len && total > max_bytes; i++) {
+                sprintf(path, "%s/%s", dir, entries[i].name);
+                if (unlink(path) == 0) {
+                        total -= entries[i].size;
+                }
+        }
+
+        FREE(path);
+        FREE(entries);
+        flock(lock, LOCK_UN);
+        close(lock);
+}
+
+/*
+ * [Name]:       older_first
+ * [Parameters]: 2 const void* (struct entry)
+ * [Return]:     negative, zero or positive as entry1 was used before, at
+ *               the same time as, or after entry2
+ * [Purpose]:    qsort comparison putting the least recently used first
+ * [Errors]:     None
+ */
+int older_first(const void *entry1, const void *entry2)
+{
+        const struct timespec *t1 = &((const struct entry *)entry1)->used;
+        const struct timespec *t2 = &((const struct entry *)entry2)->used;
+
+        if (t1->tv_sec != t2->tv_sec) {
+                return t1->tv_sec < t2->tv_sec ? -1 : 1;
+        }
+        return (t1->tv_nsec > t2->tv_nsec) - (t1->tv_nsec < t2->tv_nsec);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
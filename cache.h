@@ -0,0 +1,39 @@
+/*
+ *      cache.h
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Header file declaring client-accessible functions for the cache
+ *        component
+ *      - Component keeps the outputs of earlier 40image jobs in a directory,
+ *        keyed by a hash of the job's input bytes and options, so a job
+ *        seen before is answered by copying the stored output to standard
+ *        output without running the pipeline
+ *      - The directory is bounded in size: the least recently used outputs
+ *        are evicted first. Any number of processes may share it
+ */
+
+#ifndef CACHE_INCLUDED
+#define CACHE_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* A job: reads input, and prints its whole result on standard output */
+typedef void Cache_job(FILE *input, void *cl);
+
+/* Default bound on the size of a cache directory, in bytes */
+static const uint64_t CACHE_DEFAULT_MAX = (uint64_t)256 << 20;
+
+/*
+ * Prints the result of job on input to standard output, from the cache in
+ * dir if an earlier job with the same options (described by the string
+ * options) had the same input bytes, otherwise by running job and storing
+ * its result; then evicts old results until dir holds at most max_bytes
+ * Note: If dir cannot be used, job simply runs uncached
+ * CRE: parameters cannot be NULL
+ */
+extern void cache_run(const char *dir, uint64_t max_bytes,
+                      const char *options, FILE *input, Cache_job *job,
+                      void *cl);
+
+#endif /* CACHE_INCLUDED */
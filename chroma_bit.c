@@ -11,8 +11,11 @@
  *              ~ {Pb, Pr} range is [-0.5, 0.5]
  *              ~ Blocks passed in as "input" are not modified
  *              ~ {Index Pb, Index Pr} range is [0, 15]
+ *              ~ Chroma indices of other widths (parameter sweeps only) are
+ *                uniform over [-0.5, 0.5], with a level at 0
  */
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -21,10 +24,8 @@
 #include "mem.h"
 #include "chroma_bit.h"
 
-/* -- COMPRESSION AVERAGE HELPER FUNCTIONS -- */
-float average_Pb(XYZ_block xyz);
-float average_Pr(XYZ_block xyz);
-/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+/* -- Chroma values span [-CHROMA_MAX, CHROMA_MAX] -- */
+static const float CHROMA_MAX = 0.5;
 
 /* -- DECOPMRESSION HELPER FUNCTIONS -- */
 XYZ_block store_Pb(XYZ_block xyz, float Pb);
@@ -178,4 +179,65 @@ XYZ_block store_Pr(XYZ_block xyz, float Pr)
 
         return xyz;
 }
-/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
\ No newline at end of file
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                       LAYOUT FUNCTIONS                       |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       quantize_chroma
+ * [Parameters]: 1 float (value), 1 int (size of the index in bits)
+ * [Return]:     index of value, in [0, 2^bitsize - 2]
+ * [Purpose]:    Quantizes a chroma value at any width; 4 bits is the codec's
+ *               own (nonuniform) Arith40 index, so a sweep matches compress40
+ *               Note: Other widths round to the nearest of 2^bitsize - 1
+ *                     evenly spaced values, an odd number so that gray
+ *                     (0, index 2^(bitsize - 1) - 1) stays gray; the top
+ *                     index is unused, and 1 bit holds only 0
+ * [Errors]:     CRE if bitsize is not in [1, 16]
+ */
+unsigned quantize_chroma(float value, int bitsize)
+{
+        assert(bitsize >= 1 && bitsize <= 16);
+        if (bitsize == PB_WIDTH) {
+                return Arith40_index_of_chroma(value);
+        }
+
+        float steps = (1u << bitsize) - 2;
+        if (steps == 0) {
+                return 0;
+        }
+        if (value > CHROMA_MAX) {
+                value = CHROMA_MAX;
+        } else if (value < -CHROMA_MAX) {
+                value = -CHROMA_MAX;
+        }
+
+        return lroundf((value + CHROMA_MAX) / (2 * CHROMA_MAX) * steps);
+}
+
+/*
+ * [Name]:       scale_chroma
+ * [Parameters]: 1 unsigned (index), 1 int (size of the index in bits)
+ * [Return]:     the chroma value of index
+ * [Purpose]:    Inverse of quantize_chroma
+ * [Errors]:     CRE if bitsize is not in [1, 16]
+ */
+float scale_chroma(unsigned index, int bitsize)
+{
+        assert(bitsize >= 1 && bitsize <= 16);
+        if (bitsize == PB_WIDTH) {
+                return Arith40_chroma_of_index(index);
+        }
+
+        float steps = (1u << bitsize) - 2;
+        if (steps == 0) {
+                return 0.0;
+        }
+        if (index > steps) {
+                index = steps;
+        }
+
+        return index / steps * (2 * CHROMA_MAX) - CHROMA_MAX;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -28,4 +28,22 @@ extern bit_block chroma_to_bit(XYZ_block xyz, bit_block bit);
 extern XYZ_block bit_to_chroma(bit_block bit, XYZ_block xyz);
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
-#endif /* CHROMA_INCLUDED */
\ No newline at end of file
+/* -- LAYOUT FUNCTIONS -- */
+/*
+ * Return the mean Pb (or Pr) of the pixels of xyz, before quantization
+ * CRE: xyz cannot be NULL
+ */
+extern float average_Pb(XYZ_block xyz);
+extern float average_Pr(XYZ_block xyz);
+
+/*
+ * Quantize a chroma value into an index of bitsize bits, and back; 4-bit
+ * indices are those of the codec (Arith40), other widths are spread evenly
+ * over [-0.5, 0.5]
+ * CRE: bitsize must be in [1, 16]
+ */
+extern unsigned quantize_chroma(float value, int bitsize);
+extern float    scale_chroma   (unsigned index, int bitsize);
+/* ^^^^^^^^^^^^^^^^^^^^ */
+
+#endif /* CHROMA_INCLUDED */
\ No newline at end of file
@@ -0,0 +1,853 @@
+/*
+ *      codeword_io.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Component file defining all extern and helper functions for the
+ *        codeword_io component
+ *      - Component reads and writes the COMP40 file formats (2: flat,
+ *        3: tiled), and reads any rectangle of blocks from either
+ *      - Format 3 tile payloads are coded "raw" (big-endian codewords),
+ *        "huff" (see entropy.h) or "rle" (runs of identical codewords, each
+ *        a LEB128 run length followed by the codeword); each tile decodes on
+ *        its own either way
+ *      - Component-wide invariants:
+ *              ~ Header dimensions are always even
+ *              ~ Format 2: codeword of block (x, y) is at byte offset
+ *                base + CODEWORD_BYTES * (y * (width / 2) + x)
+ *              ~ Format 3: tile t spans bytes [offsets[t], offsets[t + 1])
+ *                after the index; tiles are tile x tile blocks (smaller
+ *                along the right/bottom edges), in row-major order of tiles
+ *              ~ Decoded tiles are cached one tile row at a time, so reading
+ *                a tiled image row by row fetches each tile only once
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "codeword_io.h"
+#include "entropy.h"
+#include "mem.h"
+
+#define T Comp40_T
+
+struct T {
+        FILE         *input;
+        Comp40_header header;
+        unsigned      blocks_wide, blocks_high;
+        int           seekable;
+        long          base;          /* file offset of codewords/payload */
+        unsigned      next_row;      /* format 2 pipes: next unread row  */
+
+        /* -- format 3 only -- */
+        unsigned       tiles_wide, tiles_high;
+        uint64_t      *offsets;      /* tiles + 1 payload offsets        */
+        unsigned char *payload;      /* whole payload, if not seekable   */
+        size_t         payload_len;  /* its length in bytes              */
+
+        /* -- tile cache: slot (t % cache_len) holds tile t, if tag == t -- */
+        unsigned        cache_len;
+        int            *cache_tags;
+        UArray_T       *cache_tiles;
+        pthread_mutex_t cache_lock;
+};
+
+/* -- OPEN HELPER FUNCTIONS -- */
+void           read_index   (T image);
+unsigned char *read_rest    (FILE *input, size_t *len);
+int            is_seekable  (FILE *input);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- RECTANGLE HELPER FUNCTIONS -- */
+void     rect_flat  (T image, unsigned bx, unsigned by, unsigned bw,
+                     unsigned bh, UArray_T codewords);
+void     rect_tiled (T image, unsigned bx, unsigned by, unsigned bw,
+                     unsigned bh, UArray_T codewords);
+UArray_T cached_tile(T image, unsigned index);
+void     read_bytes (FILE *input, long offset, unsigned char *buf,
+                     size_t len);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- TILE PAYLOAD FUNCTIONS -- */
+int            known_coding  (const char *coding);
+void           decode_payload(const char *coding, const unsigned char *bytes,
+                              size_t len, unsigned blocks_wide,
+                              UArray_T codewords);
+unsigned char *encode_payload(const char *coding, UArray_T codewords,
+                              unsigned blocks_wide, size_t *len);
+unsigned char *encode_rle    (UArray_T codewords, size_t *len);
+void           decode_rle    (const unsigned char *bytes, size_t len,
+                              UArray_T codewords);
+uint64_t       get_offset    (const unsigned char *bytes);
+void           put_offset    (unsigned char *bytes, uint64_t offset);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                        READ FUNCTIONS                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       Comp40_open
+ * [Parameters]: 1 FILE* (input)
+ * [Return]:     Comp40_T for the image on input
+ * [Purpose]:    Reads a COMP40 header of any supported format from input,
+ *               and for format 3 the tile index as well
+ *               Note: Tiled input that is not seekable is read into memory
+ * [Errors]:     CRE if input is NULL or header is malformed
+ */
+T Comp40_open(FILE *input)
+{
+        assert(input != NULL);
+
+        T image;
+        NEW0(image);
+        image->input = input;
+
+        Comp40_header *header = &image->header;
+        int read = fscanf(input, "COMP40 Compressed image format %u\n",
+                          &header->format);
+        assert(read == 1);
+
+        if (header->format == 2) {
+                read = fscanf(input, "%u %u", &header->width, &header->height);
+                assert(read == 2);
+        } else {
+                assert(header->format == 3);
+                read = fscanf(input, "%u %u %u %15s", &header->width,
+                              &header->height, &header->tile, header->coding);
+                assert(read == 4 && header->tile > 0);
+                assert(known_coding(header->coding));
+        }
+        int c = getc(input);
+        assert(c == '\n');
+
+        image->blocks_wide = header->width  / 2;
+        image->blocks_high = header->height / 2;
+        image->seekable    = is_seekable(input);
+        image->base        = image->seekable ? ftell(input) : -1;
+
+        if (header->format == 3) {
+                read_index(image);
+        }
+
+        return image;
+}
+
+/*
+ * [Name]:       Comp40_info
+ * [Parameters]: 1 Comp40_T
+ * [Return]:     header of the image
+ * [Purpose]:    Gives clients the image's format and dimensions
+ * [Errors]:     CRE if image is NULL
+ */
+Comp40_header Comp40_info(T image)
+{
+        assert(image != NULL);
+
+        return image->header;
+}
+
+/*
+ * [Name]:       Comp40_rect
+ * [Parameters]: 1 Comp40_T, 4 unsigned integers (block column and row of
+ *               the rectangle, its width and height in blocks), 1 UArray
+ *               (codewords, length bw * bh)
+ * [Return]:     codewords, filled with the rectangle in row-major order
+ * [Purpose]:    Reads only the codewords of the given rectangle, from
+ *               whichever format the image is stored in
+ * [Errors]:     CRE if any pointer is NULL, the rectangle does not fit or
+ *                   input ends early
+ */
+UArray_T Comp40_rect(T image, unsigned bx, unsigned by, unsigned bw,
+                     unsigned bh, UArray_T codewords)
+{
+        assert(image != NULL && codewords != NULL);
+        assert(bx + bw <= image->blocks_wide && by + bh <= image->blocks_high);
+        assert(UArray_length(codewords) == (int)(bw * bh));
+
+        if (image->header.format == 2) {
+                rect_flat (image, bx, by, bw, bh, codewords);
+        } else {
+                rect_tiled(image, bx, by, bw, bh, codewords);
+        }
+
+        return codewords;
+}
+
+/*
+ * [Name]:       Comp40_tiles
+ * [Parameters]: 1 Comp40_T
+ * [Return]:     number of tiles in a tiled image
+ * [Purpose]:    Lets clients iterate over (or divide up) the tiles
+ * [Errors]:     CRE if image is NULL or not tiled
+ */
+unsigned Comp40_tiles(T image)
+{
+        assert(image != NULL && image->header.format == 3);
+
+        return image->tiles_wide * image->tiles_high;
+}
+
+/*
+ * [Name]:       Comp40_tile_rect
+ * [Parameters]: 1 Comp40_T, 1 unsigned (tile index), 4 unsigned* (block
+ *               column, row, width and height of the tile)
+ * [Return]:     void
+ * [Purpose]:    Gives the rectangle of blocks covered by a tile
+ * [Errors]:     CRE if any pointer is NULL, image is not tiled or index is
+ *                   out of range
+ */
+void Comp40_tile_rect(T image, unsigned index, unsigned *bx, unsigned *by,
+                      unsigned *bw, unsigned *bh)
+{
+        assert(bx != NULL && by != NULL && bw != NULL && bh != NULL);
+        assert(index < Comp40_tiles(image));
+
+        unsigned tile = image->header.tile;
+
+        *bx = (index % image->tiles_wide) * tile;
+        *by = (index / image->tiles_wide) * tile;
+        *bw = image->blocks_wide - *bx < tile ? image->blocks_wide - *bx : tile;
+        *bh = image->blocks_high - *by < tile ? image->blocks_high - *by : tile;
+}
+
+/*
+ * [Name]:       Comp40_tile
+ * [Parameters]: 1 Comp40_T, 1 unsigned (tile index), 1 UArray (codewords,
+ *               length of the tile in blocks)
+ * [Return]:     codewords, filled with the tile in row-major order
+ * [Purpose]:    Fetches and decodes a single tile, without touching any other
+ *               part of the file; safe to call from several threads at once
+ * [Errors]:     CRE if any pointer is NULL, image is not tiled, index is out
+ *                   of range or codewords has the wrong length
+ */
+UArray_T Comp40_tile(T image, unsigned index, UArray_T codewords)
+{
+        assert(codewords != NULL);
+        assert(index < Comp40_tiles(image));
+
+        unsigned bx, by, bw, bh;
+        Comp40_tile_rect(image, index, &bx, &by, &bw, &bh);
+        assert(UArray_length(codewords) == (int)(bw * bh));
+
+        uint64_t start = image->offsets[index];
+        size_t   len   = image->offsets[index + 1] - start;
+
+        if (image->seekable) {
+                unsigned char *bytes = ALLOC(len + 1);
+                read_bytes(image->input, image->base + start, bytes, len);
+                decode_payload(image->header.coding, bytes, len, bw,
+                               codewords);
+                FREE(bytes);
+        } else {
+                decode_payload(image->header.coding, image->payload + start,
+                               len, bw, codewords);
+        }
+
+        return codewords;
+}
+
+/*
+ * [Name]:       Comp40_close
+ * [Parameters]: 1 Comp40_T*
+ * [Return]:     void
+ * [Purpose]:    Frees the image, its tile index and its cached tiles
+ *               Note: Does not close the input stream
+ * [Errors]:     CRE if image is NULL
+ */
+void Comp40_close(T *image)
+{
+        assert(image != NULL && *image != NULL);
+
+        T img = *image;
+
+        for (unsigned i = 0; i < img->cache_len; i++) {
+                if (img->cache_tiles[i] != NULL) {
+                        UArray_free(&img->cache_tiles[i]);
+                }
+        }
+
+        if (img->header.format == 3) {
+                pthread_mutex_destroy(&img->cache_lock);
+                FREE(img->cache_tags);
+                FREE(img->cache_tiles);
+                FREE(img->offsets);
+        }
+        if (img->payload != NULL) {
+                FREE(img->payload);
+        }
+
+        FREE(*image);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                    OPEN HELPER FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       read_index
+ * [Parameters]: 1 Comp40_T
+ * [Return]:     void
+ * [Purpose]:    Reads the tile offset index of a tiled image, and sets up its
+ *               tile cache
+ * [Errors]:     CRE if input ends early, or (on a pipe) the payload is
+ *               shorter than the index says
+ */
+void read_index(T image)
+{
+        unsigned tile = image->header.tile;
+
+        image->tiles_wide = (image->blocks_wide + tile - 1) / tile;
+        image->tiles_high = (image->blocks_high + tile - 1) / tile;
+
+        unsigned tiles = image->tiles_wide * image->tiles_high;
+        unsigned char *bytes = ALLOC((tiles + 1) * OFFSET_BYTES);
+        size_t got = fread(bytes, OFFSET_BYTES, tiles + 1, image->input);
+        assert(got == tiles + 1);
+
+        image->offsets = ALLOC((tiles + 1) * sizeof(uint64_t));
+        for (unsigned t = 0; t <= tiles; t++) {
+                image->offsets[t] = get_offset(bytes + t * OFFSET_BYTES);
+                assert(t == 0 || image->offsets[t] >= image->offsets[t - 1]);
+        }
+        FREE(bytes);
+
+        if (image->seekable) {
+                image->base = ftell(image->input);
+        } else {
+                image->payload = read_rest(image->input,
+                                           &image->payload_len);
+                assert(image->offsets[tiles] <= image->payload_len);
+        }
+
+        image->cache_len   = image->tiles_wide > 0 ? image->tiles_wide : 1;
+        image->cache_tags  = ALLOC(image->cache_len * sizeof(int));
+        image->cache_tiles = CALLOC(image->cache_len, sizeof(UArray_T));
+        for (unsigned i = 0; i < image->cache_len; i++) {
+                image->cache_tags[i] = -1;
+        }
+        pthread_mutex_init(&image->cache_lock, NULL);
+}
+
+/*
+ * [Name]:       read_rest
+ * [Parameters]: 1 FILE* (input), 1 size_t* (len, set to the bytes read)
+ * [Return]:     malloc'd buffer holding everything left on input
+ * [Purpose]:    Reads the tile payload of a tiled image that arrives on a
+ *               pipe, so tiles can still be fetched in any order
+ * [Errors]:     None
+ */
+unsigned char *read_rest(FILE *input, size_t *len)
+{
+        size_t cap = 1 << 16;
+        unsigned char *buf = ALLOC(cap);
+
+        *len = 0;
+        size_t got;
+        while ((got = fread(buf + *len, 1, cap - *len, input)) > 0) {
+                *len += got;
+                if (*len == cap) {
+                        cap *= 2;
+                        RESIZE(buf, cap);
+                }
+        }
+
+        return buf;
+}
+
+/*
+ * [Name]:       is_seekable
+ * [Parameters]: 1 FILE* (input)
+ * [Return]:     1 if input is backed by a regular file, 0 otherwise
+ * [Purpose]:    Decides whether codewords can be addressed directly by
+ *               offset, or must be read sequentially (e.g. from a pipe)
+ * [Errors]:     None
+ */
+int is_seekable(FILE *input)
+{
+        struct stat info;
+
+        if (fstat(fileno(input), &info) != 0) {
+                return 0;
+        }
+
+        return S_ISREG(info.st_mode);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                 RECTANGLE HELPER FUNCTIONS                   |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       rect_flat
+ * [Parameters]: 1 Comp40_T, 4 unsigned integers (rectangle in blocks),
+ *               1 UArray (codewords)
+ * [Return]:     void
+ * [Purpose]:    Reads a rectangle of a format 2 image. Each row of the
+ *               rectangle is one contiguous run in the file, so seekable
+ *               input is read with one pread per row; a pipe is read
+ *               sequentially and the rows outside the rectangle are skipped
+ * [Errors]:     CRE if input ends early, or a pipe is read out of order
+ */
+void rect_flat(T image, unsigned bx, unsigned by, unsigned bw, unsigned bh,
+               UArray_T codewords)
+{
+        size_t row_len = (size_t)image->blocks_wide * CODEWORD_BYTES;
+        unsigned char *buf = ALLOC(row_len + 1);
+
+        /* Sequential input: skip rows above rectangle */
+        assert(image->seekable || by >= image->next_row);
+        for (; !image->seekable && image->next_row < by; image->next_row++) {
+                read_bytes(image->input, -1, buf, row_len);
+        }
+
+        int cell = 0;
+        for (unsigned row = by; row < by + bh; row++) {
+                unsigned char *bytes = buf;
+
+                if (image->seekable) {
+                        long offset = image->base +
+                                      ((long)row * image->blocks_wide + bx) *
+                                      CODEWORD_BYTES;
+                        read_bytes(image->input, offset, buf,
+                                   (size_t)bw * CODEWORD_BYTES);
+                } else {
+                        read_bytes(image->input, -1, buf, row_len);
+                        image->next_row++;
+                        bytes += (size_t)bx * CODEWORD_BYTES;
+                }
+
+                for (unsigned col = 0; col < bw; col++) {
+                        uint32_t *codeword = UArray_at(codewords, cell++);
+                        *codeword = get_codeword(bytes + col * CODEWORD_BYTES);
+                }
+        }
+
+        FREE(buf);
+}
+
+/*
+ * [Name]:       rect_tiled
+ * [Parameters]: 1 Comp40_T, 4 unsigned integers (rectangle in blocks),
+ *               1 UArray (codewords)
+ * [Return]:     void
+ * [Purpose]:    Reads a rectangle of a format 3 image by copying the
+ *               overlapping part of every tile it touches
+ * [Errors]:     CRE if input ends early
+ */
+void rect_tiled(T image, unsigned bx, unsigned by, unsigned bw, unsigned bh,
+                UArray_T codewords)
+{
+        unsigned tile = image->header.tile;
+
+        for (unsigned ty = by / tile; ty * tile < by + bh; ty++) {
+                for (unsigned tx = bx / tile; tx * tile < bx + bw; tx++) {
+                        unsigned index = ty * image->tiles_wide + tx;
+                        unsigned tbx, tby, tbw, tbh;
+                        Comp40_tile_rect(image, index, &tbx, &tby, &tbw,
+                                         &tbh);
+
+                        /* Overlap of tile and rectangle, in image blocks */
+                        unsigned x0 = tbx > bx ? tbx : bx;
+                        unsigned y0 = tby > by ? tby : by;
+                        unsigned x1 = tbx + tbw < bx + bw ? tbx + tbw : bx + bw;
+                        unsigned y1 = tby + tbh < by + bh ? tby + tbh : by + bh;
+
+                        pthread_mutex_lock(&image->cache_lock);
+                        UArray_T cached = cached_tile(image, index);
+                        for (unsigned y = y0; y < y1; y++) {
+                                for (unsigned x = x0; x < x1; x++) {
+                                        uint32_t *src = UArray_at(cached,
+                                                (y - tby) * tbw + (x - tbx));
+                                        uint32_t *dst = UArray_at(codewords,
+                                                (y - by) * bw + (x - bx));
+                                        *dst = *src;
+                                }
+                        }
+                        pthread_mutex_unlock(&image->cache_lock);
+                }
+        }
+}
+
+/*
+ * [Name]:       cached_tile
+ * [Parameters]: 1 Comp40_T, 1 unsigned (tile index)
+ * [Return]:     decoded codewords of the tile, owned by the cache
+ * [Purpose]:    Returns the tile from the cache, fetching and decoding it
+ *               first if its slot holds a different tile
+ *               Note: Caller must hold cache_lock
+ * [Errors]:     CRE if input ends early
+ */
+UArray_T cached_tile(T image, unsigned index)
+{
+        unsigned slot = index % image->cache_len;
+
+        if (image->cache_tags[slot] != (int)index) {
+                unsigned bx, by, bw, bh;
+                Comp40_tile_rect(image, index, &bx, &by, &bw, &bh);
+
+                if (image->cache_tiles[slot] != NULL) {
+                        UArray_free(&image->cache_tiles[slot]);
+                }
+                image->cache_tiles[slot] = UArray_new(bw * bh,
+                                                      sizeof(uint32_t));
+                Comp40_tile(image, index, image->cache_tiles[slot]);
+                image->cache_tags[slot] = index;
+        }
+
+        return image->cache_tiles[slot];
+}
+
+/*
+ * [Name]:       read_bytes
+ * [Parameters]: 1 FILE* (input), 1 long (offset, or -1 for sequential
+ *               input), 1 unsigned char* (buf), 1 size_t (len)
+ * [Return]:     void
+ * [Purpose]:    Reads len bytes into buf, with pread at the given offset or
+ *               from the current position of input
+ * [Errors]:     CRE if input ends early
+ */
+void read_bytes(FILE *input, long offset, unsigned char *buf, size_t len)
+{
+        if (offset < 0) {
+                size_t got = fread(buf, 1, len, input);
+                assert(got == len);
+                return;
+        }
+
+        size_t done = 0;
+        while (done < len) {
+                ssize_t got = pread(fileno(input), buf + done, len - done,
+                                    offset + done);
+                assert(got > 0);
+                done += got;
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                       WRITE FUNCTIONS                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       write_header
+ * [Parameters]: 1 FILE* (output), 2 unsigned integers (width, height)
+ * [Return]:     void
+ * [Purpose]:    Prints a format 2 COMP40 header for the given dimensions
+ * [Errors]:     CRE if output is NULL
+ */
+void write_header(FILE *output, unsigned width, unsigned height)
+{
+        assert(output != NULL);
+
+        fprintf(output, "COMP40 Compressed image format 2\n%u %u\n",
+                width, height);
+}
+
+/*
+ * [Name]:       write_codewords
+ * [Parameters]: 1 FILE* (output), 1 UArray (codewords)
+ * [Return]:     void
+ * [Purpose]:    Prints codewords to output in big-endian order with a single
+ *               bulk write
+ * [Errors]:     CRE if any parameter is NULL
+ */
+void write_codewords(FILE *output, UArray_T codewords)
+{
+        assert(output != NULL && codewords != NULL);
+
+        size_t len;
+        unsigned char *buf = encode_payload("raw", codewords, 0, &len);
+
+        fwrite(buf, 1, len, output);
+        FREE(buf);
+}
+
+/*
+ * [Name]:       write_tiled
+ * [Parameters]: 1 FILE* (output), 1 UArray (codewords, row-major), 3
+ *               unsigned integers (width, height in pixels, tile side in
+ *               blocks), 1 const char* (coding of the tile payloads)
+ * [Return]:     void
+ * [Purpose]:    Prints a format 3 image: the header, the index of tile
+ *               offsets, then each tile's payload in tile-major order
+ * [Errors]:     CRE if any pointer is NULL, tile is 0, coding is unknown or
+ *                   codewords does not match the dimensions
+ */
+void write_tiled(FILE *output, UArray_T codewords, unsigned width,
+                 unsigned height, unsigned tile, const char *coding)
+{
+        assert(output != NULL && codewords != NULL && tile > 0);
+        assert(coding != NULL && known_coding(coding));
+
+        unsigned blocks_wide = width / 2;
+        unsigned blocks_high = height / 2;
+        assert(UArray_length(codewords) == (int)(blocks_wide * blocks_high));
+
+        unsigned tiles_wide = (blocks_wide + tile - 1) / tile;
+        unsigned tiles_high = (blocks_high + tile - 1) / tile;
+        unsigned tiles      = tiles_wide * tiles_high;
+
+        unsigned char **payloads = ALLOC((tiles + 1) * sizeof(*payloads));
+        unsigned char  *index    = ALLOC((tiles + 1) * OFFSET_BYTES);
+        uint64_t        offset   = 0;
+
+        for (unsigned t = 0; t < tiles; t++) {
+                unsigned bx = (t % tiles_wide) * tile;
+                unsigned by = (t / tiles_wide) * tile;
+                unsigned bw = blocks_wide - bx < tile ? blocks_wide - bx : tile;
+                unsigned bh = blocks_high - by < tile ? blocks_high - by : tile;
+
+                UArray_T tile_words = UArray_new(bw * bh, sizeof(uint32_t));
+                for (unsigned y = 0; y < bh; y++) {
+                        memcpy(UArray_at(tile_words, y * bw),
+                               UArray_at(codewords, (by + y) * blocks_wide + bx),
+                               bw * sizeof(uint32_t));
+                }
+
+                size_t len;
+                payloads[t] = encode_payload(coding, tile_words, bw, &len);
+                UArray_free(&tile_words);
+
+                put_offset(index + t * OFFSET_BYTES, offset);
+                offset += len;
+        }
+        put_offset(index + tiles * OFFSET_BYTES, offset);
+
+        fprintf(output, "COMP40 Compressed image format 3\n%u %u %u %s\n",
+                width, height, tile, coding);
+        fwrite(index, OFFSET_BYTES, tiles + 1, output);
+        for (unsigned t = 0; t < tiles; t++) {
+                uint64_t len = get_offset(index + (t + 1) * OFFSET_BYTES) -
+                               get_offset(index + t * OFFSET_BYTES);
+                fwrite(payloads[t], 1, len, output);
+                FREE(payloads[t]);
+        }
+
+        FREE(index);
+        FREE(payloads);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                   TILE PAYLOAD FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       known_coding
+ * [Parameters]: 1 const char* (coding)
+ * [Return]:     1 if coding names a supported tile payload coding, else 0
+ * [Purpose]:    Validates codings from headers and from clients
+ * [Errors]:     None
+ */
+int known_coding(const char *coding)
+{
+        return strcmp(coding, "raw")  == 0 || strcmp(coding, "huff") == 0 ||
+               strcmp(coding, "rle")  == 0;
+}
+
+/*
+ * [Name]:       decode_payload
+ * [Parameters]: 1 const char* (coding), 1 const unsigned char* (bytes),
+ *               1 size_t (len of bytes), 1 unsigned (tile width in
+ *               blocks), 1 UArray (codewords)
+ * [Return]:     void
+ * [Purpose]:    Decodes a tile payload into its codewords
+ *               Note: "raw" payloads are plain big-endian codewords
+ * [Errors]:     CRE if coding is unknown or payload is malformed
+ */
+void decode_payload(const char *coding, const unsigned char *bytes,
+                    size_t len, unsigned blocks_wide, UArray_T codewords)
+{
+        if (strcmp(coding, "huff") == 0) {
+                entropy_decode(bytes, len, blocks_wide, codewords);
+                return;
+        } else if (strcmp(coding, "rle") == 0) {
+                decode_rle(bytes, len, codewords);
+                return;
+        }
+
+        assert(strcmp(coding, "raw") == 0);
+        assert(len == (size_t)UArray_length(codewords) * CODEWORD_BYTES);
+
+        for (int i = 0; i < UArray_length(codewords); i++) {
+                uint32_t *codeword = UArray_at(codewords, i);
+                *codeword = get_codeword(bytes + i * CODEWORD_BYTES);
+        }
+}
+
+/*
+ * [Name]:       encode_payload
+ * [Parameters]: 1 const char* (coding), 1 UArray (codewords), 1 unsigned
+ *               (tile width in blocks; unused by "raw"), 1 size_t* (len,
+ *               set to the payload size)
+ * [Return]:     malloc'd payload holding the encoded codewords
+ * [Purpose]:    Encodes codewords into a tile payload (or, for "raw", the
+ *               codeword section of a format 2 file)
+ * [Errors]:     CRE if coding is unknown
+ */
+unsigned char *encode_payload(const char *coding, UArray_T codewords,
+                              unsigned blocks_wide, size_t *len)
+{
+        if (strcmp(coding, "huff") == 0) {
+                return entropy_encode(codewords, blocks_wide, len);
+        } else if (strcmp(coding, "rle") == 0) {
+                return encode_rle(codewords, len);
+        }
+
+        assert(strcmp(coding, "raw") == 0);
+
+        *len = (size_t)UArray_length(codewords) * CODEWORD_BYTES;
+        unsigned char *bytes = ALLOC(*len + 1);
+
+        for (int i = 0; i < UArray_length(codewords); i++) {
+                put_codeword(bytes + i * CODEWORD_BYTES,
+                             *(uint32_t *)UArray_at(codewords, i));
+        }
+
+        return bytes;
+}
+
+/*
+ * [Name]:       encode_rle
+ * [Parameters]: 1 UArray (codewords), 1 size_t* (len, set to the payload
+ *               size)
+ * [Return]:     malloc'd "rle" payload holding the codewords
+ * [Purpose]:    Stores each run of identical codewords as its length (LEB128:
+ *               7 bits per byte, low bits first, high bit set on all but the
+ *               last byte) followed by the codeword
+ * [Errors]:     CRE if any parameter is NULL
+ */
+unsigned char *encode_rle(UArray_T codewords, size_t *len)
+{
+        assert(codewords != NULL && len != NULL);
+
+        int            n     = UArray_length(codewords);
+        unsigned char *bytes = ALLOC((size_t)n * (CODEWORD_BYTES + 5) + 1);
+        size_t         pos   = 0;
+
+        for (int i = 0; i < n; ) {
+                uint32_t codeword = *(uint32_t *)UArray_at(codewords, i);
+                unsigned run      = 1;
+                while (i + run < (unsigned)n &&
+                       *(uint32_t *)UArray_at(codewords, i + run) == codeword) {
+                        run++;
+                }
+                i += run;
+
+                for (; run >= 0x80; run >>= 7) {
+                        bytes[pos++] = (run & 0x7f) | 0x80;
+                }
+                bytes[pos++] = run;
+                put_codeword(bytes + pos, codeword);
+                pos += CODEWORD_BYTES;
+        }
+
+        *len = pos;
+        return bytes;
+}
+
+/*
+ * [Name]:       decode_rle
+ * [Parameters]: 1 const unsigned char* (bytes), 1 size_t (len of bytes), 1
+ *               UArray (codewords)
+ * [Return]:     void
+ * [Purpose]:    Expands an "rle" payload into codewords
+ * [Errors]:     CRE if the runs overflow or underfill codewords, or the
+ *                   payload is truncated
+ */
+void decode_rle(const unsigned char *bytes, size_t len, UArray_T codewords)
+{
+        int    n   = UArray_length(codewords);
+        int    i   = 0;
+        size_t pos = 0;
+
+        while (pos < len) {
+                unsigned run = 0;
+                for (int shift = 0; ; shift += 7) {
+                        assert(pos < len && shift < 32);
+                        run |= (unsigned)(bytes[pos] & 0x7f) << shift;
+                        if ((bytes[pos++] & 0x80) == 0) {
+                                break;
+                        }
+                }
+                assert(run > 0 && run <= (unsigned)(n - i));
+                assert(len - pos >= (size_t)CODEWORD_BYTES);
+
+                uint32_t codeword = get_codeword(bytes + pos);
+                pos += CODEWORD_BYTES;
+                for (; run > 0; run--) {
+                        *(uint32_t *)UArray_at(codewords, i++) = codeword;
+                }
+        }
+        assert(i == n);
+}
+
+/*
+ * [Name]:       get_offset / put_offset
+ * [Parameters]: 1 (const) unsigned char* (bytes), (put: 1 uint64_t)
+ * [Return]:     get: the big-endian offset stored in bytes
+ * [Purpose]:    Convert between a tile offset and its OFFSET_BYTES-byte
+ *               big-endian representation in the index
+ * [Errors]:     None
+ */
+uint64_t get_offset(const unsigned char *bytes)
+{
+        uint64_t offset = 0;
+
+        for (int i = 0; i < OFFSET_BYTES; i++) {
+                offset = (offset << 8) | bytes[i];
+        }
+
+        return offset;
+}
+
+void put_offset(unsigned char *bytes, uint64_t offset)
+{
+        for (int i = OFFSET_BYTES - 1; i >= 0; i--) {
+                bytes[i] = offset & 0xff;
+                offset >>= 8;
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                      CODEWORD FUNCTIONS                      |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       get_codeword
+ * [Parameters]: 1 const unsigned char* (bytes)
+ * [Return]:     codeword stored in the first CODEWORD_BYTES bytes
+ * [Purpose]:    Converts a big-endian codeword in memory into an integer
+ * [Errors]:     CRE if bytes is NULL
+ */
+uint32_t get_codeword(const unsigned char *bytes)
+{
+        assert(bytes != NULL);
+
+        return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) |
+               ((uint32_t)bytes[2] << 8)  |  (uint32_t)bytes[3];
+}
+
+/*
+ * [Name]:       put_codeword
+ * [Parameters]: 1 unsigned char* (bytes), 1 uint32_t (codeword)
+ * [Return]:     void
+ * [Purpose]:    Stores codeword in big-endian order in the first
+ *               CODEWORD_BYTES bytes
+ * [Errors]:     CRE if bytes is NULL
+ */
+void put_codeword(unsigned char *bytes, uint32_t codeword)
+{
+        assert(bytes != NULL);
+
+        bytes[0] = codeword >> 24;
+        bytes[1] = codeword >> 16;
+        bytes[2] = codeword >> 8;
+        bytes[3] = codeword;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+#undef T
@@ -0,0 +1,125 @@
+/*
+ *      codeword_io.h
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Header file declaring client-accessible functions for the
+ *        codeword_io component
+ *      - Component reads and writes the COMP40 file formats:
+ *              ~ Format 2: the text header, followed by 32-bit codewords in
+ *                big-endian, row-major order
+ *              ~ Format 3 (tiled): the text header, followed by an index of
+ *                tile offsets, followed by square tiles of codewords in
+ *                tile-major order, so any tile can be fetched on its own
+ *      - Readers get codewords through a Comp40_T, which hides the format:
+ *        any rectangle of blocks can be read from either one
+ */
+
+#ifndef CODEWORDIO_INCLUDED
+#define CODEWORDIO_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "uarray.h"
+
+/* Size of one codeword in the file, in bytes */
+static const int CODEWORD_BYTES = 4;
+
+/* Size of one tile offset in the format 3 index, in bytes */
+static const int OFFSET_BYTES = 8;
+
+/* Default tile size for format 3, in blocks along each side */
+static const unsigned DEFAULT_TILE = 64;
+
+/* Metadata from the header of a COMP40 file */
+typedef struct Comp40_header {
+        unsigned format;          /* 2 (flat) or 3 (tiled)                  */
+        unsigned width, height;   /* in pixels, always even                 */
+        unsigned tile;            /* format 3: tile side, in blocks         */
+        char     coding[16];      /* format 3: "raw", "huff" or "rle" tiles  */
+} Comp40_header;
+
+/* An open COMP40 image, read through its codewords */
+typedef struct Comp40_T *Comp40_T;
+
+/* -- READ FUNCTIONS -- */
+/*
+ * Reads the header (and format 3 tile index) of the COMP40 image on input
+ * CRE: input cannot be NULL, header must be well-formed
+ */
+extern Comp40_T Comp40_open(FILE *input);
+
+/*
+ * Returns the header of an open image
+ * CRE: image cannot be NULL
+ */
+extern Comp40_header Comp40_info(Comp40_T image);
+
+/*
+ * Reads the (bw x bh) rectangle of blocks at block (bx, by) into codewords,
+ * in row-major order
+ * Note: On format 2 input that is not seekable, rectangles must be read in
+ *       increasing row order
+ * CRE: parameters cannot be NULL, rectangle must fit within the image
+ */
+extern UArray_T Comp40_rect(Comp40_T image, unsigned bx, unsigned by,
+                            unsigned bw, unsigned bh, UArray_T codewords);
+
+/*
+ * Format 3 only: returns number of tiles, and reads the index_th tile (in
+ * tile-major order) into codewords, in row-major order within the tile
+ * Note: Comp40_tile may be called from several threads at once
+ * CRE: image must be tiled, index must be in range, codewords must have
+ *      exactly as many elements as the tile has blocks
+ */
+extern unsigned Comp40_tiles(Comp40_T image);
+extern UArray_T Comp40_tile (Comp40_T image, unsigned index,
+                             UArray_T codewords);
+
+/*
+ * Format 3 only: gives the block position and size of the index_th tile
+ * CRE: image must be tiled, index must be in range
+ */
+extern void Comp40_tile_rect(Comp40_T image, unsigned index, unsigned *bx,
+                             unsigned *by, unsigned *bw, unsigned *bh);
+
+/*
+ * Frees an open image (but does not close its input)
+ * CRE: image cannot be NULL
+ */
+extern void Comp40_close(Comp40_T *image);
+/* ^^^^^^^^^^^^^^^^^^ */
+
+/* -- WRITE FUNCTIONS -- */
+/*
+ * Prints a format 2 COMP40 header for an image of width x height pixels
+ * CRE: output cannot be NULL
+ */
+extern void write_header(FILE *output, unsigned width, unsigned height);
+
+/*
+ * Prints all codewords to output in big-endian, row-major order
+ * CRE: parameters cannot be NULL
+ */
+extern void write_codewords(FILE *output, UArray_T codewords);
+
+/*
+ * Prints a complete format 3 COMP40 image (header, tile index and tiles of
+ * tile x tile blocks) from the row-major codewords of a width x height image,
+ * coding each tile's payload as coding ("raw", "huff" or "rle")
+ * CRE: parameters cannot be NULL, tile cannot be 0, coding must be known
+ */
+extern void write_tiled(FILE *output, UArray_T codewords, unsigned width,
+                        unsigned height, unsigned tile, const char *coding);
+/* ^^^^^^^^^^^^^^^^^^^ */
+
+/* -- CODEWORD FUNCTIONS -- */
+/*
+ * Converts between a codeword and its big-endian representation in bytes
+ * CRE: bytes cannot be NULL
+ */
+extern uint32_t get_codeword(const unsigned char *bytes);
+extern void     put_codeword(unsigned char *bytes, uint32_t codeword);
+/* ^^^^^^^^^^^^^^^^^^^^^^ */
+
+#endif /* CODEWORDIO_INCLUDED */
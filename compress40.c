@@ -11,37 +11,136 @@
  *      - Invariants:
  *              ~ Image (compressed or decompressed) is never modified
  *              ~ Num of 2x2 blocks in img = (img_width / 2) * (img_height / 2)
+ *              ~ Tiles of a format 3 image are decoded independently, on as
+ *                many threads as there are processors
+ *              ~ Only the first block of each run of identical blocks goes
+ *                through the pipeline (either way); the rest are copies
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "a2methods.h"
 #include "a2plain.h"
 #include "assert.h"
+#include "codeword_io.h"
 #include "compress40.h"
+#include "compress40ext.h"
 #include "imagemethods.h"
+#include "mem.h"
 #include "pixpack.h"
+#include "profile.h"
+#include "runs.h"
 #include "uarray.h"
 
 /* -- struct Pnm_ppm is from pnm.h -- */
 typedef struct Pnm_ppm *ppm;
 
+/* -- Shared state of the threads decoding a tiled image -- */
+struct tile_job {
+        Comp40_T        image;
+        ppm             pixmap;
+        unsigned        next;        /* next tile to hand out */
+        pthread_mutex_t lock;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- COMPRESS HELPER FUNCTIONS -- */
+static void     compress_image(FILE *input, unsigned tile,
+                               const char *coding, double fraction,
+                               Comp40_quality *quality);
+static UArray_T encode_blocks (UArray_T rgb_blocks, UArray_T codewords);
+static int      same_rgb_block(const void *block1, const void *block2);
+static int      same_rgb_px   (RGB_px px1, RGB_px px2);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- DECOMPRESS HELPER FUNCTIONS -- */
+static void  decode_blocks(UArray_T codewords, UArray_T indices,
+                           unsigned width, unsigned height, ppm pixmap,
+                           int x, int y);
+static void  decode_tiled (Comp40_T image);
+static void *decode_tiles (void *cl);
+static int   same_codeword(const void *codeword1, const void *codeword2);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
 /*--------------------------------------------------------------*
- |                      COMPRESS FUNCTION                       |
+ |                      COMPRESS FUNCTIONS                      |
  *--------------------------------------------------------------*/
 /*
  * [Name]:       compress40
  * [Parameters]: 1 FILE* (input)
  * [Return]:     void
  * [Purpose]:    Compresses image on input stream and sends it on standard
+ *               output in the COMP40 compressed image format (format 2)
+ *               Note: Does not modify or close input
+ * [Errors]:     CRE if input is NULL
+ */
+void compress40(FILE* input)
+{
+        compress_image(input, 0, NULL, 0, NULL);
+}
+
+/*
+ * [Name]:       compress40_tiled
+ * [Parameters]: 1 FILE* (input), 1 unsigned (tile side, in blocks), 1 const
+ *               char* (coding of the tiles, "raw", "huff" or "rle")
+ * [Return]:     void
+ * [Purpose]:    Compresses image on input stream and sends it on standard
+ *               output in the tiled COMP40 format (format 3)
+ *               Note: Does not modify or close input
+ * [Errors]:     CRE if input or coding is NULL, or tile is 0
+ */
+void compress40_tiled(FILE *input, unsigned tile, const char *coding)
+{
+        assert(tile > 0 && coding != NULL);
+
+        compress_image(input, tile, coding, 0, NULL);
+}
+
+/*
+ * [Name]:       compress40_verify
+ * [Parameters]: 1 FILE* (input), 1 unsigned (tile side in blocks, or 0 for
+ *               format 2), 1 const char* (coding of the tiles), 1 double
+ *               (fraction of the blocks to check, 1 or more for all)
+ * [Return]:     Comp40_quality of the round trip
+ * [Purpose]:    Compresses image on input stream like compress40 or
+ *               compress40_tiled, and checks the result by decoding it (or
+ *               a sample of it) in memory against the pixels just compressed
+ *               Note: Does not modify or close input
+ * [Errors]:     CRE if input is NULL, tile is not 0 and coding is NULL, or
+ *                   fraction is not positive
+ */
+Comp40_quality compress40_verify(FILE *input, unsigned tile,
+                                 const char *coding, double fraction)
+{
+        assert(tile == 0 || coding != NULL);
+        assert(fraction > 0);
+
+        Comp40_quality quality;
+        compress_image(input, tile, coding, fraction, &quality);
+
+        return quality;
+}
+
+/*
+ * [Name]:       compress_image
+ * [Parameters]: 1 FILE* (input), 1 unsigned (tile side in blocks, or 0 for
+ *               the flat format 2), 1 const char* (coding of the tiles,
+ *               unused by format 2), 1 double (fraction of the blocks to
+ *               verify), 1 Comp40_quality* (set to the round trip's error,
+ *               or NULL not to verify)
+ * [Return]:     void
+ * [Purpose]:    Compresses image on input stream and sends it on standard
  *               output in the COMP40 compressed image format
  *               Note: Does not modify or close input
  *                     Sets ImageMethods to compress, then calls the respective
  *                      image functions
  * [Errors]:     CRE if input is NULL
  */
-void compress40(FILE* input)
+static void compress_image(FILE *input, unsigned tile, const char *coding,
+                           double fraction, Comp40_quality *quality)
 {
         assert(input != NULL);
 
@@ -50,35 +149,175 @@ void compress40(FILE* input)
         ImageMethods_T img_m = compress;
         ppm            image = Pnm_ppmread(input, A2_m);
 
-        /* Allocating memory for UArrays */
+        unsigned len       = (image->width / 2) * (image->height / 2);
+        UArray_T codewords = img_m->new_blocks(len, sizeof(uint32_t));
+        codewords = compress_pixmap(image, codewords);
+        /* AFTER THIS POINT: Image has been compressed */
+
+        PROFILE_START(mark);
+        if (tile == 0) {
+                img_m->write(codewords, image->width, image->height);
+        } else {
+                write_tiled(stdout, codewords, image->width, image->height,
+                            tile, coding);
+        }
+        PROFILE_STOP(mark, PROFILE_COMPRESS, PROFILE_WRITE, len,
+                     PROFILE_WORD_BYTES(len), PROFILE_WORD_BYTES(len));
+        if (quality != NULL) {
+                *quality = verify_codewords(image, codewords, fraction);
+        }
+        UArray_free(&codewords);
+        Pnm_ppmfree(&image);
+}
+
+/*
+ * [Name]:       compress_pixmap
+ * [Parameters]: 1 Pnm_ppm (image), 1 UArray (codewords, one per 2x2 block)
+ * [Return]:     codewords, filled with the compressed image
+ * [Purpose]:    Runs the compress pipeline on an image already in memory
+ *               Note: Trims image to even dimensions; does not free it
+ *                     Each run of identical blocks is compressed once
+ * [Errors]:     CRE if any parameter is NULL or codewords has the wrong
+ *                   length
+ */
+UArray_T compress_pixmap(Pnm_ppm image, UArray_T codewords)
+{
+        assert(image != NULL && codewords != NULL);
+
+        ImageMethods_T img_m = compress;
+
         unsigned len        = (image->width / 2) * (image->height / 2);
         UArray_T rgb_blocks = img_m->new_blocks(len, sizeof(struct RGB_block));
-        UArray_T xyz_blocks = img_m->new_blocks(len, sizeof(struct XYZ_block));
-        UArray_T bit_blocks = img_m->new_blocks(len, sizeof(struct bit_block));
-        UArray_T codewords  = img_m->new_blocks(len, sizeof(        uint32_t));
+        assert(UArray_length(codewords) == (int)len);
+
+        PROFILE_START(mark);
+        rgb_blocks = img_m->read(rgb_blocks, image);
+        PROFILE_STOP(mark, PROFILE_COMPRESS, PROFILE_READ, len,
+                     PROFILE_PIXMAP_BYTES(len), PROFILE_RGB_BYTES(len));
+
+        return encode_blocks(rgb_blocks, codewords);
+}
+
+/*
+ * [Name]:       compress_changed
+ * [Parameters]: 1 Pnm_ppm (image, scaled and trimmed), 2 UArrays (indices
+ *               of the blocks to compress, codewords of the same length)
+ * [Return]:     codewords, filled with the compressed blocks in the order
+ *               of indices
+ * [Purpose]:    Runs the compress pipeline on some blocks of an image only,
+ *               so the cost scales with the number of blocks
+ * [Errors]:     CRE if any parameter is NULL, image is not scaled and
+ *                   trimmed, or the UArrays differ in length
+ */
+UArray_T compress_changed(Pnm_ppm image, UArray_T indices, UArray_T codewords)
+{
+        assert(image != NULL && indices != NULL && codewords != NULL);
+        assert(UArray_length(indices) == UArray_length(codewords));
+
+        ImageMethods_T img_m = compress;
+
+        unsigned len        = UArray_length(indices);
+        UArray_T rgb_blocks = img_m->new_blocks(len, sizeof(struct RGB_block));
+
+        PROFILE_START(mark);
+        rgb_blocks = read_blocks(rgb_blocks, image, indices);
+        PROFILE_STOP(mark, PROFILE_COMPRESS, PROFILE_READ, len,
+                     PROFILE_PIXMAP_BYTES(len), PROFILE_RGB_BYTES(len));
+
+        return encode_blocks(rgb_blocks, codewords);
+}
+
+/*
+ * [Name]:       encode_blocks
+ * [Parameters]: 2 UArrays (rgb_blocks, codewords of the same length)
+ * [Return]:     codewords, filled with the compressed rgb_blocks
+ * [Purpose]:    Runs the rest of the compress pipeline after read
+ *               Note: Frees rgb_blocks
+ *                     Each run of identical blocks is compressed once
+ * [Errors]:     None
+ */
+static UArray_T encode_blocks(UArray_T rgb_blocks, UArray_T codewords)
+{
+        ImageMethods_T img_m = compress;
+
+        /* Identical neighbors share one trip through the pipeline */
+        unsigned len        = UArray_length(rgb_blocks);
+        UArray_T runs       = img_m->new_blocks(len, sizeof(unsigned));
+        unsigned num_runs   = find_runs(rgb_blocks, same_rgb_block, runs);
+        UArray_T run_rgb    = gather_runs(rgb_blocks, runs, num_runs);
+        UArray_T xyz_blocks = img_m->new_blocks(num_runs,
+                                                sizeof(struct XYZ_block));
+        UArray_T bit_blocks = img_m->new_blocks(num_runs,
+                                                sizeof(struct bit_block));
+        UArray_T run_words  = img_m->new_blocks(num_runs, sizeof(uint32_t));
 
         /* Image methods */
-        rgb_blocks = img_m->read   (rgb_blocks, image);
-        xyz_blocks = img_m->rgb_xyz(xyz_blocks, rgb_blocks);
+        PROFILE_START(rgb_xyz_mark);
+        xyz_blocks = img_m->rgb_xyz(xyz_blocks, run_rgb);
+        PROFILE_STOP(rgb_xyz_mark, PROFILE_COMPRESS, PROFILE_RGB_XYZ, num_runs,
+                     PROFILE_RGB_BYTES(num_runs), PROFILE_XYZ_BYTES(num_runs));
+        PROFILE_START(chroma_mark);
         bit_blocks = img_m->chroma (bit_blocks, xyz_blocks);
+        PROFILE_STOP(chroma_mark, PROFILE_COMPRESS, PROFILE_CHROMA, num_runs,
+                     PROFILE_XYZ_BYTES(num_runs), PROFILE_BIT_BYTES(num_runs));
+        PROFILE_START(luma_mark);
         bit_blocks = img_m->luma   (bit_blocks, xyz_blocks);
-        codewords  = img_m->pixpack(codewords,  bit_blocks);
-        /* AFTER THIS POINT: Image has been compressed */
+        PROFILE_STOP(luma_mark, PROFILE_COMPRESS, PROFILE_LUMA, num_runs,
+                     PROFILE_XYZ_BYTES(num_runs), PROFILE_BIT_BYTES(num_runs));
+        PROFILE_START(pixpack_mark);
+        run_words  = img_m->pixpack(run_words,  bit_blocks);
+        PROFILE_STOP(pixpack_mark, PROFILE_COMPRESS, PROFILE_PIXPACK, num_runs,
+                     PROFILE_BIT_BYTES(num_runs),
+                     PROFILE_WORD_BYTES(num_runs));
+        codewords  = scatter_runs  (run_words,  runs, codewords);
+
+        img_m->free (rgb_blocks, xyz_blocks, bit_blocks, run_words, NULL);
+        UArray_free(&run_rgb);
+        UArray_free(&runs);
+
+        return codewords;
+}
+
+/*
+ * [Name]:       same_rgb_block
+ * [Parameters]: 2 const void* (RGB_blocks)
+ * [Return]:     1 if the blocks have identical pixels, 0 otherwise
+ * [Purpose]:    Runs_equal function for uncompressed blocks
+ * [Errors]:     None
+ */
+static int same_rgb_block(const void *block1, const void *block2)
+{
+        const struct RGB_block *rgb1 = block1;
+        const struct RGB_block *rgb2 = block2;
+
+        return same_rgb_px(rgb1->topL, rgb2->topL) &&
+               same_rgb_px(rgb1->topR, rgb2->topR) &&
+               same_rgb_px(rgb1->botL, rgb2->botL) &&
+               same_rgb_px(rgb1->botR, rgb2->botR);
+}
 
-        img_m->write(codewords, image->width, image->height);
-        img_m->free (rgb_blocks, xyz_blocks, bit_blocks, codewords, image);
+/*
+ * [Name]:       same_rgb_px
+ * [Parameters]: 2 RGB_px
+ * [Return]:     1 if the pixels have identical values, 0 otherwise
+ * [Purpose]:    Compares two pixels of same_rgb_block
+ * [Errors]:     None
+ */
+static int same_rgb_px(RGB_px px1, RGB_px px2)
+{
+        return px1->r == px2->r && px1->g == px2->g && px1->b == px2->b;
 }
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
 /*--------------------------------------------------------------*
- |                     DECOMPRESS FUNCTION                      |
+ |                     DECOMPRESS FUNCTIONS                     |
  *--------------------------------------------------------------*/
 /*
  * [Name]:       decompress40
  * [Parameters]: 1 FILE* (input)
  * [Return]:     void
- * [Purpose]:    Decompresses image on input stream and sends it on standard
- *               output in a portable pixmap format
+ * [Purpose]:    Decompresses image (format 2 or 3) on input stream and sends
+ *               it on standard output in a portable pixmap format
  *               Note: Does not modify or close input
  *                     Sets ImageMethods to decompress, then calls respective
  *                      image functions
@@ -86,44 +325,319 @@ void compress40(FILE* input)
  */
 void decompress40(FILE* input)
 {
-        assert(input != NULL);        
-        
-        /* Setting methods */
-        ImageMethods_T img_m = decompress;
-        
+        assert(input != NULL);
+
         /* Reading file header */
-        unsigned height, width;
-        int read = fscanf(input, "COMP40 Compressed image format 2\n%u %u",
-                          &width, &height);
-        assert(read == 2);
-        int c = getc(input);
-        assert(c == '\n');
+        Comp40_T      image  = Comp40_open(input);
+        Comp40_header header = Comp40_info(image);
 
-        /* Allocating memory for UArrays*/
-        unsigned len = (width / 2) * (height / 2);
-        UArray_T rgb_blocks = img_m->new_blocks(len, sizeof(struct RGB_block));
-        UArray_T xyz_blocks = img_m->new_blocks(len, sizeof(struct XYZ_block));
-        UArray_T bit_blocks = img_m->new_blocks(len, sizeof(struct bit_block));
-        UArray_T codewords  = img_m->new_blocks(len, sizeof(        uint32_t));
+        if (header.format == 3) {
+                decode_tiled(image);
+        } else {
+                /* Initializing compressed image */
+                unsigned bw = header.width  / 2;
+                unsigned bh = header.height / 2;
+                UArray_T codewords = decompress->new_blocks(bw * bh,
+                                                            sizeof(uint32_t));
+                PROFILE_START(mark);
+                codewords = Comp40_rect(image, 0, 0, bw, bh, codewords);
+                PROFILE_STOP(mark, PROFILE_DECOMPRESS, PROFILE_READ, bw * bh,
+                             PROFILE_WORD_BYTES(bw * bh),
+                             PROFILE_WORD_BYTES(bw * bh));
 
-        /* Initializing compressed image */
-        for (int i = 0; i < UArray_length(codewords); i++) {
-                uint32_t *codeword = UArray_at(codewords, i);
+                decompress_codewords(codewords, header.width, header.height,
+                                     NULL, 0, 0);
+        }
 
-                for (int j = sizeof(uint32_t); j > 0; j--) {
-                        char c = getc(input);
-                        *codeword = store_char(c, *codeword, j - 1);
-                }
+        Comp40_close(&image);
+}
+
+/*
+ * [Name]:       decompress40_region
+ * [Parameters]: 1 FILE* (input), 4 unsigned integers (x, y, width, height
+ *               of the region, in pixels)
+ * [Return]:     void
+ * [Purpose]:    Decompresses only the width x height region at pixel (x, y)
+ *               of the image on input stream, and sends it on standard output
+ *               in a portable pixmap format
+ *               Note: Only the codewords of blocks overlapping the region are
+ *                      read and decoded, so cost scales with the region
+ *                     Region is clipped to the image's right/bottom edges
+ * [Errors]:     CRE if input is NULL or region is empty or outside the image
+ */
+void decompress40_region(FILE *input, unsigned x, unsigned y,
+                         unsigned width, unsigned height)
+{
+        assert(input != NULL);
+
+        /* Reading file header */
+        Comp40_T      image  = Comp40_open(input);
+        Comp40_header header = Comp40_info(image);
+
+        assert(x < header.width && y < header.height);
+        assert(width > 0 && height > 0);
+        if (width > header.width - x) {
+                width = header.width - x;
         }
+        if (height > header.height - y) {
+                height = header.height - y;
+        }
+
+        /* Blocks overlapping the region */
+        unsigned bx = x / 2;
+        unsigned by = y / 2;
+        unsigned bw = (x + width + 1) / 2 - bx;
+        unsigned bh = (y + height + 1) / 2 - by;
+
+        UArray_T codewords = decompress->new_blocks(bw * bh, sizeof(uint32_t));
+        PROFILE_START(read_mark);
+        codewords = Comp40_rect(image, bx, by, bw, bh, codewords);
+        PROFILE_STOP(read_mark, PROFILE_DECOMPRESS, PROFILE_READ, bw * bh,
+                     PROFILE_WORD_BYTES(bw * bh), PROFILE_WORD_BYTES(bw * bh));
+        Comp40_close(&image);
+
+        ppm pixmap = new_ppm(width, height);
+        decompress_codewords(codewords, 2 * bw, 2 * bh, pixmap,
+                             -(int)(x % 2), -(int)(y % 2));
+
+        PROFILE_START(write_mark);
+        Pnm_ppmwrite(stdout, pixmap);
+        PROFILE_STOP(write_mark, PROFILE_DECOMPRESS, PROFILE_WRITE, 0,
+                     3 * (uint64_t)width * height,
+                     3 * (uint64_t)width * height);
+        Pnm_ppmfree(&pixmap);
+}
+
+/*
+ * [Name]:       decompress_codewords
+ * [Parameters]: 1 UArray (codewords), 2 unsigned integers (width and height
+ *               in pixels of the area the codewords cover), 1 Pnm_ppm
+ *               (pixmap, or NULL), 2 ints (position of the area in pixmap)
+ * [Return]:     void
+ * [Purpose]:    Decompresses codewords, then stores the result at (x, y) in
+ *               pixmap, or prints it on standard output if pixmap is NULL
+ *               Note: Frees codewords
+ * [Errors]:     CRE if codewords is NULL
+ */
+void decompress_codewords(UArray_T codewords, unsigned width,
+                          unsigned height, Pnm_ppm pixmap, int x, int y)
+{
+        assert(codewords != NULL);
+
+        decode_blocks(codewords, NULL, width, height, pixmap, x, y);
+}
+
+/*
+ * [Name]:       decompress_changed
+ * [Parameters]: 2 UArrays (codewords, indices of their blocks in pixmap),
+ *               1 Pnm_ppm (pixmap)
+ * [Return]:     void
+ * [Purpose]:    Decompresses codewords of scattered blocks, storing each at
+ *               its block's place in pixmap and leaving the rest of pixmap
+ *               as it was
+ *               Note: Frees codewords
+ * [Errors]:     CRE if any parameter is NULL or the UArrays differ in length
+ */
+void decompress_changed(UArray_T codewords, UArray_T indices, Pnm_ppm pixmap)
+{
+        assert(codewords != NULL && indices != NULL && pixmap != NULL);
+        assert(UArray_length(indices) == UArray_length(codewords));
+
+        decode_blocks(codewords, indices, pixmap->width, pixmap->height,
+                      pixmap, 0, 0);
+}
+
+/*
+ * [Name]:       decode_blocks
+ * [Parameters]: 2 UArrays (codewords, indices of their blocks or NULL if
+ *               they cover a whole area in row-major order), 2 unsigned
+ *               integers (width and height in pixels of the area), 1
+ *               Pnm_ppm (pixmap, or NULL), 2 ints (position of the area in
+ *               pixmap)
+ * [Return]:     void
+ * [Purpose]:    Runs the decompress pipeline, then stores the result in
+ *               pixmap or prints it on standard output if pixmap is NULL
+ *               Note: Frees codewords
+ *                     Each run of identical codewords is decoded once
+ * [Errors]:     None
+ */
+static void decode_blocks(UArray_T codewords, UArray_T indices,
+                          unsigned width, unsigned height, ppm pixmap,
+                          int x, int y)
+{
+        /* Setting methods */
+        ImageMethods_T img_m = decompress;
+
+        /* Allocating memory for UArrays*/
+        unsigned len       = UArray_length(codewords);
+        UArray_T runs      = img_m->new_blocks(len, sizeof(unsigned));
+        unsigned num_runs  = find_runs(codewords, same_codeword, runs);
+        UArray_T run_words = gather_runs(codewords, runs, num_runs);
+        UArray_T rgb_blocks = img_m->new_blocks(num_runs,
+                                                sizeof(struct RGB_block));
+        UArray_T xyz_blocks = img_m->new_blocks(num_runs,
+                                                sizeof(struct XYZ_block));
+        UArray_T bit_blocks = img_m->new_blocks(num_runs,
+                                                sizeof(struct bit_block));
+        UArray_T all_rgb    = img_m->new_blocks(len,
+                                                sizeof(struct RGB_block));
 
         /* Image methods */
-        bit_blocks = img_m->pixpack(bit_blocks, codewords);
+        PROFILE_START(pixpack_mark);
+        bit_blocks = img_m->pixpack(bit_blocks, run_words);
+        PROFILE_STOP(pixpack_mark, PROFILE_DECOMPRESS, PROFILE_PIXPACK,
+                     num_runs, PROFILE_WORD_BYTES(num_runs),
+                     PROFILE_BIT_BYTES(num_runs));
+        PROFILE_START(luma_mark);
         xyz_blocks = img_m->luma   (xyz_blocks, bit_blocks);
+        PROFILE_STOP(luma_mark, PROFILE_DECOMPRESS, PROFILE_LUMA, num_runs,
+                     PROFILE_BIT_BYTES(num_runs), PROFILE_XYZ_BYTES(num_runs));
+        PROFILE_START(chroma_mark);
         xyz_blocks = img_m->chroma (xyz_blocks, bit_blocks);
+        PROFILE_STOP(chroma_mark, PROFILE_DECOMPRESS, PROFILE_CHROMA, num_runs,
+                     PROFILE_BIT_BYTES(num_runs), PROFILE_XYZ_BYTES(num_runs));
+        PROFILE_START(rgb_xyz_mark);
         rgb_blocks = img_m->rgb_xyz(rgb_blocks, xyz_blocks);
+        PROFILE_STOP(rgb_xyz_mark, PROFILE_DECOMPRESS, PROFILE_RGB_XYZ,
+                     num_runs, PROFILE_XYZ_BYTES(num_runs),
+                     PROFILE_RGB_BYTES(num_runs));
+        all_rgb    = scatter_runs  (rgb_blocks, runs, all_rgb);
         /* AFTER THIS POINT: Image has been decompressed */
-        
-        img_m->write(rgb_blocks, width, height);
+
+        /* Storing blocks into pixmap counts as writing, like printing */
+        PROFILE_START(write_mark);
+        if (indices != NULL) {
+                copy_blocks_at(all_rgb, indices, width / 2, pixmap);
+        } else if (pixmap == NULL) {
+                img_m->write(all_rgb, width, height);
+        } else {
+                copy_blocks(all_rgb, width / 2, pixmap, x, y);
+        }
+        PROFILE_STOP(write_mark, PROFILE_DECOMPRESS, PROFILE_WRITE, len,
+                     PROFILE_RGB_BYTES(len), PROFILE_PIXMAP_BYTES(len));
         img_m->free (rgb_blocks, xyz_blocks, bit_blocks, codewords, NULL);
+        UArray_free(&all_rgb);
+        UArray_free(&run_words);
+        UArray_free(&runs);
 }
-/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
\ No newline at end of file
+
+/*
+ * [Name]:       decode_tiled
+ * [Parameters]: 1 Comp40_T (tiled image)
+ * [Return]:     void
+ * [Purpose]:    Decompresses every tile of a format 3 image into one pixmap,
+ *               spreading the tiles over several threads, then prints the
+ *               pixmap on standard output
+ * [Errors]:     CRE if image is NULL
+ */
+static void decode_tiled(Comp40_T image)
+{
+        assert(image != NULL);
+
+        Comp40_header header = Comp40_info(image);
+        struct tile_job job  = { .image = image, .next = 0 };
+        job.pixmap = new_ppm(header.width, header.height);
+        pthread_mutex_init(&job.lock, NULL);
+
+        int        threads = num_threads(Comp40_tiles(image));
+        pthread_t *workers = ALLOC(threads * sizeof(pthread_t));
+        for (int i = 0; i < threads; i++) {
+                int err = pthread_create(&workers[i], NULL, decode_tiles,
+                                         &job);
+                assert(err == 0);
+        }
+        PROFILE_SPAN_START(join_mark);
+        for (int i = 0; i < threads; i++) {
+                pthread_join(workers[i], NULL);
+        }
+        PROFILE_SPAN_STOP(join_mark, "wait workers");
+        /* AFTER THIS POINT: Image has been decompressed */
+
+        PROFILE_START(mark);
+        Pnm_ppmwrite(stdout, job.pixmap);
+        PROFILE_STOP(mark, PROFILE_DECOMPRESS, PROFILE_WRITE, 0,
+                     3 * (uint64_t)header.width * header.height,
+                     3 * (uint64_t)header.width * header.height);
+
+        FREE(workers);
+        pthread_mutex_destroy(&job.lock);
+        Pnm_ppmfree(&job.pixmap);
+}
+
+/*
+ * [Name]:       decode_tiles
+ * [Parameters]: 1 void* (closure, the struct tile_job)
+ * [Return]:     NULL
+ * [Purpose]:    Thread body: repeatedly takes the next undecoded tile, then
+ *               fetches and decompresses it into the shared pixmap (tiles
+ *               never overlap, so no lock is needed while decoding)
+ * [Errors]:     CRE if cl is NULL
+ */
+static void *decode_tiles(void *cl)
+{
+        assert(cl != NULL);
+
+        struct tile_job *job   = cl;
+        unsigned         tiles = Comp40_tiles(job->image);
+
+        for (;;) {
+                pthread_mutex_lock(&job->lock);
+                unsigned t = job->next++;
+                pthread_mutex_unlock(&job->lock);
+
+                if (t >= tiles) {
+                        return NULL;
+                }
+
+                PROFILE_SPAN_START(tile_mark);
+                unsigned bx, by, bw, bh;
+                Comp40_tile_rect(job->image, t, &bx, &by, &bw, &bh);
+
+                UArray_T codewords = decompress->new_blocks(bw * bh,
+                                                            sizeof(uint32_t));
+                PROFILE_START(mark);
+                codewords = Comp40_tile(job->image, t, codewords);
+                PROFILE_STOP(mark, PROFILE_DECOMPRESS, PROFILE_READ, bw * bh,
+                             PROFILE_WORD_BYTES(bw * bh),
+                             PROFILE_WORD_BYTES(bw * bh));
+                decompress_codewords(codewords, 2 * bw, 2 * bh, job->pixmap,
+                                     2 * bx, 2 * by);
+                PROFILE_SPAN_STOP(tile_mark, "tile");
+        }
+}
+
+/*
+ * [Name]:       num_threads
+ * [Parameters]: 1 unsigned (number of independent pieces of work)
+ * [Return]:     number of threads to run: one per online processor, but
+ *               never more than there is work, and at least 1
+ * [Purpose]:    Sizes the thread pool for parallel decoding (and for the
+ *               other parallel entry points)
+ * [Errors]:     None
+ */
+int num_threads(unsigned work)
+{
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (cpus < 1) {
+                cpus = 1;
+        }
+        if ((unsigned long)cpus > work) {
+                cpus = work > 0 ? work : 1;
+        }
+
+        return cpus;
+}
+
+/*
+ * [Name]:       same_codeword
+ * [Parameters]: 2 const void* (uint32_t codewords)
+ * [Return]:     1 if the codewords are equal, 0 otherwise
+ * [Purpose]:    Runs_equal function for compressed blocks
+ * [Errors]:     None
+ */
+static int same_codeword(const void *codeword1, const void *codeword2)
+{
+        return *(const uint32_t *)codeword1 == *(const uint32_t *)codeword2;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
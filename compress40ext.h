@@ -0,0 +1,233 @@
+/*
+ *      compress40ext.h
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Header file declaring the client-accessible entry points for 40image
+ *        beyond the compress40/decompress40 pair in compress40.h
+ *      - Like compress40.h, each function reads from the given input stream
+ *        and writes its result on standard output
+ */
+
+#ifndef COMPRESS40EXT_INCLUDED
+#define COMPRESS40EXT_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pnm.h"
+#include "uarray.h"
+
+/*
+ * Compresses the portable pixmap on input into the tiled COMP40 format
+ * (format 3), with square tiles of tile x tile blocks, each coded as coding:
+ * "raw" codewords, "huff" (entropy-coded, see entropy.h) or "rle" (runs of
+ * identical codewords)
+ * CRE: input and coding cannot be NULL, tile cannot be 0
+ */
+extern void compress40_tiled(FILE *input, unsigned tile, const char *coding);
+
+/* RMS error of a compression round trip (color values in [0, 1], as ppmdiff
+ * reports it), measured on all blocks or estimated from a sample of them */
+typedef struct Comp40_quality {
+        double   rms;               /* exact, or estimated from the sample */
+        double   rms_low, rms_high; /* 95% confidence bounds (equal to rms
+                                       when every block was checked)       */
+        unsigned sampled, blocks;   /* blocks decoded, blocks in the image */
+} Comp40_quality;
+
+/*
+ * Compresses the portable pixmap on input like compress40 (if tile is 0) or
+ * compress40_tiled, then decodes the codewords (all of them if fraction is at
+ * least 1, else a fixed pseudo-random fraction of them) while they are still
+ * in memory and returns the error of the result against the source pixels
+ * CRE: input cannot be NULL, coding cannot be NULL if tile is not 0,
+ *      fraction must be positive
+ */
+extern Comp40_quality compress40_verify(FILE *input, unsigned tile,
+                                        const char *coding, double fraction);
+
+/*
+ * Decompresses only the width x height pixel region at (x, y) of the COMP40
+ * image on input, reading just the codewords that overlap it
+ * CRE: input cannot be NULL, region must start inside the image
+ */
+extern void decompress40_region(FILE *input, unsigned x, unsigned y,
+                                unsigned width, unsigned height);
+
+/*
+ * Decompresses the COMP40 image on input at 1/scale resolution (scale is 2,
+ * 4 or 8) from the a, Pb and Pr fields alone, without the inverse DCT
+ * CRE: input cannot be NULL, scale must be 2, 4 or 8
+ */
+extern void decompress40_preview(FILE *input, unsigned scale);
+
+/*
+ * Compresses the stream of concatenated portable pixmaps on input into a
+ * framed COMP40 stream, one frame per pixmap; if temporal is nonzero, frames
+ * send only the blocks that changed since the frame before
+ * CRE: input cannot be NULL
+ */
+extern void compress40_stream(FILE *input, int temporal);
+
+/*
+ * Decompresses a framed COMP40 stream on input into concatenated portable
+ * pixmaps, one per frame
+ * CRE: input cannot be NULL, stream must be well-formed
+ */
+extern void decompress40_stream(FILE *input);
+
+/*
+ * Compresses the portable pixmap on input (format 2), copying the codewords
+ * of every region whose pixels are unchanged since base (an old COMP40 file,
+ * or NULL) was made, as recorded in its sidecar base + ".rows"; then writes
+ * the new image's sidecar to rows (if not NULL)
+ * CRE: input cannot be NULL, base and rows must be accessible
+ */
+extern void compress40_incremental(FILE *input, const char *base,
+                                   const char *rows);
+
+/*
+ * Flips, transposes or rotates the COMP40 image on input without decoding
+ * it, by moving codewords and rewriting their b, c and d fields; transform
+ * is "fliph", "flipv", "transpose", "rot90", "rot180" or "rot270" (rotations
+ * are clockwise), and known_transform tells whether a name is one of these
+ * CRE: parameters cannot be NULL, transform must be known
+ */
+extern void transform40    (FILE *input, const char *transform);
+extern int  known_transform(const char *transform);
+
+/*
+ * Edits COMP40 images without decoding them, on 2-pixel boundaries:
+ *      ~ crop40 sends the width x height region at (x, y) of the image on
+ *        input (clipped to the image), as a COMP40 image
+ *      ~ stack40 sends the n images on inputs joined left to right (if
+ *        horizontal is nonzero; all must have the same height) or top to
+ *        bottom (all must have the same width), as one COMP40 image
+ *      ~ split40 writes the image on input as a grid of width x height
+ *        pieces (smaller along the right/bottom edges), the piece in grid
+ *        row r and column c to the file "<prefix>-<r>-<c>.c40"
+ * CRE: pointers cannot be NULL, coordinates and sizes must be even, regions
+ *      must start inside the image, pieces must be writable
+ */
+extern void crop40 (FILE *input, unsigned x, unsigned y, unsigned width,
+                    unsigned height);
+extern void stack40(FILE **inputs, unsigned n, int horizontal);
+extern void split40(FILE *input, unsigned width, unsigned height,
+                    const char *prefix);
+
+/*
+ * Sends the COMP40 image on input with its lumas mapped by
+ * Y -> contrast * (Y - 0.5) + 0.5 + brightness, and near-gray if gray is
+ * nonzero (chroma alternating between the values nearest 0 block by block,
+ * since Arith40 has no zero), as a COMP40 image, by rewriting codeword
+ * fields without decoding
+ * CRE: input cannot be NULL, contrast cannot be negative
+ */
+extern void tone40(FILE *input, float brightness, float contrast, int gray);
+
+/* Statistics of a COMP40 image, computed from its codeword fields alone */
+typedef struct Comp40_stats {
+        unsigned      width, height;            /* in pixels              */
+        unsigned long luma_histogram[64];       /* blocks per value of a  */
+        double        mean_luma, mean_Pb, mean_Pr;
+        double        mean_red, mean_green, mean_blue;   /* [0, 255]      */
+        double        block_variance;   /* mean variance of luma within a
+                                           block, from b, c and d         */
+        uint64_t      phash;            /* perceptual hash of block means */
+} Comp40_stats;
+
+/*
+ * stats_of returns the statistics of the COMP40 image on input, without
+ * decoding it; stats40 prints them on standard output
+ * CRE: input cannot be NULL
+ */
+extern Comp40_stats stats_of(FILE *input);
+extern void         stats40 (FILE *input);
+
+/*
+ * Returns the number of bits in which two perceptual hashes differ; images
+ * that differ in few bits are near-duplicates
+ */
+extern unsigned phash_distance(uint64_t hash1, uint64_t hash2);
+
+/*
+ * Writes the COMP40 image on input (or the portable pixmap on input,
+ * compressed) and every halving of it, without decoding, to the files
+ * "<prefix>-<level>.c40", level 0 being the full size; levels are format 2
+ * if tile is 0, else format 3 with tile x tile tiles coded as coding
+ * CRE: input and prefix cannot be NULL, coding must be known if tile is
+ *      not 0, levels must be writable
+ */
+extern void pyramid40(FILE *input, const char *prefix, unsigned tile,
+                      const char *coding);
+
+/*
+ * Compares the COMP40 images on input1 and input2 (of the same size) with
+ * one thread per processor, and prints per-field codeword differences and
+ * an RMS error estimated from the dequantized fields; if exact is nonzero,
+ * also the exact RMS error of the decoded pixmaps, decoded one block row at
+ * a time
+ * CRE: inputs cannot be NULL, images must have the same size
+ */
+extern void diff40(FILE *input1, FILE *input2, int exact);
+
+/*
+ * Reads the portable pixmap on input and converts it to YPbPr and DCT
+ * coefficients once, then prints the encoded size and round-trip RMS error
+ * of each codeword layout in layouts ("A/BCD/C" separated by commas: widths
+ * in bits of a, of each of b, c and d, and of each of Pb and Pr), evaluated
+ * in parallel; known_layouts tells whether a list is well-formed
+ * CRE: input cannot be NULL, layouts must be known
+ */
+extern void sweep40      (FILE *input, const char *layouts);
+extern int  known_layouts(const char *layouts);
+
+/* -- PIPELINE FUNCTIONS, shared by the entry points above -- */
+/*
+ * Compresses an image already in memory into codewords (one per 2x2 block,
+ * row-major), trimming it to even dimensions; the image is not freed
+ * CRE: parameters cannot be NULL, codewords must have one element per block
+ */
+extern UArray_T compress_pixmap(Pnm_ppm image, UArray_T codewords);
+
+/*
+ * Returns the error of the decoded codewords against image, which must be as
+ * compress_pixmap left it, from all blocks or a fraction of them (as
+ * compress40_verify); neither is freed
+ * CRE: parameters cannot be NULL, codewords must have one element per block,
+ *      fraction must be positive
+ */
+extern Comp40_quality verify_codewords(Pnm_ppm image, UArray_T codewords,
+                                       double fraction);
+
+/*
+ * Decompresses the codewords of a width x height pixel area into pixmap with
+ * its top-left corner at (x, y), or onto standard output if pixmap is NULL;
+ * frees codewords
+ * CRE: codewords cannot be NULL
+ */
+extern void decompress_codewords(UArray_T codewords, unsigned width,
+                                 unsigned height, Pnm_ppm pixmap, int x,
+                                 int y);
+
+/*
+ * Like compress_pixmap and decompress_codewords, but only for the blocks
+ * numbered (row-major, as unsigned) by indices: compress_changed fills
+ * codewords in the order of indices (image must already be scaled with
+ * scale_ppm), and decompress_changed stores each block at its place in
+ * pixmap, leaving the other blocks as they were (and frees codewords)
+ * CRE: parameters cannot be NULL, indices and codewords must match in length
+ */
+extern UArray_T compress_changed  (Pnm_ppm image, UArray_T indices,
+                                   UArray_T codewords);
+extern void     decompress_changed(UArray_T codewords, UArray_T indices,
+                                   Pnm_ppm pixmap);
+
+/*
+ * Returns the number of threads to spread work (a number of independent
+ * pieces) over: one per online processor, at most work, and at least 1
+ */
+extern int num_threads(unsigned work);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+#endif /* COMPRESS40EXT_INCLUDED */
@@ -0,0 +1,233 @@
+/*
+ *      counters.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Component file defining all extern and helper functions for the
+ *        counters component
+ *      - Each thread opens its counters as one perf_event_open group, so a
+ *        single read returns all of them, counted over the same intervals
+ *      - Component-wide invariants:
+ *              ~ Only user-space events of the calling thread are counted
+ *                (what perf_event_paranoid 2, the usual default, allows)
+ *              ~ A counter the kernel refuses (no PMU in a container or VM,
+ *                no such event on the CPU, no room left in the group) is
+ *                skipped; the rest still count
+ *              ~ If the group shares the PMU with other events and only
+ *                runs part of the time, counts are scaled up to the whole
+ *                time, as perf stat does
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "counters.h"
+
+static const char *COUNTER_NAMES[COUNTERS] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+/* perf_event_open type and config of each counter */
+#define CACHE_READ_MISS(cache) ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 | \
+                                PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+static const struct {
+        uint32_t type;
+        uint64_t config;
+} EVENTS[COUNTERS] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES            },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS          },
+        { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D) },
+        { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)  },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES         }
+};
+
+/* -- Counters of one thread -- */
+struct thread_counters {
+        int      opened;
+        unsigned counting;           /* bit i: counter i is in the group   */
+        int      leader;             /* fd read for the group, or -1       */
+        int      fds[COUNTERS];
+        int      slot[COUNTERS];     /* position of counter i in a read    */
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+static __thread struct thread_counters mine;
+static int            open_errno = 0;      /* first refusal, for the error */
+static pthread_once_t key_once   = PTHREAD_ONCE_INIT;
+static pthread_key_t  close_key;           /* closes a thread's counters */
+
+/* -- THREAD HELPER FUNCTIONS -- */
+void make_close_key(void);
+void close_counters(void *state);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                       COUNTER FUNCTIONS                      |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       counters_open
+ * [Parameters]: None
+ * [Return]:     the set of counters counting on this thread (bit i for
+ *               counter i), 0 if none could be opened
+ * [Purpose]:    Opens this thread's counters the first time it is called,
+ *               as one group led by the first counter the kernel accepts,
+ *               and starts them
+ * [Errors]:     None (refused counters are left out)
+ */
+unsigned counters_open(void)
+{
+        if (mine.opened) {
+                return mine.counting;
+        }
+        mine.opened = 1;
+        mine.leader = -1;
+
+        int members = 0;
+        for (int i = 0; i < COUNTERS; i++) {
+                struct perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size           = sizeof(attr);
+                attr.type           = EVENTS[i].type;
+                attr.config         = EVENTS[i].config;
+                attr.disabled       = mine.leader < 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv     = 1;
+                attr.read_format    = PERF_FORMAT_GROUP |
+                                      PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                      PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                mine.fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1,
+                                      mine.leader, 0);
+                if (mine.fds[i] < 0) {
+                        int none = 0;
+                        __atomic_compare_exchange_n(&open_errno, &none, errno,
+                                                    0, __ATOMIC_RELAXED,
+                                                    __ATOMIC_RELAXED);
+                        continue;
+                }
+                if (mine.leader < 0) {
+                        mine.leader = mine.fds[i];
+                }
+                mine.slot[i]   = members++;
+                mine.counting |= 1u << i;
+        }
+
+        if (mine.leader >= 0) {
+                pthread_once(&key_once, make_close_key);
+                pthread_setspecific(close_key, &mine);
+                ioctl(mine.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(mine.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        return mine.counting;
+}
+
+/*
+ * [Name]:       counters_error
+ * [Parameters]: None
+ * [Return]:     why the first counter refused on any thread was refused
+ *               (strerror of perf_event_open's errno), or "" if none was
+ * [Purpose]:    Explains missing counters (ENOENT: no such event, as in
+ *               most containers; EACCES: perf_event_paranoid too high)
+ * [Errors]:     None
+ */
+const char *counters_error(void)
+{
+        int err = __atomic_load_n(&open_errno, __ATOMIC_RELAXED);
+
+        return err != 0 ? strerror(err) : "";
+}
+
+/*
+ * [Name]:       counters_read
+ * [Parameters]: 1 uint64_t array (values, set)
+ * [Return]:     void
+ * [Purpose]:    Reads this thread's counts since counters_open, in one read
+ *               of the group, scaled up if the group was not always running
+ * [Errors]:     None (values are all 0 if the group cannot be read)
+ */
+void counters_read(uint64_t values[COUNTERS])
+{
+        memset(values, 0, COUNTERS * sizeof(uint64_t));
+        if (!mine.opened || mine.leader < 0) {
+                return;
+        }
+
+        /* nr, time enabled, time running, then one value per member */
+        uint64_t group[3 + COUNTERS];
+        if (read(mine.leader, group, sizeof(group)) <
+            (ssize_t)(3 * sizeof(uint64_t))) {
+                return;
+        }
+        uint64_t enabled = group[1], running = group[2];
+
+        for (int i = 0; i < COUNTERS; i++) {
+                if ((mine.counting & (1u << i)) == 0) {
+                        continue;
+                }
+                values[i] = group[3 + mine.slot[i]];
+                if (running > 0 && running < enabled) {
+                        values[i] = (double)values[i] * enabled / running;
+                }
+        }
+}
+
+/*
+ * [Name]:       counter_name
+ * [Parameters]: 1 int (counter)
+ * [Return]:     the counter's name, as reports print it
+ * [Purpose]:    Names the counters for the profile and 40bench reports
+ * [Errors]:     CRE if counter is out of range
+ */
+const char *counter_name(int counter)
+{
+        assert(counter >= 0 && counter < COUNTERS);
+
+        return COUNTER_NAMES[counter];
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                        THREAD FUNCTIONS                      |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       make_close_key
+ * [Parameters]: None
+ * [Return]:     void
+ * [Purpose]:    Creates the key whose destructor closes the counters of an
+ *               exiting thread (once, through pthread_once)
+ * [Errors]:     None
+ */
+void make_close_key(void)
+{
+        pthread_key_create(&close_key, close_counters);
+}
+
+/*
+ * [Name]:       close_counters
+ * [Parameters]: 1 void* (state: the exiting thread's struct thread_counters)
+ * [Return]:     void
+ * [Purpose]:    Closes the thread's counters, so that short-lived decode
+ *               threads do not leak file descriptors
+ * [Errors]:     None
+ */
+void close_counters(void *state)
+{
+        struct thread_counters *counters = state;
+
+        for (int i = 0; i < COUNTERS; i++) {
+                if ((counters->counting & (1u << i)) != 0) {
+                        close(counters->fds[i]);
+                }
+        }
+        counters->counting = 0;
+        counters->leader   = -1;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
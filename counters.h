@@ -0,0 +1,39 @@
+/*
+ *      counters.h
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Header file declaring client-accessible functions for the
+ *        counters component
+ *      - Component reads the hardware performance counters of the calling
+ *        thread (Linux perf_event_open, user space only): cycles,
+ *        instructions, L1 data cache read misses, last-level cache read
+ *        misses and branch misses
+ *      - Counters are opened per thread, on first use, and closed when the
+ *        thread exits; any that the kernel, the CPU or a container refuses
+ *        are left out, and read as 0
+ */
+
+#ifndef COUNTERS_INCLUDED
+#define COUNTERS_INCLUDED
+
+#include <stdint.h>
+
+enum { COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_L1D_MISSES,
+       COUNTER_LLC_MISSES, COUNTER_BRANCH_MISSES, COUNTERS };
+
+/*
+ * counters_open opens the calling thread's counters (once; later calls
+ * only return the result) and returns the set of those counting, bit i
+ * for counter i: 0 if none could be opened, counters_error then telling
+ * why; counters_read sets values to the thread's counts so far, since the
+ * open (0 for counters not counting, and all 0 before counters_open);
+ * counter_name gives "cycles", "instructions", "l1d_misses", "llc_misses"
+ * or "branch_misses"
+ * CRE: counter out of range
+ */
+extern unsigned    counters_open (void);
+extern const char *counters_error(void);
+extern void        counters_read (uint64_t values[COUNTERS]);
+extern const char *counter_name  (int counter);
+
+#endif /* COUNTERS_INCLUDED */
@@ -0,0 +1,373 @@
+/*
+ *      diff.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the compressed-domain diff function for 40image
+ *      - Diff: Compares two COMP40 images of the same size block by block,
+ *              and reports on standard output:
+ *              ~ For each codeword field, how many blocks differ in it, and
+ *                the mean and largest difference
+ *              ~ An estimated RMS error (as ppmdiff reports it, with color
+ *                values in [0, 1]) from the dequantized fields alone: the
+ *                2x2 DCT is orthogonal, so a block's summed squared luma
+ *                error is 4 (da^2 + db^2 + dc^2 + dd^2), and its chroma is
+ *                the same at all four pixels
+ *              ~ Optionally, the exact RMS error of the decoded pixmaps:
+ *                each block row of both images is decoded by the
+ *                decompress pipeline into a 2-pixel-high strip and
+ *                compared, so no full pixmap is ever built
+ *      - Invariants:
+ *              ~ Block rows are shared out to threads in chunks; each
+ *                thread sums into its own totals, merged at the end
+ *              ~ Estimated and exact errors differ only by the rounding and
+ *                clamping of decoded pixels
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arith40.h"
+#include "assert.h"
+#include "codeword_io.h"
+#include "compress40ext.h"
+#include "imagemethods.h"
+#include "luma_bit.h"
+#include "mem.h"
+#include "pixpack.h"
+#include "uarray.h"
+
+/* -- struct Pnm_ppm is from pnm.h -- */
+typedef struct Pnm_ppm *ppm;
+
+/* Block rows handed to a thread at a time */
+static const unsigned DIFF_CHUNK = 16;
+
+/* Fields of a codeword, in the order they are reported */
+enum { FIELD_A, FIELD_B, FIELD_C, FIELD_D, FIELD_PB, FIELD_PR, FIELDS };
+static const char *FIELD_NAMES[FIELDS] = { "a", "b", "c", "d", "Pb", "Pr" };
+
+/* -- Totals over some block rows -- */
+struct diff_sums {
+        uint64_t differ;                  /* codewords that differ        */
+        uint64_t field_differ[FIELDS];
+        uint64_t field_abs[FIELDS];       /* summed |difference|          */
+        unsigned field_max[FIELDS];
+        double   estimated;               /* summed squared error, [0, 1] */
+        double   exact;                   /* summed squared error, [0, 1] */
+};
+
+/* -- Shared state of the threads comparing two images -- */
+struct diff_job {
+        UArray_T         words1, words2;  /* all codewords of each image  */
+        unsigned         bw, bh;
+        int              exact;
+        unsigned         next;            /* next block row to hand out   */
+        struct diff_sums sums;
+        pthread_mutex_t  lock;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- DIFF HELPER FUNCTIONS -- */
+UArray_T read_all_codewords(FILE *input, Comp40_header *header);
+void    *diff_rows         (void *cl);
+void     diff_codewords    (uint32_t word1, uint32_t word2,
+                            struct diff_sums *sums);
+double   estimated_error   (const struct bit_block *bit1,
+                            const struct bit_block *bit2);
+double   exact_error       (const struct diff_job *job, unsigned row,
+                            ppm strip1, ppm strip2);
+void     decode_strip      (UArray_T words, unsigned bw, unsigned row,
+                            ppm strip);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                        DIFF FUNCTION                         |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       diff40
+ * [Parameters]: 2 FILE* (input1, input2), 1 int (exact: nonzero to also
+ *               decode both images and measure their exact RMS error)
+ * [Return]:     void
+ * [Purpose]:    Compares the compressed images on the two input streams,
+ *               using one thread per processor, and sends the report on
+ *               standard output, one "name value..." line each
+ *               Note: Does not modify or close either input
+ * [Errors]:     CRE if either input is NULL, or the images differ in size
+ */
+void diff40(FILE *input1, FILE *input2, int exact)
+{
+        assert(input1 != NULL && input2 != NULL);
+
+        Comp40_header header1, header2;
+        struct diff_job job;
+        memset(&job, 0, sizeof(job));
+        job.words1 = read_all_codewords(input1, &header1);
+        job.words2 = read_all_codewords(input2, &header2);
+        assert(header1.width == header2.width &&
+               header1.height == header2.height);
+        job.bw    = header1.width  / 2;
+        job.bh    = header1.height / 2;
+        job.exact = exact;
+        pthread_mutex_init(&job.lock, NULL);
+
+        int        threads = num_threads((job.bh + DIFF_CHUNK - 1) /
+                                         DIFF_CHUNK);
+        pthread_t *workers = ALLOC(threads * sizeof(pthread_t));
+        for (int i = 0; i < threads; i++) {
+                int err = pthread_create(&workers[i], NULL, diff_rows, &job);
+                assert(err == 0);
+        }
+        for (int i = 0; i < threads; i++) {
+                pthread_join(workers[i], NULL);
+        }
+
+        double blocks = (double)job.bw * job.bh;
+        printf("size %u %u\n", header1.width, header1.height);
+        printf("codewords %.0f differ %llu\n", blocks,
+               (unsigned long long)job.sums.differ);
+        for (int f = 0; f < FIELDS; f++) {
+                printf("field %s differ %llu mean_abs %.4f max %u\n",
+                       FIELD_NAMES[f],
+                       (unsigned long long)job.sums.field_differ[f],
+                       blocks > 0 ? job.sums.field_abs[f] / blocks : 0.0,
+                       job.sums.field_max[f]);
+        }
+        printf("estimated_rms %.4f\n",
+               blocks > 0 ? sqrt(job.sums.estimated / (12 * blocks)) : 0.0);
+        if (exact) {
+                printf("exact_rms %.4f\n", blocks > 0 ?
+                       sqrt(job.sums.exact / (12 * blocks)) : 0.0);
+        }
+
+        FREE(workers);
+        pthread_mutex_destroy(&job.lock);
+        UArray_free(&job.words1);
+        UArray_free(&job.words2);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                    DIFF HELPER FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       read_all_codewords
+ * [Parameters]: 1 FILE* (input), 1 Comp40_header* (header, filled)
+ * [Return]:     UArray_T of all the image's codewords, row-major
+ * [Purpose]:    Reads a whole compressed image of either format, so threads
+ *               can share it without sharing its input
+ * [Errors]:     CRE if the image is malformed
+ */
+UArray_T read_all_codewords(FILE *input, Comp40_header *header)
+{
+        Comp40_T image = Comp40_open(input);
+        *header = Comp40_info(image);
+
+        unsigned bw    = header->width  / 2;
+        unsigned bh    = header->height / 2;
+        UArray_T words = UArray_new(bw * bh, sizeof(uint32_t));
+        words = Comp40_rect(image, 0, 0, bw, bh, words);
+        Comp40_close(&image);
+
+        return words;
+}
+
+/*
+ * [Name]:       diff_rows
+ * [Parameters]: 1 void* (closure, the struct diff_job)
+ * [Return]:     NULL
+ * [Purpose]:    Thread body: repeatedly takes the next DIFF_CHUNK block rows
+ *               and compares them, then adds its totals to the job's
+ * [Errors]:     CRE if cl is NULL
+ */
+void *diff_rows(void *cl)
+{
+        assert(cl != NULL);
+
+        struct diff_job *job = cl;
+        struct diff_sums sums;
+        memset(&sums, 0, sizeof(sums));
+
+        ppm strip1 = NULL, strip2 = NULL;
+        if (job->exact) {
+                strip1 = new_ppm(2 * job->bw, 2);
+                strip2 = new_ppm(2 * job->bw, 2);
+        }
+
+        for (;;) {
+                pthread_mutex_lock(&job->lock);
+                unsigned first = job->next;
+                job->next += DIFF_CHUNK;
+                pthread_mutex_unlock(&job->lock);
+
+                if (first >= job->bh) {
+                        break;
+                }
+
+                unsigned last = first + DIFF_CHUNK < job->bh ?
+                                first + DIFF_CHUNK : job->bh;
+                for (unsigned row = first; row < last; row++) {
+                        const uint32_t *w1 = UArray_at(job->words1,
+                                                       row * job->bw);
+                        const uint32_t *w2 = UArray_at(job->words2,
+                                                       row * job->bw);
+                        int same = 1;
+                        for (unsigned j = 0; j < job->bw; j++) {
+                                if (w1[j] != w2[j]) {
+                                        diff_codewords(w1[j], w2[j], &sums);
+                                        same = 0;
+                                }
+                        }
+                        if (job->exact && !same) {
+                                sums.exact += exact_error(job, row, strip1,
+                                                          strip2);
+                        }
+                }
+        }
+
+        pthread_mutex_lock(&job->lock);
+        job->sums.differ    += sums.differ;
+        job->sums.estimated += sums.estimated;
+        job->sums.exact     += sums.exact;
+        for (int f = 0; f < FIELDS; f++) {
+                job->sums.field_differ[f] += sums.field_differ[f];
+                job->sums.field_abs[f]    += sums.field_abs[f];
+                if (sums.field_max[f] > job->sums.field_max[f]) {
+                        job->sums.field_max[f] = sums.field_max[f];
+                }
+        }
+        pthread_mutex_unlock(&job->lock);
+
+        if (job->exact) {
+                Pnm_ppmfree(&strip1);
+                Pnm_ppmfree(&strip2);
+        }
+
+        return NULL;
+}
+
+/*
+ * [Name]:       diff_codewords
+ * [Parameters]: 2 uint32_t (different codewords of the same block), 1
+ *               struct diff_sums*
+ * [Return]:     void
+ * [Purpose]:    Adds the codewords' per-field differences and estimated
+ *               squared error to sums
+ * [Errors]:     None
+ */
+void diff_codewords(uint32_t word1, uint32_t word2, struct diff_sums *sums)
+{
+        struct bit_block bit1, bit2;
+        unpack(word1, &bit1);
+        unpack(word2, &bit2);
+
+        int deltas[FIELDS] = {
+                (int)bit1.a - (int)bit2.a, bit1.b - bit2.b, bit1.c - bit2.c,
+                bit1.d - bit2.d, (int)bit1.Pb - (int)bit2.Pb,
+                (int)bit1.Pr - (int)bit2.Pr
+        };
+
+        sums->differ++;
+        for (int f = 0; f < FIELDS; f++) {
+                unsigned delta = abs(deltas[f]);
+                sums->field_differ[f] += delta != 0;
+                sums->field_abs[f]    += delta;
+                if (delta > sums->field_max[f]) {
+                        sums->field_max[f] = delta;
+                }
+        }
+
+        sums->estimated += estimated_error(&bit1, &bit2);
+}
+
+/*
+ * [Name]:       estimated_error
+ * [Parameters]: 2 const struct bit_block* (fields of the same block)
+ * [Return]:     squared RGB error summed over the block's 4 pixels and 3
+ *               channels, in [0, 1] units, before rounding and clamping
+ * [Purpose]:    Each pixel's luma error is da +/- db +/- dc +/- dd, and its
+ *               chroma error is dPb, dPr; RGB is linear in those (the
+ *               inverse of rgb_xyz.c's transform), so the sum has a closed
+ *               form over the block
+ * [Errors]:     None
+ */
+double estimated_error(const struct bit_block *bit1,
+                       const struct bit_block *bit2)
+{
+        double da  = bit_to_avg_luma(bit1->a) - bit_to_avg_luma(bit2->a);
+        double db  = bit_to_bcd(bit1->b, B_WIDTH) - bit_to_bcd(bit2->b,
+                                                               B_WIDTH);
+        double dc  = bit_to_bcd(bit1->c, C_WIDTH) - bit_to_bcd(bit2->c,
+                                                               C_WIDTH);
+        double dd  = bit_to_bcd(bit1->d, D_WIDTH) - bit_to_bcd(bit2->d,
+                                                               D_WIDTH);
+        double dPb = Arith40_chroma_of_index(bit1->Pb) -
+                     Arith40_chroma_of_index(bit2->Pb);
+        double dPr = Arith40_chroma_of_index(bit1->Pr) -
+                     Arith40_chroma_of_index(bit2->Pr);
+
+        /* Chroma's share of each channel's error */
+        double kr = 1.402 * dPr;
+        double kg = -0.344136 * dPb - 0.714136 * dPr;
+        double kb = 1.772 * dPb;
+
+        double luma_squares = 4 * (da * da + db * db + dc * dc + dd * dd);
+
+        return 3 * luma_squares + 8 * da * (kr + kg + kb) +
+               4 * (kr * kr + kg * kg + kb * kb);
+}
+
+/*
+ * [Name]:       exact_error
+ * [Parameters]: 1 const struct diff_job*, 1 unsigned (block row), 2 ppm
+ *               (strip1, strip2: 2-pixel-high scratch pixmaps)
+ * [Return]:     squared RGB error summed over the row's pixels, in [0, 1]
+ *               units
+ * [Purpose]:    Decodes the block row of both images exactly as 40image -d
+ *               does, and compares the pixels
+ * [Errors]:     None
+ */
+double exact_error(const struct diff_job *job, unsigned row, ppm strip1,
+                   ppm strip2)
+{
+        decode_strip(job->words1, job->bw, row, strip1);
+        decode_strip(job->words2, job->bw, row, strip2);
+
+        double sum = 0;
+        for (unsigned y = 0; y < 2; y++) {
+                for (unsigned x = 0; x < strip1->width; x++) {
+                        Pnm_rgb px1 = strip1->methods->at(strip1->pixels, x,
+                                                          y);
+                        Pnm_rgb px2 = strip2->methods->at(strip2->pixels, x,
+                                                          y);
+                        double dr = ((double)px1->red   - px2->red)   / 255;
+                        double dg = ((double)px1->green - px2->green) / 255;
+                        double db = ((double)px1->blue  - px2->blue)  / 255;
+                        sum += dr * dr + dg * dg + db * db;
+                }
+        }
+
+        return sum;
+}
+
+/*
+ * [Name]:       decode_strip
+ * [Parameters]: 1 UArray_T (all codewords of an image), 2 unsigned integers
+ *               (image width in blocks, block row), 1 ppm (strip)
+ * [Return]:     void
+ * [Purpose]:    Decodes one block row into strip with the decompress
+ *               pipeline
+ * [Errors]:     None
+ */
+void decode_strip(UArray_T words, unsigned bw, unsigned row, ppm strip)
+{
+        UArray_T codewords = UArray_new(bw, sizeof(uint32_t));
+        memcpy(UArray_at(codewords, 0), UArray_at(words, row * bw),
+               bw * sizeof(uint32_t));
+
+        decompress_codewords(codewords, 2 * bw, 2, strip, 0, 0);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -0,0 +1,390 @@
+/*
+ *      edit.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the compressed-domain edit functions for 40image
+ *      - Crop:  Sends a rectangle of a COMP40 image on standard output
+ *      - Stack: Sends COMP40 images side by side (or one above the other) as
+ *               one COMP40 image on standard output
+ *      - Split: Writes a COMP40 image as a grid of smaller COMP40 files
+ *      - Each codeword codes its own 2x2 block, so all three only copy rows
+ *        of codewords into a new image: nothing is decoded or re-quantized
+ *      - Invariants:
+ *              ~ Every edge of a crop, piece or stacked image lies on a
+ *                2-pixel (block) boundary
+ *              ~ Format 2 files are mapped into memory and their rows of
+ *                big-endian codewords are written out as they are; other
+ *                input is read through a Comp40_T
+ *              ~ Output has the format (and, for format 3, the tile size and
+ *                coding) of the (first) input
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "assert.h"
+#include "codeword_io.h"
+#include "compress40ext.h"
+#include "mem.h"
+#include "uarray.h"
+
+/* -- A COMP40 image opened for copying rows of codewords -- */
+struct source {
+        Comp40_header        header;
+        unsigned             bw, bh;       /* in blocks                   */
+        const unsigned char *words;        /* big-endian, row-major       */
+        void                *map;          /* mapped file, or NULL        */
+        size_t               map_len;
+        unsigned char       *copy;         /* words, if not mapped        */
+};
+
+/* -- A COMP40 image being written, one run of codewords at a time -- */
+struct sink {
+        FILE          *output;
+        Comp40_header  header;
+        UArray_T       codewords;          /* format 3: all codewords     */
+        size_t         next;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- SOURCE HELPER FUNCTIONS -- */
+void                 open_source (FILE *input, struct source *src);
+void                 close_source(struct source *src);
+const unsigned char *source_row  (const struct source *src, unsigned bx,
+                                  unsigned by);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- SINK HELPER FUNCTIONS -- */
+void open_sink (FILE *output, const Comp40_header *like, unsigned width,
+                unsigned height, struct sink *dst);
+void sink_put  (struct sink *dst, const unsigned char *words, unsigned n);
+void close_sink(struct sink *dst);
+void copy_rect (const struct source *src, unsigned bx, unsigned by,
+                unsigned bw, unsigned bh, FILE *output);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                       EDIT FUNCTIONS                         |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       crop40
+ * [Parameters]: 1 FILE* (input), 4 unsigned integers (x, y, width, height
+ *               of the region, in pixels)
+ * [Return]:     void
+ * [Purpose]:    Sends the width x height region at pixel (x, y) of the
+ *               compressed image on input stream on standard output, still
+ *               compressed
+ *               Note: Region is clipped to the image's right/bottom edges
+ * [Errors]:     CRE if input is NULL, region is empty or outside the image,
+ *                   or any of x, y, width and height is odd
+ */
+void crop40(FILE *input, unsigned x, unsigned y, unsigned width,
+            unsigned height)
+{
+        assert(input != NULL);
+        assert(x % 2 == 0 && y % 2 == 0 && width % 2 == 0 && height % 2 == 0);
+
+        struct source src;
+        open_source(input, &src);
+
+        assert(x < src.header.width && y < src.header.height);
+        assert(width > 0 && height > 0);
+        if (width > src.header.width - x) {
+                width = src.header.width - x;
+        }
+        if (height > src.header.height - y) {
+                height = src.header.height - y;
+        }
+
+        copy_rect(&src, x / 2, y / 2, width / 2, height / 2, stdout);
+        close_source(&src);
+}
+
+/*
+ * [Name]:       stack40
+ * [Parameters]: 1 FILE** (inputs), 1 unsigned (n, number of inputs), 1 int
+ *               (horizontal: nonzero to stack left to right, else top to
+ *               bottom)
+ * [Return]:     void
+ * [Purpose]:    Sends the compressed images on the inputs, joined in order,
+ *               on standard output as one compressed image
+ * [Errors]:     CRE if inputs (or any input) is NULL, n is 0, or the images
+ *                   differ in height (horizontal) or width (vertical)
+ */
+void stack40(FILE **inputs, unsigned n, int horizontal)
+{
+        assert(inputs != NULL && n > 0);
+
+        struct source *srcs  = ALLOC(n * sizeof(*srcs));
+        unsigned       width = 0, height = 0;
+        for (unsigned i = 0; i < n; i++) {
+                assert(inputs[i] != NULL);
+                open_source(inputs[i], &srcs[i]);
+                if (horizontal) {
+                        assert(srcs[i].bh == srcs[0].bh);
+                        width += srcs[i].header.width;
+                        height = srcs[i].header.height;
+                } else {
+                        assert(srcs[i].bw == srcs[0].bw);
+                        width   = srcs[i].header.width;
+                        height += srcs[i].header.height;
+                }
+        }
+
+        struct sink dst;
+        open_sink(stdout, &srcs[0].header, width, height, &dst);
+        if (horizontal) {
+                for (unsigned row = 0; row < srcs[0].bh; row++) {
+                        for (unsigned i = 0; i < n; i++) {
+                                sink_put(&dst, source_row(&srcs[i], 0, row),
+                                         srcs[i].bw);
+                        }
+                }
+        } else {
+                for (unsigned i = 0; i < n; i++) {
+                        sink_put(&dst, source_row(&srcs[i], 0, 0),
+                                 srcs[i].bw * srcs[i].bh);
+                }
+        }
+        close_sink(&dst);
+
+        for (unsigned i = 0; i < n; i++) {
+                close_source(&srcs[i]);
+        }
+        FREE(srcs);
+}
+
+/*
+ * [Name]:       split40
+ * [Parameters]: 1 FILE* (input), 2 unsigned integers (width and height of
+ *               a piece, in pixels), 1 const char* (prefix of the pieces'
+ *               file names)
+ * [Return]:     void
+ * [Purpose]:    Writes the compressed image on input stream as a grid of
+ *               compressed pieces, the piece in grid row r and column c
+ *               going to the file "<prefix>-<r>-<c>.c40"
+ *               Note: Pieces along the right/bottom edges may be smaller
+ * [Errors]:     CRE if input or prefix is NULL, width or height is 0 or odd,
+ *                   or a piece cannot be written
+ */
+void split40(FILE *input, unsigned width, unsigned height, const char *prefix)
+{
+        assert(input != NULL && prefix != NULL);
+        assert(width > 0 && height > 0 && width % 2 == 0 && height % 2 == 0);
+
+        struct source src;
+        open_source(input, &src);
+
+        unsigned pw   = width  / 2;
+        unsigned ph   = height / 2;
+        char    *path = ALLOC(strlen(prefix) + 32);
+
+        for (unsigned r = 0; r * ph < src.bh; r++) {
+                for (unsigned c = 0; c * pw < src.bw; c++) {
+                        sprintf(path, "%s-%u-%u.c40", prefix, r, c);
+                        FILE *output = fopen(path, "wb");
+                        assert(output != NULL);
+
+                        unsigned bw = src.bw - c * pw < pw ? src.bw - c * pw
+                                                           : pw;
+                        unsigned bh = src.bh - r * ph < ph ? src.bh - r * ph
+                                                           : ph;
+                        copy_rect(&src, c * pw, r * ph, bw, bh, output);
+
+                        int err = fclose(output);
+                        assert(err == 0);
+                }
+        }
+
+        FREE(path);
+        close_source(&src);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                   SOURCE HELPER FUNCTIONS                    |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       open_source
+ * [Parameters]: 1 FILE* (input), 1 struct source* (src, filled)
+ * [Return]:     void
+ * [Purpose]:    Opens the compressed image on input for copying: a format 2
+ *               regular file is mapped, so its codewords are never copied
+ *               into memory; anything else (pipes, format 3) is read whole
+ *               and converted to big-endian codewords
+ * [Errors]:     CRE if header is malformed or input ends early
+ */
+void open_source(FILE *input, struct source *src)
+{
+        Comp40_T image = Comp40_open(input);
+
+        src->header = Comp40_info(image);
+        src->bw     = src->header.width  / 2;
+        src->bh     = src->header.height / 2;
+        src->map    = NULL;
+        src->copy   = NULL;
+
+        size_t      bytes = (size_t)src->bw * src->bh * CODEWORD_BYTES;
+        long        base  = ftell(input);
+        struct stat info;
+        if (src->header.format == 2 && base >= 0 &&
+            fstat(fileno(input), &info) == 0 && S_ISREG(info.st_mode) &&
+            (size_t)info.st_size >= base + bytes && bytes > 0) {
+                src->map_len = base + bytes;
+                src->map = mmap(NULL, src->map_len, PROT_READ, MAP_PRIVATE,
+                                fileno(input), 0);
+                if (src->map == MAP_FAILED) {
+                        src->map = NULL;
+                } else {
+                        madvise(src->map, src->map_len, MADV_SEQUENTIAL);
+                        src->words = (unsigned char *)src->map + base;
+                }
+        }
+
+        if (src->map == NULL) {
+                UArray_T codewords = UArray_new(src->bw * src->bh,
+                                                sizeof(uint32_t));
+                codewords = Comp40_rect(image, 0, 0, src->bw, src->bh,
+                                        codewords);
+
+                src->copy = ALLOC(bytes + 1);
+                for (unsigned i = 0; i < src->bw * src->bh; i++) {
+                        put_codeword(src->copy + (size_t)i * CODEWORD_BYTES,
+                                     *(uint32_t *)UArray_at(codewords, i));
+                }
+                src->words = src->copy;
+                UArray_free(&codewords);
+        }
+
+        Comp40_close(&image);
+}
+
+/*
+ * [Name]:       close_source
+ * [Parameters]: 1 struct source*
+ * [Return]:     void
+ * [Purpose]:    Unmaps or frees the codewords of src
+ * [Errors]:     None
+ */
+void close_source(struct source *src)
+{
+        if (src->map != NULL) {
+                munmap(src->map, src->map_len);
+        }
+        if (src->copy != NULL) {
+                FREE(src->copy);
+        }
+}
+
+/*
+ * [Name]:       source_row
+ * [Parameters]: 1 const struct source*, 2 unsigned integers (block column
+ *               and row)
+ * [Return]:     pointer to the big-endian codeword of block (bx, by); the
+ *               rest of its row (and the rows below) follow it
+ * [Purpose]:    Addresses codewords for bulk copies
+ * [Errors]:     None
+ */
+const unsigned char *source_row(const struct source *src, unsigned bx,
+                                unsigned by)
+{
+        return src->words + ((size_t)by * src->bw + bx) * CODEWORD_BYTES;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                    SINK HELPER FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       open_sink
+ * [Parameters]: 1 FILE* (output), 1 const Comp40_header* (like: header
+ *               whose format, tile size and coding are kept), 2 unsigned
+ *               integers (width and height of the new image, in pixels), 1
+ *               struct sink* (dst, filled)
+ * [Return]:     void
+ * [Purpose]:    Starts writing a compressed image: format 2 prints its
+ *               header now, format 3 collects codewords until close_sink
+ * [Errors]:     None
+ */
+void open_sink(FILE *output, const Comp40_header *like, unsigned width,
+               unsigned height, struct sink *dst)
+{
+        dst->output        = output;
+        dst->header        = *like;
+        dst->header.width  = width;
+        dst->header.height = height;
+        dst->codewords     = NULL;
+        dst->next          = 0;
+
+        if (like->format == 3) {
+                dst->codewords = UArray_new((width / 2) * (height / 2),
+                                            sizeof(uint32_t));
+        } else {
+                write_header(output, width, height);
+        }
+}
+
+/*
+ * [Name]:       sink_put
+ * [Parameters]: 1 struct sink* (dst), 1 const unsigned char* (n big-endian
+ *               codewords), 1 unsigned (n)
+ * [Return]:     void
+ * [Purpose]:    Appends the next n codewords (in row-major order) to dst
+ * [Errors]:     CRE if output cannot be written
+ */
+void sink_put(struct sink *dst, const unsigned char *words, unsigned n)
+{
+        if (dst->codewords == NULL) {
+                size_t put = fwrite(words, CODEWORD_BYTES, n, dst->output);
+                assert(put == n);
+                return;
+        }
+
+        for (unsigned i = 0; i < n; i++) {
+                *(uint32_t *)UArray_at(dst->codewords, dst->next++) =
+                        get_codeword(words + (size_t)i * CODEWORD_BYTES);
+        }
+}
+
+/*
+ * [Name]:       close_sink
+ * [Parameters]: 1 struct sink*
+ * [Return]:     void
+ * [Purpose]:    Finishes the image: format 3 writes its tiles now
+ * [Errors]:     None
+ */
+void close_sink(struct sink *dst)
+{
+        if (dst->codewords != NULL) {
+                write_tiled(dst->output, dst->codewords, dst->header.width,
+                            dst->header.height, dst->header.tile,
+                            dst->header.coding);
+                UArray_free(&dst->codewords);
+        }
+}
+
+/*
+ * [Name]:       copy_rect
+ * [Parameters]: 1 const struct source*, 4 unsigned integers (block column
+ *               and row of the rectangle, its width and height in blocks),
+ *               1 FILE* (output)
+ * [Return]:     void
+ * [Purpose]:    Writes the rectangle of src as a compressed image of its
+ *               own, one row of codewords at a time
+ * [Errors]:     None
+ */
+void copy_rect(const struct source *src, unsigned bx, unsigned by,
+               unsigned bw, unsigned bh, FILE *output)
+{
+        struct sink dst;
+        open_sink(output, &src->header, 2 * bw, 2 * bh, &dst);
+        for (unsigned row = 0; row < bh; row++) {
+                sink_put(&dst, source_row(src, bx, by + row), bw);
+        }
+        close_sink(&dst);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
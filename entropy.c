@@ -0,0 +1,650 @@
+/*
+ *      entropy.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Component file defining all extern and helper functions for the
+ *        entropy component
+ *      - Component losslessly codes a tile of codewords with canonical
+ *        Huffman codes, and back
+ *      - Payload layout:
+ *              ~ Code lengths (one 4-bit nibble per symbol, high nibble
+ *                first) of the three code tables: a errors, b/c/d values and
+ *                Pb/Pr errors
+ *              ~ Then, for each block in row-major order, the codes of
+ *                a, b, c, d, Pb and Pr, packed most significant bit first
+ *      - Component-wide invariants:
+ *              ~ a, Pb and Pr are predicted from the left and above blocks
+ *                (their average when both exist); the prediction error is
+ *                wrapped to the field's width, so coding is lossless
+ *              ~ Signed values and errors are zigzag-mapped (0, -1, 1, -2,
+ *                ...) so that small magnitudes get the small symbols
+ *              ~ No code is longer than MAX_CODE_LEN bits
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assert.h"
+#include "entropy.h"
+#include "mem.h"
+#include "pixpack.h"
+
+/* -- Limits of the code tables -- */
+#define MAX_CODE_LEN 15
+#define MAX_SYMBOLS  256
+#define FAST_BITS    9      /* codes up to this long decode in one lookup */
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- Which table each of a block's six fields is coded with -- */
+enum { DC_TABLE, AC_TABLE, CHROMA_TABLE, NUM_TABLES };
+static const int FIELD_TABLE[6] = { DC_TABLE, AC_TABLE, AC_TABLE, AC_TABLE,
+                                    CHROMA_TABLE, CHROMA_TABLE };
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- Canonical Huffman code table -- */
+typedef struct table {
+        int            n;                        /* number of symbols    */
+        unsigned char  lengths[MAX_SYMBOLS];     /* 0 if symbol unused   */
+        unsigned       codes  [MAX_SYMBOLS];     /* for encoding         */
+        unsigned short counts [MAX_CODE_LEN + 1];/* codes of each length */
+        unsigned short symbols[MAX_SYMBOLS];     /* by (length, symbol)  */
+        unsigned short fast[1 << FAST_BITS];     /* see build_fast       */
+} table;
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- Bit streams, most significant bit first -- */
+typedef struct bit_writer {
+        unsigned char *bytes;
+        size_t         len, cap;
+        uint32_t       acc;
+        int            nbits;
+} bit_writer;
+
+typedef struct bit_reader {
+        const unsigned char *bytes;
+        size_t               len, pos;   /* pos is in bytes            */
+        uint64_t             buf;        /* next bits, from the top    */
+        int                  nbits;      /* bits of buf from the input */
+} bit_reader;
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- SYMBOL HELPER FUNCTIONS -- */
+void     table_sizes  (int sizes[NUM_TABLES]);
+void     block_symbols(struct bit_block *fields, unsigned blocks_wide, int i,
+                       unsigned symbols[6]);
+void     block_fields (struct bit_block *fields, unsigned blocks_wide, int i,
+                       const unsigned symbols[6]);
+unsigned predict      (struct bit_block *fields, unsigned blocks_wide, int i,
+                       int field);
+unsigned zigzag       (int value, int width);
+int      unzigzag     (unsigned symbol);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- HUFFMAN HELPER FUNCTIONS -- */
+void build_lengths(const unsigned long *freq, int n, unsigned char *lengths);
+void assign_codes (table *t);
+void build_fast   (table *t);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- BIT STREAM HELPER FUNCTIONS -- */
+void     put_bits  (bit_writer *w, unsigned code, int len);
+void     flush_bits(bit_writer *w);
+void     refill    (bit_reader *r);
+unsigned get_bits  (bit_reader *r, int len);
+void     skip_bits (bit_reader *r, int len);
+unsigned get_symbol(bit_reader *r, const table *t);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                      CODING FUNCTIONS                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       entropy_encode
+ * [Parameters]: 1 UArray (codewords of a tile, row-major), 1 unsigned (tile
+ *               width in blocks), 1 size_t* (len, set to the payload size)
+ * [Return]:     malloc'd payload holding the coded tile
+ * [Purpose]:    Turns every block into six symbols, builds one Huffman code
+ *               per table from their frequencies in this tile only (so each
+ *               tile decodes on its own), then writes the code lengths and
+ *               the coded symbols
+ * [Errors]:     CRE if any parameter is NULL
+ */
+unsigned char *entropy_encode(UArray_T codewords, unsigned blocks_wide,
+                              size_t *len)
+{
+        assert(codewords != NULL && len != NULL);
+
+        int blocks = UArray_length(codewords);
+        struct bit_block *fields = ALLOC((blocks + 1) * sizeof(*fields));
+        unsigned         *syms   = ALLOC((blocks + 1) * 6 * sizeof(*syms));
+        for (int i = 0; i < blocks; i++) {
+                unpack(*(uint32_t *)UArray_at(codewords, i), &fields[i]);
+        }
+
+        /* Symbols and their frequencies */
+        int sizes[NUM_TABLES];
+        table_sizes(sizes);
+        unsigned long freq[NUM_TABLES][MAX_SYMBOLS] = { { 0 } };
+        for (int i = 0; i < blocks; i++) {
+                block_symbols(fields, blocks_wide, i, &syms[i * 6]);
+                for (int f = 0; f < 6; f++) {
+                        freq[FIELD_TABLE[f]][syms[i * 6 + f]]++;
+                }
+        }
+
+        /* Code tables, stored as a nibble per symbol */
+        table      tables[NUM_TABLES];
+        bit_writer w = { .cap = 1024 };
+        w.bytes = ALLOC(w.cap);
+        for (int t = 0; t < NUM_TABLES; t++) {
+                tables[t].n = sizes[t];
+                build_lengths(freq[t], sizes[t], tables[t].lengths);
+                assign_codes(&tables[t]);
+                for (int s = 0; s < sizes[t]; s++) {
+                        put_bits(&w, tables[t].lengths[s], 4);
+                }
+        }
+        flush_bits(&w);
+
+        /* Coded blocks */
+        for (int i = 0; i < blocks * 6; i++) {
+                const table *t = &tables[FIELD_TABLE[i % 6]];
+                put_bits(&w, t->codes[syms[i]], t->lengths[syms[i]]);
+        }
+        flush_bits(&w);
+
+        FREE(fields);
+        FREE(syms);
+
+        *len = w.len;
+        return w.bytes;
+}
+
+/*
+ * [Name]:       entropy_decode
+ * [Parameters]: 1 const unsigned char* (payload), 1 size_t (its length),
+ *               1 unsigned (tile width in blocks), 1 UArray (codewords)
+ * [Return]:     codewords, filled with the decoded tile in row-major order
+ * [Purpose]:    Reads the code tables, then decodes each block's symbols,
+ *               undoing the prediction against already-decoded neighbors,
+ *               and packs the fields back into codewords
+ * [Errors]:     CRE if any pointer is NULL or payload is malformed
+ */
+UArray_T entropy_decode(const unsigned char *bytes, size_t len,
+                        unsigned blocks_wide, UArray_T codewords)
+{
+        assert(bytes != NULL && codewords != NULL);
+
+        int sizes[NUM_TABLES];
+        table_sizes(sizes);
+
+        /* Code tables */
+        table      tables[NUM_TABLES];
+        bit_reader r = { .bytes = bytes, .len = len };
+        for (int t = 0; t < NUM_TABLES; t++) {
+                tables[t].n = sizes[t];
+                for (int s = 0; s < sizes[t]; s++) {
+                        tables[t].lengths[s] = get_bits(&r, 4);
+                }
+                assign_codes(&tables[t]);
+                build_fast(&tables[t]);
+        }
+        skip_bits(&r, r.nbits % 8);
+
+        /* Coded blocks */
+        int blocks = UArray_length(codewords);
+        struct bit_block *fields = ALLOC((blocks + 1) * sizeof(*fields));
+        for (int i = 0; i < blocks; i++) {
+                unsigned syms[6];
+                for (int f = 0; f < 6; f++) {
+                        syms[f] = get_symbol(&r, &tables[FIELD_TABLE[f]]);
+                }
+                block_fields(fields, blocks_wide, i, syms);
+
+                uint32_t *codeword = UArray_at(codewords, i);
+                *codeword = pack(&fields[i]);
+        }
+
+        FREE(fields);
+        return codewords;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                    SYMBOL HELPER FUNCTIONS                   |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       table_sizes
+ * [Parameters]: 1 int array (sizes, one per table)
+ * [Return]:     void
+ * [Purpose]:    Gives the number of symbols in each table, from the widths
+ *               of the fields it codes
+ * [Errors]:     CRE if a field is too wide for the tables
+ */
+void table_sizes(int sizes[NUM_TABLES])
+{
+        int ac     = B_WIDTH  > C_WIDTH ? B_WIDTH : C_WIDTH;
+        ac         = D_WIDTH  > ac      ? D_WIDTH : ac;
+        int chroma = PB_WIDTH > PR_WIDTH ? PB_WIDTH : PR_WIDTH;
+
+        sizes[DC_TABLE]     = 1 << A_WIDTH;
+        sizes[AC_TABLE]     = 1 << ac;
+        sizes[CHROMA_TABLE] = 1 << chroma;
+
+        for (int t = 0; t < NUM_TABLES; t++) {
+                assert(sizes[t] <= MAX_SYMBOLS);
+        }
+}
+
+/*
+ * [Name]:       block_symbols
+ * [Parameters]: 1 struct bit_block* (fields of the whole tile), 1 unsigned
+ *               (tile width in blocks), 1 int (block index), 1 unsigned
+ *               array (symbols, filled in field order a, b, c, d, Pb, Pr)
+ * [Return]:     void
+ * [Purpose]:    Maps one block's fields to the symbols that get coded
+ * [Errors]:     None
+ */
+void block_symbols(struct bit_block *fields, unsigned blocks_wide, int i,
+                   unsigned symbols[6])
+{
+        struct bit_block *bit = &fields[i];
+
+        symbols[0] = zigzag((int)bit->a  - (int)predict(fields, blocks_wide,
+                                                        i, 0), A_WIDTH);
+        symbols[1] = zigzag(bit->b, B_WIDTH);
+        symbols[2] = zigzag(bit->c, C_WIDTH);
+        symbols[3] = zigzag(bit->d, D_WIDTH);
+        symbols[4] = zigzag((int)bit->Pb - (int)predict(fields, blocks_wide,
+                                                        i, 4), PB_WIDTH);
+        symbols[5] = zigzag((int)bit->Pr - (int)predict(fields, blocks_wide,
+                                                        i, 5), PR_WIDTH);
+}
+
+/*
+ * [Name]:       block_fields
+ * [Parameters]: 1 struct bit_block* (fields of the whole tile), 1 unsigned
+ *               (tile width in blocks), 1 int (block index), 1 const
+ *               unsigned array (symbols, in field order)
+ * [Return]:     void
+ * [Purpose]:    Inverse of block_symbols: recovers one block's fields, given
+ *               that every block before it has been recovered already
+ * [Errors]:     None
+ */
+void block_fields(struct bit_block *fields, unsigned blocks_wide, int i,
+                  const unsigned symbols[6])
+{
+        struct bit_block *bit = &fields[i];
+        unsigned a_mask  = (1u << A_WIDTH)  - 1;
+        unsigned pb_mask = (1u << PB_WIDTH) - 1;
+        unsigned pr_mask = (1u << PR_WIDTH) - 1;
+
+        bit->a  = (predict(fields, blocks_wide, i, 0) + unzigzag(symbols[0]))
+                  & a_mask;
+        bit->b  = unzigzag(symbols[1]);
+        bit->c  = unzigzag(symbols[2]);
+        bit->d  = unzigzag(symbols[3]);
+        bit->Pb = (predict(fields, blocks_wide, i, 4) + unzigzag(symbols[4]))
+                  & pb_mask;
+        bit->Pr = (predict(fields, blocks_wide, i, 5) + unzigzag(symbols[5]))
+                  & pr_mask;
+}
+
+/*
+ * [Name]:       predict
+ * [Parameters]: 1 struct bit_block* (fields of the whole tile), 1 unsigned
+ *               (tile width in blocks), 1 int (block index), 1 int (field:
+ *               0 for a, 4 for Pb, 5 for Pr)
+ * [Return]:     predicted value of the field for block i
+ * [Purpose]:    Predicts a smooth field from the blocks to the left of and
+ *               above block i, which the decoder always has already
+ * [Errors]:     None
+ */
+unsigned predict(struct bit_block *fields, unsigned blocks_wide, int i,
+                 int field)
+{
+        int has_left  = i % blocks_wide != 0;
+        int has_above = (unsigned)i >= blocks_wide;
+        unsigned left = 0, above = 0;
+
+        if (has_left) {
+                struct bit_block *bit = &fields[i - 1];
+                left = field == 0 ? bit->a : field == 4 ? bit->Pb : bit->Pr;
+        }
+        if (has_above) {
+                struct bit_block *bit = &fields[i - blocks_wide];
+                above = field == 0 ? bit->a : field == 4 ? bit->Pb : bit->Pr;
+        }
+
+        if (has_left && has_above) {
+                return (left + above + 1) / 2;
+        }
+
+        return left + above;
+}
+
+/*
+ * [Name]:       zigzag
+ * [Parameters]: 1 int (value or prediction error), 1 int (field width)
+ * [Return]:     symbol in [0, 2^width)
+ * [Purpose]:    Wraps value into the signed range of a width-bit field, then
+ *               interleaves signs: 0 -> 0, -1 -> 1, 1 -> 2, -2 -> 3, ...
+ * [Errors]:     None
+ */
+unsigned zigzag(int value, int width)
+{
+        int half = 1 << (width - 1);
+
+        value = ((value + half) & ((1 << width) - 1)) - half;
+
+        return value >= 0 ? 2 * value : -2 * value - 1;
+}
+
+/*
+ * [Name]:       unzigzag
+ * [Parameters]: 1 unsigned (symbol)
+ * [Return]:     the signed value the symbol stands for
+ * [Purpose]:    Inverse of zigzag (before wrapping)
+ * [Errors]:     None
+ */
+int unzigzag(unsigned symbol)
+{
+        return symbol % 2 == 0 ? (int)(symbol / 2) : -(int)((symbol + 1) / 2);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                   HUFFMAN HELPER FUNCTIONS                   |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       build_lengths
+ * [Parameters]: 1 const unsigned long* (symbol frequencies), 1 int (number
+ *               of symbols), 1 unsigned char* (lengths, filled)
+ * [Return]:     void
+ * [Purpose]:    Builds a Huffman tree over the used symbols and stores each
+ *               symbol's depth as its code length. If the tree is deeper
+ *               than MAX_CODE_LEN, frequencies are halved (flattening the
+ *               tree) and it is rebuilt
+ *               Note: A lone used symbol still gets a 1-bit code
+ * [Errors]:     None
+ */
+void build_lengths(const unsigned long *freq, int n, unsigned char *lengths)
+{
+        unsigned long weight[2 * MAX_SYMBOLS];
+        int           parent[2 * MAX_SYMBOLS];
+        char          alive [2 * MAX_SYMBOLS];
+
+        memset(lengths, 0, n);
+        for (int s = 0; s < n; s++) {
+                weight[s] = freq[s];
+        }
+
+        for (;;) {
+                int active = 0;
+                for (int s = 0; s < n; s++) {
+                        alive[s] = weight[s] > 0;
+                        active  += alive[s];
+                }
+                if (active <= 1) {
+                        for (int s = 0; s < n; s++) {
+                                lengths[s] = alive[s];
+                        }
+                        return;
+                }
+
+                /* Merge the two lightest live nodes until one is left */
+                int next = n;
+                for (; active > 1; active--, next++) {
+                        int lo[2] = { -1, -1 };
+                        for (int x = 0; x < next; x++) {
+                                if (!alive[x]) {
+                                        continue;
+                                }
+                                if (lo[0] < 0 || weight[x] < weight[lo[0]]) {
+                                        lo[1] = lo[0];
+                                        lo[0] = x;
+                                } else if (lo[1] < 0 ||
+                                           weight[x] < weight[lo[1]]) {
+                                        lo[1] = x;
+                                }
+                        }
+                        weight[next] = weight[lo[0]] + weight[lo[1]];
+                        alive [next] = 1;
+                        alive [lo[0]] = alive[lo[1]] = 0;
+                        parent[lo[0]] = parent[lo[1]] = next;
+                }
+
+                int root = next - 1;
+                int max  = 0;
+                for (int s = 0; s < n; s++) {
+                        int depth = 0;
+                        for (int x = s; weight[s] > 0 && x != root;
+                             x = parent[x]) {
+                                depth++;
+                        }
+                        lengths[s] = depth;
+                        max = depth > max ? depth : max;
+                }
+                if (max <= MAX_CODE_LEN) {
+                        return;
+                }
+
+                for (int s = 0; s < n; s++) {
+                        weight[s] = (weight[s] + 1) / 2;
+                }
+        }
+}
+
+/*
+ * [Name]:       assign_codes
+ * [Parameters]: 1 table* (with lengths filled in)
+ * [Return]:     void
+ * [Purpose]:    Assigns canonical codes: shorter codes first, and codes of
+ *               equal length in symbol order. Encoder and decoder derive the
+ *               same codes from the lengths alone
+ * [Errors]:     CRE if a length exceeds MAX_CODE_LEN, or the lengths are
+ *                   not a prefix code (more codes of some length than are
+ *                   left, i.e. a Kraft sum over 1), as in a corrupt payload
+ */
+void assign_codes(table *t)
+{
+        unsigned next[MAX_CODE_LEN + 2];
+        unsigned index[MAX_CODE_LEN + 2];
+
+        memset(t->counts, 0, sizeof(t->counts));
+        for (int s = 0; s < t->n; s++) {
+                assert(t->lengths[s] <= MAX_CODE_LEN);
+                t->counts[t->lengths[s]]++;
+        }
+        t->counts[0] = 0;
+
+        unsigned code = 0;
+        index[1] = 0;
+        for (int len = 1; len <= MAX_CODE_LEN; len++) {
+                assert(code + t->counts[len] <= 1u << len);
+                next [len]     = code;
+                code           = (code + t->counts[len]) << 1;
+                index[len + 1] = index[len] + t->counts[len];
+        }
+
+        for (int s = 0; s < t->n; s++) {
+                int len = t->lengths[s];
+                if (len > 0) {
+                        t->codes[s]               = next[len]++;
+                        t->symbols[index[len]++] = s;
+                }
+        }
+}
+
+/*
+ * [Name]:       build_fast
+ * [Parameters]: 1 table* (with codes assigned)
+ * [Return]:     void
+ * [Purpose]:    Fills the lookup used by get_symbol: entry i, for the next
+ *               FAST_BITS bits of the stream being i, is (symbol << 4) |
+ *               length of the code those bits start with, or 0 if that code
+ *               is longer than FAST_BITS
+ *               Note: Only the 2^FAST_BITS entries are rebuilt per tile;
+ *               a full 2^MAX_CODE_LEN lookup would cost more to fill than
+ *               a small tile takes to decode
+ * [Errors]:     None
+ */
+void build_fast(table *t)
+{
+        memset(t->fast, 0, sizeof(t->fast));
+
+        for (int s = 0; s < t->n; s++) {
+                int len = t->lengths[s];
+                if (len == 0 || len > FAST_BITS) {
+                        continue;
+                }
+
+                unsigned first = t->codes[s] << (FAST_BITS - len);
+                unsigned span  = 1u << (FAST_BITS - len);
+                for (unsigned i = first; i < first + span; i++) {
+                        t->fast[i] = (s << 4) | len;
+                }
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*---------------------------------------------------------------
+ |                  BIT STREAM HELPER FUNCTIONS                 |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       put_bits
+ * [Parameters]: 1 bit_writer*, 1 unsigned (code), 1 int (length in bits)
+ * [Return]:     void
+ * [Purpose]:    Appends the low len bits of code to the stream, most
+ *               significant first
+ * [Errors]:     None
+ */
+void put_bits(bit_writer *w, unsigned code, int len)
+{
+        w->acc    = (w->acc << len) | (code & ((1u << len) - 1));
+        w->nbits += len;
+
+        while (w->nbits >= 8) {
+                if (w->len == w->cap) {
+                        w->cap *= 2;
+                        RESIZE(w->bytes, w->cap);
+                }
+                w->nbits -= 8;
+                w->bytes[w->len++] = w->acc >> w->nbits;
+                w->acc &= (1u << w->nbits) - 1;
+        }
+}
+
+/*
+ * [Name]:       flush_bits
+ * [Parameters]: 1 bit_writer*
+ * [Return]:     void
+ * [Purpose]:    Pads the stream with zero bits up to the next byte boundary
+ * [Errors]:     None
+ */
+void flush_bits(bit_writer *w)
+{
+        if (w->nbits > 0) {
+                put_bits(w, 0, 8 - w->nbits);
+        }
+}
+
+/*
+ * [Name]:       refill
+ * [Parameters]: 1 bit_reader*
+ * [Return]:     void
+ * [Purpose]:    Tops buf up with whole bytes of the input, so that it holds
+ *               at least 57 bits until the input runs out; the bits of buf
+ *               past nbits are always 0
+ * [Errors]:     None
+ */
+void refill(bit_reader *r)
+{
+        while (r->nbits <= 56 && r->pos < r->len) {
+                r->buf   |= (uint64_t)r->bytes[r->pos++] << (56 - r->nbits);
+                r->nbits += 8;
+        }
+}
+
+/*
+ * [Name]:       get_bits
+ * [Parameters]: 1 bit_reader*, 1 int (length in bits, 1 to MAX_CODE_LEN)
+ * [Return]:     next len bits of the stream, most significant first
+ * [Purpose]:    Reads a fixed-width field (the code lengths)
+ * [Errors]:     CRE if the stream has run out
+ */
+unsigned get_bits(bit_reader *r, int len)
+{
+        if (r->nbits < len) {
+                refill(r);
+                assert(r->nbits >= len);
+        }
+
+        unsigned bits = r->buf >> (64 - len);
+        skip_bits(r, len);
+
+        return bits;
+}
+
+/*
+ * [Name]:       skip_bits
+ * [Parameters]: 1 bit_reader*, 1 int (length in bits, at most nbits)
+ * [Return]:     void
+ * [Purpose]:    Consumes len bits of buf
+ * [Errors]:     None
+ */
+void skip_bits(bit_reader *r, int len)
+{
+        r->buf   <<= len;
+        r->nbits  -= len;
+}
+
+/*
+ * [Name]:       get_symbol
+ * [Parameters]: 1 bit_reader*, 1 const table*
+ * [Return]:     next symbol of the stream
+ * [Purpose]:    Peeks MAX_CODE_LEN bits (zeros past the end of the input)
+ *               and decodes one canonical code from them: codes of up to
+ *               FAST_BITS bits with one lookup, longer ones by walking the
+ *               lengths, since codes of each length are consecutive, so the
+ *               first len bits are a code of that length iff they fall in
+ *               their range
+ * [Errors]:     CRE if the bits match no code, or the code runs past the
+ *               end of the input
+ */
+unsigned get_symbol(bit_reader *r, const table *t)
+{
+        if (r->nbits < MAX_CODE_LEN) {
+                refill(r);
+        }
+        unsigned peek  = r->buf >> (64 - MAX_CODE_LEN);
+        unsigned entry = t->fast[peek >> (MAX_CODE_LEN - FAST_BITS)];
+
+        if (entry != 0) {
+                int len = entry & 0xf;
+                assert(len <= r->nbits);
+                skip_bits(r, len);
+                return entry >> 4;
+        }
+
+        unsigned first = 0, index = 0;
+        for (int len = 1; len <= MAX_CODE_LEN; len++) {
+                unsigned code  = peek >> (MAX_CODE_LEN - len);
+                unsigned count = t->counts[len];
+                if (code - first < count) {
+                        assert(len <= r->nbits);
+                        skip_bits(r, len);
+                        return t->symbols[index + code - first];
+                }
+
+                index  += count;
+                first  += count;
+                first <<= 1;
+        }
+
+        assert(0);
+        return 0;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -0,0 +1,38 @@
+/*
+ *      entropy.h
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Header file declaring client-accessible functions for the
+ *        entropy component
+ *      - Component losslessly codes a rectangle of codewords (a tile) into a
+ *        smaller, self-contained byte payload with canonical Huffman codes,
+ *        and back
+ *      - a, Pb and Pr are predicted from neighboring blocks and only the
+ *        prediction error is coded; b, c and d are coded directly, since
+ *        they already cluster around zero
+ */
+
+#ifndef ENTROPY_INCLUDED
+#define ENTROPY_INCLUDED
+
+#include <stddef.h>
+
+#include "uarray.h"
+
+/*
+ * Codes the codewords of a tile blocks_wide blocks wide (row-major) into a
+ * malloc'd payload, storing its size in len
+ * CRE: parameters cannot be NULL
+ */
+extern unsigned char *entropy_encode(UArray_T codewords, unsigned blocks_wide,
+                                     size_t *len);
+
+/*
+ * Decodes a payload of len bytes made by entropy_encode back into codewords,
+ * which must have as many elements as the coded tile
+ * CRE: parameters cannot be NULL, payload must be well-formed
+ */
+extern UArray_T entropy_decode(const unsigned char *bytes, size_t len,
+                               unsigned blocks_wide, UArray_T codewords);
+
+#endif /* ENTROPY_INCLUDED */
@@ -18,6 +18,7 @@
 #include "a2plain.h"
 #include "assert.h"
 #include "chroma_bit.h"
+#include "codeword_io.h"
 #include "compress40.h"
 #include "imagemethods.h"
 #include "luma_bit.h"
@@ -208,6 +209,48 @@ RGB_px get_rgb_pixel(Pnm_rgb pnm, float denom)
 
         return pixel;
 }
+
+/*
+ * [Name]:       read_blocks
+ * [Parameters]: 2 UArrays (rgb_blocks, indices of the blocks to read), 1
+ *               Pnm_ppm (image)
+ * [Return]:     rgb_blocks filled with the RGB values of the chosen blocks
+ * [Purpose]:    Like read, but copies only the chosen 2x2 blocks, for
+ *               clients that compress part of an image
+ *               Note: image must have been scaled with scale_ppm already;
+ *                     a trailing odd row or column is never read
+ * [Errors]:     CRE if any parameter is NULL, the UArrays differ in length,
+ *                   image is not scaled or a block is outside the image
+ */
+UArray_T read_blocks(UArray_T rgb_blocks, Pnm_ppm image, UArray_T indices)
+{
+        assert(rgb_blocks != NULL && image != NULL && indices != NULL);
+        assert(UArray_length(rgb_blocks) == UArray_length(indices));
+        assert(image->denominator == RGB_MAX);
+
+        const struct A2Methods_T m = *(image->methods);
+        unsigned blocks_wide = image->width  / 2;
+        unsigned blocks_high = image->height / 2;
+
+        for (int i = 0; i < UArray_length(indices); i++) {
+                unsigned  index = *(unsigned *)UArray_at(indices, i);
+                int       col   = 2 * (index % blocks_wide);
+                int       row   = 2 * (index / blocks_wide);
+                RGB_block block = UArray_at(rgb_blocks, i);
+                assert(index / blocks_wide < blocks_high);
+
+                block->topL = get_rgb_pixel(m.at(image->pixels, col, row),
+                                            image->denominator);
+                block->topR = get_rgb_pixel(m.at(image->pixels, col + 1,
+                                                 row), image->denominator);
+                block->botL = get_rgb_pixel(m.at(image->pixels, col,
+                                                 row + 1), image->denominator);
+                block->botR = get_rgb_pixel(m.at(image->pixels, col + 1,
+                                                 row + 1), image->denominator);
+        }
+
+        return rgb_blocks;
+}
 /* -------------------------------------------- */
 
 /* -------------------------------------------- *
@@ -330,16 +373,8 @@ static void write(UArray_T codewords, unsigned width, unsigned height)
 {
         assert(codewords != NULL);
 
-        printf("COMP40 Compressed image format 2\n%u %u\n", width, height);
-
-        for (int i = 0; i < UArray_length(codewords); i++) {
-                uint32_t *codeword = UArray_at(codewords, i);
-
-                for (int j = 4; j > 0; j--) {
-                        char c = extract_char(*codeword, j - 1);
-                        putchar(c);
-                }
-        }
+        write_header   (stdout, width, height);
+        write_codewords(stdout, codewords);
 }
 /* ^------------------------------------------^ */
 
@@ -350,7 +385,8 @@ static void write(UArray_T codewords, unsigned width, unsigned height)
  * [Name]:       free_c
  * [Parameters]: 4 UArrays, 1 ppm
  * [Return]:     void
- * [Purpose]:    Frees the given UArrays and ppm
+ * [Purpose]:    Frees the given UArrays and ppm (unless ppm is NULL, when
+ *               the caller still needs the image)
  * [Errors]:     None
  */
 static void free_c(UArray_T rgb_blocks, UArray_T xyz_blocks, UArray_T bit_blocks,
@@ -360,7 +396,9 @@ static void free_c(UArray_T rgb_blocks, UArray_T xyz_blocks, UArray_T bit_blocks
         free_xyz_c      (xyz_blocks);
         free_bit_c      (bit_blocks);
         free_codewords_c(codewords);
-        Pnm_ppmfree     (&image);
+        if (image != NULL) {
+                Pnm_ppmfree(&image);
+        }
 }
 
 /*
@@ -438,4 +476,4 @@ static struct ImageMethods_T compress_struct = {
 
 /* The Payoff: Exported pointer to the struct */
 ImageMethods_T compress = &compress_struct;
-/* -------------------------------------------- */
\ No newline at end of file
+/* -------------------------------------------- */
\ No newline at end of file
@@ -33,7 +33,6 @@ typedef struct Pnm_ppm    *ppm;
 typedef A2Methods_UArray2 A2;
 
 /* -- GET PPM HELPER FUNCTIONS -- */
-ppm            get_ppm    (unsigned width, unsigned height, A2Methods_T m);
 struct Pnm_rgb get_pnm_rgb(RGB_px rgb);
 
 /* -- FREE HELPER FUNCTIONS -- */
@@ -174,46 +173,101 @@ static void write(UArray_T rgb_blocks, unsigned width, unsigned height)
 {
         assert(rgb_blocks != NULL);
 
-        A2Methods_T m = uarray2_methods_plain;
-        A2 pixels     = m->new(width, height, sizeof(struct Pnm_rgb));
-        ppm image     = get_ppm(width, height, m);
+        ppm image = new_ppm(width, height);
+        copy_blocks(rgb_blocks, width / 2, image, 0, 0);
 
-        int cell = 0;
-        for (unsigned row = 0; row < height; row += 2) {
-                for (unsigned col = 0; col < width; col += 2) {
-                        RGB_block block = UArray_at(rgb_blocks, cell);
+        Pnm_ppmwrite(stdout, image);
+        Pnm_ppmfree(&image);
+}
 
-                        Pnm_rgb buf = (Pnm_rgb)m->at(pixels, col, row);
-                               *buf = get_pnm_rgb(block->topL);
+/*
+ * [Name]:       copy_blocks
+ * [Parameters]: 1 UArray (rgb_blocks), 1 unsigned (width of rgb_blocks in
+ *               blocks), 1 Pnm_ppm (image), 2 ints (pixel position in image
+ *               of the top-left block)
+ * [Return]:     void
+ * [Purpose]:    Stores the pixels of decompressed rgb_blocks into image, with
+ *               the first block's top-left pixel at (x, y)
+ *               Note: Pixels that fall outside the image are skipped, so a
+ *                      region can start or end halfway through a block
+ *                     Different threads may fill disjoint parts of one image
+ * [Errors]:     CRE if rgb_blocks or image is NULL
+ */
+void copy_blocks(UArray_T rgb_blocks, unsigned blocks_wide, ppm image,
+                 int x, int y)
+{
+        assert(rgb_blocks != NULL && image != NULL);
 
-                                buf = (Pnm_rgb)m->at(pixels, col + 1, row);
-                               *buf = get_pnm_rgb(block->topR);
+        const struct A2Methods_T m = *(image->methods);
+        long width  = image->width;
+        long height = image->height;
 
-                                buf = (Pnm_rgb)m->at(pixels, col, row + 1);
-                               *buf = get_pnm_rgb(block->botL);
+        for (int i = 0; i < UArray_length(rgb_blocks); i++) {
+                RGB_block block = UArray_at(rgb_blocks, i);
+                RGB_px    px[4] = { block->topL, block->topR,
+                                    block->botL, block->botR };
+                long col = x + 2 * (long)(i % blocks_wide);
+                long row = y + 2 * (long)(i / blocks_wide);
+
+                for (int j = 0; j < 4; j++) {
+                        long c = col + j % 2;
+                        long r = row + j / 2;
+
+                        if (c >= 0 && c < width && r >= 0 && r < height) {
+                                Pnm_rgb buf = (Pnm_rgb)m.at(image->pixels,
+                                                            c, r);
+                                       *buf = get_pnm_rgb(px[j]);
+                        }
+                }
+        }
+}
 
-                                buf = (Pnm_rgb)m->at(pixels, col + 1, row + 1);
-                               *buf = get_pnm_rgb(block->botR);
+/*
+ * [Name]:       copy_blocks_at
+ * [Parameters]: 2 UArrays (rgb_blocks, indices of the blocks), 1 unsigned
+ *               (width of image in blocks), 1 Pnm_ppm (image)
+ * [Return]:     void
+ * [Purpose]:    Stores the pixels of each decompressed block at the place of
+ *               block indices[i] (in row-major order) in image, leaving the
+ *               other blocks of image untouched
+ * [Errors]:     CRE if any parameter is NULL or a block is outside image
+ */
+void copy_blocks_at(UArray_T rgb_blocks, UArray_T indices,
+                    unsigned blocks_wide, ppm image)
+{
+        assert(rgb_blocks != NULL && indices != NULL && image != NULL);
+
+        const struct A2Methods_T m = *(image->methods);
 
-                        cell++;
+        for (int i = 0; i < UArray_length(rgb_blocks); i++) {
+                RGB_block block = UArray_at(rgb_blocks, i);
+                RGB_px    px[4] = { block->topL, block->topR,
+                                    block->botL, block->botR };
+                unsigned  index = *(unsigned *)UArray_at(indices, i);
+                int       col   = 2 * (index % blocks_wide);
+                int       row   = 2 * (index / blocks_wide);
+                assert((unsigned)row + 1 < image->height);
+
+                for (int j = 0; j < 4; j++) {
+                        Pnm_rgb buf = (Pnm_rgb)m.at(image->pixels,
+                                                    col + j % 2,
+                                                    row + j / 2);
+                        *buf = get_pnm_rgb(px[j]);
                 }
         }
-
-        image->pixels = pixels;
-        Pnm_ppmwrite(stdout, image);
-        Pnm_ppmfree(&image);
 }
 
 /*
- * [Name]:       get_ppm
- * [Parameters]: 2 unsigned integers (width, height), 1 A2Methods_T
- * [Return]:     Pnm_ppm object with metadata initialized, but no image
+ * [Name]:       new_ppm
+ * [Parameters]: 2 unsigned integers (width, height)
+ * [Return]:     Pnm_ppm object with metadata initialized, and an unfilled
+ *               pixmap of the given dimensions
  * [Purpose]:    Initializes a ppm with the given metadata
- * [Errors]:     CRE if methods is NULL
+ * [Errors]:     None
  */
-ppm get_ppm(unsigned width, unsigned height, A2Methods_T m)
+ppm new_ppm(unsigned width, unsigned height)
 {
-        assert(m != NULL);
+        A2Methods_T m = uarray2_methods_plain;
 
         ppm pixmap;
         NEW(pixmap);
@@ -222,6 +276,7 @@ ppm get_ppm(unsigned width, unsigned height, A2Methods_T m)
         pixmap->height      = height;
         pixmap->denominator = RGB_MAX;
         pixmap->methods     = m;
+        pixmap->pixels      = m->new(width, height, sizeof(struct Pnm_rgb));
 
         return pixmap;
 }
@@ -343,4 +398,4 @@ static struct ImageMethods_T decompress_struct = {
 
 /* The Payoff: Exported pointer to the struct */
 ImageMethods_T decompress = &decompress_struct;
-/* -------------------------------------------- */
\ No newline at end of file
+/* -------------------------------------------- */
\ No newline at end of file
@@ -34,4 +34,46 @@ typedef struct ImageMethods_T {
 extern ImageMethods_T compress;
 extern ImageMethods_T decompress;
 
-#endif /* IMAGEMETHODS_INCLUDED */
\ No newline at end of file
+/* -- DECOMPRESS HELPERS, shared with the other decoders -- */
+/*
+ * Returns a new ppm of width x height pixels, with an unfilled pixmap
+ */
+extern Pnm_ppm new_ppm(unsigned width, unsigned height);
+
+/*
+ * Stores decompressed rgb_blocks (blocks_wide blocks per row) into image with
+ * the first block at pixel (x, y); pixels outside the image are skipped
+ * CRE: parameters cannot be NULL
+ */
+extern void copy_blocks(UArray_T rgb_blocks, unsigned blocks_wide,
+                        Pnm_ppm image, int x, int y);
+
+/*
+ * Stores each of the decompressed rgb_blocks at the place of the block
+ * numbered by the matching element (unsigned) of indices, counting in
+ * row-major order in an image blocks_wide blocks wide
+ * CRE: parameters cannot be NULL, blocks must lie within image
+ */
+extern void copy_blocks_at(UArray_T rgb_blocks, UArray_T indices,
+                           unsigned blocks_wide, Pnm_ppm image);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- COMPRESS HELPERS, shared with the other encoders -- */
+/*
+ * Scales the pixels of image to the range [0, RGB_MAX] in place, as the read
+ * method does
+ * CRE: image cannot be NULL
+ */
+extern void scale_ppm(Pnm_ppm image);
+
+/*
+ * Fills rgb_blocks with the blocks of image numbered by the matching
+ * element (unsigned) of indices, in row-major order over the image trimmed
+ * to even dimensions
+ * CRE: parameters cannot be NULL, image must already be scaled
+ */
+extern UArray_T read_blocks(UArray_T rgb_blocks, Pnm_ppm image,
+                            UArray_T indices);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+#endif /* IMAGEMETHODS_INCLUDED */
\ No newline at end of file
@@ -0,0 +1,416 @@
+/*
+ *      incremental.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the incremental compress function for 40image
+ *      - Incremental: Compresses a portable pixmap that is an edit of an
+ *                     image compressed before, recomputing only the blocks
+ *                     whose source pixels changed and copying every other
+ *                     codeword from the old COMP40 file
+ *      - Changes are found with a sidecar of row hashes, written next to a
+ *        COMP40 file with 40image -c --rows FILE:
+ *              ~ "COMP40 row hashes 2\n<width> <height> <span> <hash>\n",
+ *                where hash (16 hex digits) is of the COMP40 file's
+ *                codewords, so a sidecar left beside a regenerated file
+ *                is not trusted
+ *              ~ Then, for each block row, one 64-bit big-endian hash per
+ *                span of (up to) span blocks, left to right
+ *      - Invariants:
+ *              ~ Output is always format 2, and identical to what
+ *                compress40 would print for the same pixmap
+ *              ~ A span is recompressed if its hash differs from the
+ *                sidecar's (or there is no usable sidecar, or the old
+ *                file's codewords are not the ones the sidecar was written
+ *                for), so the work done in the pipeline scales with the
+ *                size of the edit
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "a2methods.h"
+#include "a2plain.h"
+#include "assert.h"
+#include "codeword_io.h"
+#include "compress40ext.h"
+#include "imagemethods.h"
+#include "mem.h"
+#include "uarray.h"
+
+/* -- struct Pnm_ppm is from pnm.h -- */
+typedef struct Pnm_ppm *ppm;
+
+/* Version of the sidecar layout, and the width of a hashed span in blocks */
+static const unsigned ROWS_VERSION = 2;
+static const unsigned HASH_SPAN    = 64;
+
+/* -- Hashes of every span of an image, in row-major order -- */
+struct row_hashes {
+        unsigned  width, height;      /* in pixels, even             */
+        unsigned  span;               /* in blocks                   */
+        unsigned  spans_wide;         /* spans per block row         */
+        uint64_t  codewords;          /* hash of the COMP40 file's   */
+        uint64_t *hashes;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- HASH HELPER FUNCTIONS -- */
+void     hash_image  (ppm image, struct row_hashes *rows);
+uint64_t hash_span   (ppm image, unsigned bx, unsigned by, unsigned bw);
+uint64_t hash_words  (UArray_T codewords);
+int      read_hashes (const char *path, struct row_hashes *rows);
+void     write_hashes(const char *path, const struct row_hashes *rows);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- REUSE HELPER FUNCTIONS -- */
+UArray_T old_codewords (const char *base, unsigned width, unsigned height);
+UArray_T changed_spans (const struct row_hashes *now,
+                        const struct row_hashes *then);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                   INCREMENTAL FUNCTION                       |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       compress40_incremental
+ * [Parameters]: 1 FILE* (input), 2 const char* (base: old COMP40 file, or
+ *               NULL; rows: sidecar to write for the output, or NULL)
+ * [Return]:     void
+ * [Purpose]:    Compresses the image on input stream to standard output in
+ *               format 2, reusing the codewords of base wherever the
+ *               sidecar of base (base + ".rows") shows that the source
+ *               pixels have not changed, then writes the image's own
+ *               sidecar to rows
+ *               Note: Without a usable base (different size, no sidecar,
+ *                      or a sidecar written for other codewords), every
+ *                      block is compressed; a base that cannot be opened
+ *                      at all is an error, checked before input is read
+ *                     Does not modify or close input
+ * [Errors]:     CRE if input is NULL, or base or rows cannot be opened
+ */
+void compress40_incremental(FILE *input, const char *base, const char *rows)
+{
+        assert(input != NULL);
+        if (base != NULL) {
+                FILE *fp = fopen(base, "rb");
+                assert(fp != NULL);
+                fclose(fp);
+        }
+
+        ppm image = Pnm_ppmread(input, uarray2_methods_plain);
+        scale_ppm(image);
+        image->width  -= image->width  % 2;
+        image->height -= image->height % 2;
+
+        unsigned len = (image->width / 2) * (image->height / 2);
+        struct row_hashes now;
+        hash_image(image, &now);
+
+        /* Reusable codewords and the spans that changed since they were
+         * made */
+        UArray_T codewords = NULL;
+        UArray_T indices   = NULL;
+        struct row_hashes then = { .hashes = NULL };
+        if (base != NULL) {
+                char *path = ALLOC(strlen(base) + sizeof(".rows"));
+                sprintf(path, "%s.rows", base);
+                if (read_hashes(path, &then) &&
+                    then.width == now.width && then.height == now.height &&
+                    then.span  == now.span) {
+                        codewords = old_codewords(base, now.width,
+                                                  now.height);
+                }
+                if (codewords != NULL &&
+                    hash_words(codewords) != then.codewords) {
+                        UArray_free(&codewords);
+                }
+                if (codewords != NULL) {
+                        indices = changed_spans(&now, &then);
+                }
+                FREE(path);
+        }
+
+        if (codewords == NULL) {
+                codewords = compress->new_blocks(len, sizeof(uint32_t));
+                codewords = compress_pixmap(image, codewords);
+        } else {
+                int      changed = UArray_length(indices);
+                UArray_T words   = compress->new_blocks(changed,
+                                                        sizeof(uint32_t));
+                words = compress_changed(image, indices, words);
+
+                for (int i = 0; i < changed; i++) {
+                        unsigned index = *(unsigned *)UArray_at(indices, i);
+                        *(uint32_t *)UArray_at(codewords, index) =
+                                *(uint32_t *)UArray_at(words, i);
+                }
+                UArray_free(&words);
+                UArray_free(&indices);
+        }
+        /* AFTER THIS POINT: Image has been compressed */
+
+        compress->write(codewords, image->width, image->height);
+        if (rows != NULL) {
+                now.codewords = hash_words(codewords);
+                write_hashes(rows, &now);
+        }
+
+        if (then.hashes != NULL) {
+                FREE(then.hashes);
+        }
+        FREE(now.hashes);
+        UArray_free(&codewords);
+        Pnm_ppmfree(&image);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                    HASH HELPER FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       hash_image
+ * [Parameters]: 1 Pnm_ppm (image, scaled and trimmed), 1 struct row_hashes*
+ *               (rows, filled)
+ * [Return]:     void
+ * [Purpose]:    Hashes every span of every block row of image
+ * [Errors]:     None
+ */
+void hash_image(ppm image, struct row_hashes *rows)
+{
+        unsigned blocks_wide = image->width  / 2;
+        unsigned blocks_high = image->height / 2;
+
+        rows->width      = image->width;
+        rows->height     = image->height;
+        rows->span       = HASH_SPAN;
+        rows->spans_wide = (blocks_wide + HASH_SPAN - 1) / HASH_SPAN;
+        rows->hashes     = ALLOC(((size_t)rows->spans_wide * blocks_high + 1)
+                                 * sizeof(uint64_t));
+
+        for (unsigned by = 0; by < blocks_high; by++) {
+                for (unsigned s = 0; s < rows->spans_wide; s++) {
+                        unsigned bx = s * HASH_SPAN;
+                        unsigned bw = blocks_wide - bx < HASH_SPAN ?
+                                      blocks_wide - bx : HASH_SPAN;
+                        rows->hashes[by * rows->spans_wide + s] =
+                                hash_span(image, bx, by, bw);
+                }
+        }
+}
+
+/*
+ * [Name]:       hash_span
+ * [Parameters]: 1 Pnm_ppm (image), 3 unsigned integers (block column and
+ *               row of the span, its width in blocks)
+ * [Return]:     64-bit FNV-1a hash of the span's pixels
+ * [Purpose]:    Fingerprints the 2 pixel rows of a span, one color byte at
+ *               a time (pixels are scaled, so each color fits in a byte)
+ * [Errors]:     None
+ */
+uint64_t hash_span(ppm image, unsigned bx, unsigned by, unsigned bw)
+{
+        const struct A2Methods_T m = *(image->methods);
+        uint64_t hash = 14695981039346656037ULL;
+
+        for (unsigned row = 2 * by; row < 2 * by + 2; row++) {
+                for (unsigned col = 2 * bx; col < 2 * (bx + bw); col++) {
+                        Pnm_rgb px = m.at(image->pixels, col, row);
+                        unsigned colors[3] = { px->red, px->green,
+                                               px->blue };
+                        for (int c = 0; c < 3; c++) {
+                                hash = (hash ^ (colors[c] & 0xff)) *
+                                       1099511628211ULL;
+                        }
+                }
+        }
+
+        return hash;
+}
+
+/*
+ * [Name]:       hash_words
+ * [Parameters]: 1 UArray (codewords)
+ * [Return]:     64-bit FNV-1a hash of the codewords
+ * [Purpose]:    Fingerprints the codewords of a COMP40 file, one byte at a
+ *               time, most significant first
+ * [Errors]:     None
+ */
+uint64_t hash_words(UArray_T codewords)
+{
+        uint64_t hash = 14695981039346656037ULL;
+        int      len  = UArray_length(codewords);
+
+        for (int i = 0; i < len; i++) {
+                uint32_t word = *(uint32_t *)UArray_at(codewords, i);
+                for (int b = 24; b >= 0; b -= 8) {
+                        hash = (hash ^ ((word >> b) & 0xff)) *
+                               1099511628211ULL;
+                }
+        }
+
+        return hash;
+}
+
+/*
+ * [Name]:       read_hashes
+ * [Parameters]: 1 const char* (path of a sidecar), 1 struct row_hashes*
+ *               (rows, filled)
+ * [Return]:     1 if the sidecar was read, 0 if it is missing or malformed
+ * [Purpose]:    Loads the row hashes of an earlier compression
+ * [Errors]:     None (a bad sidecar only means nothing is reused)
+ */
+int read_hashes(const char *path, struct row_hashes *rows)
+{
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+                return 0;
+        }
+
+        unsigned version;
+        int ok = fscanf(fp, "COMP40 row hashes %u\n%u %u %u %" SCNx64,
+                        &version, &rows->width, &rows->height, &rows->span,
+                        &rows->codewords) == 5 &&
+                 version == ROWS_VERSION && rows->span > 0 &&
+                 getc(fp) == '\n';
+
+        if (ok) {
+                unsigned blocks_wide = rows->width / 2;
+                size_t   count       = 0;
+                rows->spans_wide = (blocks_wide + rows->span - 1) / rows->span;
+                count            = (size_t)rows->spans_wide *
+                                   (rows->height / 2);
+                rows->hashes     = ALLOC((count + 1) * sizeof(uint64_t));
+
+                for (size_t i = 0; ok && i < count; i++) {
+                        unsigned char bytes[8];
+                        ok = fread(bytes, 1, 8, fp) == 8;
+
+                        rows->hashes[i] = 0;
+                        for (int b = 0; b < 8; b++) {
+                                rows->hashes[i] = (rows->hashes[i] << 8) |
+                                                  bytes[b];
+                        }
+                }
+                if (!ok) {
+                        FREE(rows->hashes);
+                }
+        }
+
+        fclose(fp);
+        return ok;
+}
+
+/*
+ * [Name]:       write_hashes
+ * [Parameters]: 1 const char* (path of the sidecar), 1 const struct
+ *               row_hashes*
+ * [Return]:     void
+ * [Purpose]:    Saves the row hashes of the image just compressed, for the
+ *               next incremental compression
+ * [Errors]:     CRE if the sidecar cannot be written
+ */
+void write_hashes(const char *path, const struct row_hashes *rows)
+{
+        FILE *fp = fopen(path, "wb");
+        assert(fp != NULL);
+
+        fprintf(fp, "COMP40 row hashes %u\n%u %u %u %016" PRIx64 "\n",
+                ROWS_VERSION, rows->width, rows->height, rows->span,
+                rows->codewords);
+
+        size_t count = (size_t)rows->spans_wide * (rows->height / 2);
+        for (size_t i = 0; i < count; i++) {
+                unsigned char bytes[8];
+                for (int b = 0; b < 8; b++) {
+                        bytes[b] = rows->hashes[i] >> (56 - 8 * b);
+                }
+                fwrite(bytes, 1, 8, fp);
+        }
+
+        int err = fclose(fp);
+        assert(err == 0);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                    REUSE HELPER FUNCTIONS                    |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       old_codewords
+ * [Parameters]: 1 const char* (base: path of the old COMP40 file), 2
+ *               unsigned integers (width, height of the new image)
+ * [Return]:     new UArray with all codewords of base, or NULL if base
+ *               has other dimensions
+ * [Purpose]:    Fetches the codewords that unchanged blocks copy verbatim
+ * [Errors]:     CRE if base cannot be opened or is malformed
+ */
+UArray_T old_codewords(const char *base, unsigned width, unsigned height)
+{
+        FILE *fp = fopen(base, "rb");
+        assert(fp != NULL);
+
+        Comp40_T      image  = Comp40_open(fp);
+        Comp40_header header = Comp40_info(image);
+        UArray_T      codewords = NULL;
+
+        if (header.width == width && header.height == height) {
+                unsigned bw = width  / 2;
+                unsigned bh = height / 2;
+                codewords = compress->new_blocks(bw * bh, sizeof(uint32_t));
+                codewords = Comp40_rect(image, 0, 0, bw, bh, codewords);
+        }
+
+        Comp40_close(&image);
+        fclose(fp);
+
+        return codewords;
+}
+
+/*
+ * [Name]:       changed_spans
+ * [Parameters]: 2 const struct row_hashes* (now, then: same dimensions)
+ * [Return]:     new UArray of the indices (unsigned, row-major) of every
+ *               block in a span whose hash changed
+ * [Purpose]:    Lists the blocks that have to be recompressed
+ * [Errors]:     None
+ */
+UArray_T changed_spans(const struct row_hashes *now,
+                       const struct row_hashes *then)
+{
+        unsigned blocks_wide = now->width  / 2;
+        unsigned blocks_high = now->height / 2;
+        unsigned spans       = now->spans_wide * blocks_high;
+
+        /* Counting first, so that indices is allocated once */
+        int count = 0;
+        for (unsigned i = 0; i < spans; i++) {
+                if (now->hashes[i] != then->hashes[i]) {
+                        unsigned bx = (i % now->spans_wide) * now->span;
+                        count += blocks_wide - bx < now->span ?
+                                 blocks_wide - bx : now->span;
+                }
+        }
+
+        UArray_T indices = UArray_new(count, sizeof(unsigned));
+        int      j       = 0;
+        for (unsigned i = 0; i < spans; i++) {
+                if (now->hashes[i] == then->hashes[i]) {
+                        continue;
+                }
+
+                unsigned by  = i / now->spans_wide;
+                unsigned bx  = (i % now->spans_wide) * now->span;
+                unsigned end = blocks_wide - bx < now->span ?
+                               blocks_wide : bx + now->span;
+                for (; bx < end; bx++) {
+                        *(unsigned *)UArray_at(indices, j++) =
+                                by * blocks_wide + bx;
+                }
+        }
+
+        return indices;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
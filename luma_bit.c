@@ -46,10 +46,6 @@ XYZ_block inverse_dct(XYZ_block xyz, cosine luma_cosine);
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
 /* -- QUANTIZATION HELPER FUNCTIONS -- */
-unsigned quantize_a  (float value, int bitsize);
-int      quantize_bcd(float value, int bitsize);
-float    scale_a     (float a, int bitsize);
-float    scale_bcd   (float value, int bitsize);
 float    fit_range   (float value, float max, float min);
 uint64_t get_max     (int bitsize);
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -115,6 +111,24 @@ cosine dct(XYZ_block xyz)
         return luma_cosine;
 }
 
+/*
+ * [Name]:       luma_dct
+ * [Parameters]: 1 XYZ_block, 4 float* (a, b, c, d: set to the coefficients)
+ * [Return]:     void
+ * [Purpose]:    Exposes the unquantized DCT of a block, so that a parameter
+ *               sweep can quantize it at many field widths
+ * [Errors]:     CRE if any pixel/the block is NULL or has not been malloc'd
+ */
+void luma_dct(XYZ_block xyz, float *a, float *b, float *c, float *d)
+{
+        cosine luma_cosine = dct(xyz);
+
+        *a = luma_cosine.a;
+        *b = luma_cosine.b;
+        *c = luma_cosine.c;
+        *d = luma_cosine.d;
+}
+
 /*
  * [Name]:       quantize_a
  * [Parameters]: 1 float (a), 1 int (size of bitfield that a codes to)
@@ -181,6 +195,35 @@ XYZ_block bit_to_luma(bit_block bit, XYZ_block xyz)
         return inverse_dct(xyz, luma_cosine);
 }
 
+/*
+ * [Name]:       bit_to_avg_luma
+ * [Parameters]: 1 unsigned scaled int (a)
+ * [Return]:     average luma of the block, in floating point
+ * [Purpose]:    Converts only the a (DC) coefficient back to XYZ space, which
+ *               is the mean luma of the 2x2 block; used by preview decoding
+ *               Note: Range of return value is [A_MIN, A_MAX]
+ * [Errors]:     None
+ */
+float bit_to_avg_luma(unsigned a)
+{
+        return scale_a(a, A_WIDTH);
+}
+
+/*
+ * [Name]:       bit_to_bcd
+ * [Parameters]: 1 signed scaled int (b, c or d), 1 int (width of the field
+ *               in bits)
+ * [Return]:     the coefficient in floating point
+ * [Purpose]:    Converts one AC coefficient back to DCT space; used by
+ *               statistics that read codewords without decoding them
+ *               Note: Range of return value is [BCD_MIN, BCD_MAX]
+ * [Errors]:     None
+ */
+float bit_to_bcd(int value, int bitsize)
+{
+        return scale_bcd(value, bitsize);
+}
+
 /*
  * [Name]:       scale_a
  * [Parameters]: 1 unsigned scaled int (a), 1 int (width of a in bits)
@@ -248,6 +291,50 @@ XYZ_block inverse_dct(XYZ_block xyz, cosine luma_cosine)
 }
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
+/*---------------------------------------------------------------
+ |                   TONE CONVERSION FUNCTIONS                  |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       adjust_a
+ * [Parameters]: 1 unsigned scaled int (a), 2 floats (contrast, brightness)
+ * [Return]:     quantized a of the block after the luma map
+ *               Y -> contrast * (Y - 0.5) + 0.5 + brightness
+ * [Purpose]:    a is the block's mean luma, so the map applies to it as is
+ *               Note: Clamps to [A_MIN, A_MAX] like quantize_a, but rounds
+ *                     to the nearest step, so contrast 1 and brightness 0
+ *                     leave a unchanged
+ * [Errors]:     None
+ */
+unsigned adjust_a(unsigned a, float contrast, float brightness)
+{
+        float value = scale_a(a, A_WIDTH);
+        value = contrast * (value - 0.5) + 0.5 + brightness;
+        value = fit_range(value, A_MAX, A_MIN);
+
+        return roundf(value * (get_max(A_WIDTH) / A_MAX));
+}
+
+/*
+ * [Name]:       adjust_bcd
+ * [Parameters]: 1 signed scaled int (b, c or d), 1 int (width of the field
+ *               in bits), 1 float (contrast)
+ * [Return]:     quantized value of the coefficient after the luma map of
+ *               adjust_a
+ * [Purpose]:    b, c and d are differences of lumas, so the map only scales
+ *               them by contrast
+ *               Note: Clamps to [BCD_MIN, BCD_MAX] like quantize_bcd, and
+ *                     rounds like adjust_a
+ * [Errors]:     None
+ */
+int adjust_bcd(int value, int bitsize, float contrast)
+{
+        float scaled = scale_bcd(value, bitsize) * contrast;
+        scaled = fit_range(scaled, BCD_MAX, BCD_MIN);
+
+        return roundf(scaled * (get_max(bitsize - 1) / BCD_MAX));
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
 /*---------------------------------------------------------------
  |                 QUANTIZATION HELPER FUNCTIONS                |
  *--------------------------------------------------------------*/
@@ -26,6 +26,46 @@ extern bit_block luma_to_bit(XYZ_block xyz, bit_block bit);
  * CRE: parameters cannot be NULL
  */
 extern XYZ_block bit_to_luma(bit_block bit, XYZ_block xyz);
+
+/*
+ * Returns the average luma of a block from its quantized a coefficient alone,
+ * without running the inverse DCT
+ */
+extern float bit_to_avg_luma(unsigned a);
+
+/*
+ * Returns a quantized b, c or d coefficient (coded in bitsize bits) in
+ * floating point, without running the inverse DCT
+ */
+extern float bit_to_bcd(int value, int bitsize);
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
-#endif /* LUMABIT_INCLUDED */
\ No newline at end of file
+/* -- TONE FUNCTIONS -- */
+/*
+ * Return the quantized a (or b, c or d, coded in bitsize bits) of a block
+ * after its lumas are mapped by Y -> contrast * (Y - 0.5) + 0.5 + brightness,
+ * clamped to the range the quantizers allow
+ */
+extern unsigned adjust_a  (unsigned a, float contrast, float brightness);
+extern int      adjust_bcd(int value, int bitsize, float contrast);
+/* ^^^^^^^^^^^^^^^^^^ */
+
+/* -- LAYOUT FUNCTIONS -- */
+/*
+ * Stores the DCT coefficients of the lumas of xyz in a, b, c and d, before
+ * quantization
+ * CRE: xyz cannot be NULL
+ */
+extern void luma_dct(XYZ_block xyz, float *a, float *b, float *c, float *d);
+
+/*
+ * Quantize a (or b, c or d) into a field of bitsize bits, and back; the
+ * codec uses them with A_WIDTH (and B_WIDTH, C_WIDTH, D_WIDTH)
+ */
+extern unsigned quantize_a  (float value, int bitsize);
+extern int      quantize_bcd(float value, int bitsize);
+extern float    scale_a     (float a, int bitsize);
+extern float    scale_bcd   (float value, int bitsize);
+/* ^^^^^^^^^^^^^^^^^^^^ */
+
+#endif /* LUMABIT_INCLUDED */
\ No newline at end of file
@@ -126,6 +126,32 @@ bit_block unpack(uint32_t codeword, bit_block bit)
         return bit;
 }
 
+/*
+ * [Name]:       unpack_dc
+ * [Parameters]: 1 uint32_t (codeword), 1 bit_block
+ * [Return]:     bit with a, Pb and Pr filled from codeword
+ * [Purpose]:    Unpacks only the fields that describe a block's average color
+ *               (a, Pb and Pr), skipping the cosine coefficients b, c and d
+ *               Note: Does not modify values in codeword or b/c/d in bit
+ * [Errors]:     CRE if block is NULL or has not been malloc'd
+ */
+bit_block unpack_dc(uint32_t codeword, bit_block bit)
+{
+        assert(bit != NULL);
+
+        unsigned lsb = 0;
+
+        bit->Pr = Bitpack_getu(codeword, PR_WIDTH, lsb);
+        lsb += PR_WIDTH;
+
+        bit->Pb = Bitpack_getu(codeword, PB_WIDTH, lsb);
+        lsb += PB_WIDTH + D_WIDTH + C_WIDTH + B_WIDTH;
+
+        bit->a = Bitpack_getu(codeword, A_WIDTH, lsb);
+
+        return bit;
+}
+
 /*
  * [Name]:       store_char
  * [Parameters]: 1 char (c), 1 uint32_t (codeword), 1 int (byte index)
@@ -141,4 +167,4 @@ uint32_t store_char(char c, uint32_t codeword, int index)
         return Bitpack_newu(codeword, BITS_IN_BYTE * sizeof(char),
                             index * BITS_IN_BYTE * sizeof(char), char_bit);
 }
-/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
\ No newline at end of file
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
\ No newline at end of file
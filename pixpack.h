@@ -28,6 +28,13 @@ extern uint32_t pack(bit_block bit);
  * CRE: parameters cannot be NULL
  */
 extern bit_block unpack(uint32_t codeword, bit_block bit);
+
+/*
+ * Unpacks only the a, Pb and Pr fields of a codeword into bit, leaving
+ * b, c and d untouched
+ * CRE: parameters cannot be NULL
+ */
+extern bit_block unpack_dc(uint32_t codeword, bit_block bit);
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
 /* -- BYTE-ACCESS FUNCTIONS -- */
@@ -44,4 +51,4 @@ extern char extract_char(uint32_t codeword, int index);
 extern uint32_t store_char(char c, uint32_t codeword, int index);
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
-#endif /* PIXPACK_INCLUDED */
\ No newline at end of file
+#endif /* PIXPACK_INCLUDED */
\ No newline at end of file
@@ -1,166 +1,973 @@
+/*
+ *      ppmdiff.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Program that prints the RMS difference E of two portable pixmaps,
+ *        with every sample scaled to [0, 1] by its image's maxval:
+ *              E = sqrt(sum of squared sample differences / (3 * w * h))
+ *        over the w x h pixels the two images share
+ *      - Usage: ppmdiff [--all] [--heatmap FILE [--tile N]] file1 file2
+ *        (at most one file may be "-", for standard input); images whose
+ *        widths or heights differ by more than 1 print "1.0" and fail
+ *              ~ --all also prints the RMS difference of each channel, the
+ *                PSNR (-20 log10 E, in dB) and the mean SSIM of the lumas
+ *                over 8x8 windows placed every 4 pixels
+ *              ~ --heatmap writes the RMS difference of every N x N tile
+ *                (16 by default) as a PGM image, 255 being a difference of 1
+ *      - Engine:
+ *              ~ Regular files are mapped into memory and parsed in place;
+ *                standard input is read whole
+ *              ~ Bands of rows are shared out to one thread per processor,
+ *                and every metric is gathered in the same pass over a band;
+ *                bands are whole tiles, so a tile belongs to one thread
+ *              ~ Raw 8-bit images with equal maxvals sum exact integer
+ *                squared differences, VECTOR_BYTES samples at a time in
+ *                32-bit vector lanes flushed to 64-bit totals; any other
+ *                pair sums scaled differences in double precision
+ *              ~ SSIM windows are made of 2x2 cells of 4x4 pixels, so each
+ *                pixel's luma is read once however much the windows overlap
+ *      - Invariants:
+ *              ~ Inputs are never modified
+ *              ~ Rows are compared at their own strides, so images of
+ *                different widths stay aligned
+ */
+
+#define _GNU_SOURCE
+
 #include <math.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <pnmrdr.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "assert.h"
-#include "except.h"
+#include "mem.h"
+
+static const char *STDIN = "-";
+
+/* Samples handled per vector operation; three vectors cover 8 pixels */
+#define VECTOR_BYTES 8
+typedef uint8_t  bytes_v __attribute__((vector_size(VECTOR_BYTES)));
+typedef uint32_t sums_v  __attribute__((vector_size(VECTOR_BYTES * 4)));
+
+/* Rows handed to a thread at a time (rounded up to whole tiles) */
+static const unsigned ROW_CHUNK = 64;
+
+/* SSIM: side of a cell (a window is 2x2 cells) and stabilizing constants */
+#define SSIM_CELL 4
+static const double SSIM_C1 = 0.01 * 0.01;
+static const double SSIM_C2 = 0.03 * 0.03;
+
+static const unsigned DEFAULT_HEAT_TILE = 16;
+
+/* -- A portable pixmap, parsed in place -- */
+struct pixmap {
+        unsigned             width, height, maxval;
+        const unsigned char *raster;     /* raw (P6) samples, row-major    */
+        unsigned             sample_bytes;   /* 1, or 2 (maxval > 255)     */
+        uint16_t            *plain;      /* plain (P3) samples, converted  */
+        void                *map;        /* mapped file, or NULL           */
+        size_t               map_len;
+        unsigned char       *copy;       /* standard input, read whole     */
+};
+
+/* -- Sums over some pixels of the two lumas (x, y), for SSIM -- */
+struct moments {
+        double   x, y, xx, yy, xy;
+        unsigned n;
+};
 
-const char *STDIN = "-";
+/* -- Shared state of the threads comparing two pixmaps -- */
+struct diff_job {
+        const struct pixmap *pix1, *pix2;
+        unsigned             width, height;  /* shared pixels              */
+        unsigned             band;           /* rows handed out at a time  */
+        unsigned             next;           /* next row to hand out       */
+        int                  fast;           /* both raw 8-bit, same maxval */
+        double               sums[3];        /* per channel, [0, 1] units  */
 
-typedef Pnmrdr_T Pnm;
-typedef Pnmrdr_mapdata Pnmdata;
+        int                  ssim;           /* nonzero: gather SSIM       */
+        double               ssim_sum;
+        unsigned long        windows;
 
-/* Error-Check Functions */
-void usage();
+        unsigned             tile;           /* heatmap tile side, or 0    */
+        unsigned             tiles_wide, tiles_high;
+        double              *tile_sums;      /* per tile, [0, 1] units     */
 
-/* Process-File Functions */
-Pnm  process_file(FILE* fp, char* filename);
-Pnm  open_file(FILE* stream);
-void close_files(FILE* fp1, FILE* fp2);
+        pthread_mutex_t      lock;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
-/* Comparison Functions */
-void compare(FILE* fp1, FILE* fp2, Pnm ppm1, Pnm ppm2);
-void compare_dimensions(FILE* fp1, FILE* fp2, Pnm ppm1, Pnm ppm2);
-void compute_E(Pnm ppm1, Pnm ppm2);
-void print_E(float E);
+/* -- INPUT FUNCTIONS -- */
+void         usage        (void);
+void         open_pixmap  (const char *filename, struct pixmap *pix);
+void         parse_pixmap (const unsigned char *bytes, size_t len,
+                           struct pixmap *pix);
+unsigned     read_number  (const unsigned char *bytes, size_t len,
+                           size_t *pos);
+void         close_pixmap (struct pixmap *pix);
+/* ^^^^^^^^^^^^^^^^^^^^ */
 
-/* Free Functions */
-void free_ppm(Pnm ppm1, Pnm ppm2);
+/* -- COMPARISON FUNCTIONS -- */
+void         compare      (struct diff_job *job);
+void        *diff_rows    (void *cl);
+void         sum_row_fast (const unsigned char *row1,
+                           const unsigned char *row2, unsigned width,
+                           uint64_t sums[3]);
+void         sum_row      (const struct pixmap *pix1,
+                           const struct pixmap *pix2, unsigned row,
+                           unsigned x0, unsigned width, double sums[3]);
+double       sample       (const struct pixmap *pix, unsigned row,
+                           unsigned i);
+int          cpu_threads  (unsigned work);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
-int main (int argc, char* argv[])
+/* -- METRIC FUNCTIONS -- */
+void         ssim_band    (const struct diff_job *job, unsigned first,
+                           unsigned last, double *sum,
+                           unsigned long *windows);
+void         cell_row     (const struct diff_job *job, unsigned cell_y,
+                           struct moments *cells, unsigned num_cells);
+void         cell_row_fast(const struct diff_job *job, unsigned cell_y,
+                           struct moments *cells, unsigned num_cells);
+void         add_moments  (const struct diff_job *job, unsigned y0,
+                           unsigned y1, unsigned x0, unsigned x1,
+                           struct moments *m);
+void         row_lumas    (const struct pixmap *pix, unsigned row,
+                           unsigned x0, unsigned x1, double *lumas);
+double       window_ssim  (const struct moments *m);
+double       rms          (const struct diff_job *job, int channel);
+void         print_metrics(const struct diff_job *job);
+void         write_heatmap(const struct diff_job *job, const char *path);
+/* ^^^^^^^^^^^^^^^^^^^^^ */
+
+int main(int argc, char *argv[])
 {
-        char *filename1 = NULL;
-        char *filename2 = NULL;
-        FILE *fp1 = NULL;
-        FILE *fp2 = NULL;
-        
-        if (argc != 3) {
-                usage();
+        const char *files[2]   = { NULL, NULL };
+        const char *heatmap    = NULL;
+        int         all        = 0;
+        int         num_files  = 0;
+        unsigned    tile       = DEFAULT_HEAT_TILE;
+
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "--all") == 0) {
+                        all = 1;
+                } else if (strcmp(argv[i], "--heatmap") == 0 &&
+                           i + 1 < argc) {
+                        heatmap = argv[++i];
+                } else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+                        char *end;
+                        tile = strtoul(argv[++i], &end, 10);
+                        if (*end != '\0' || tile == 0) {
+                                usage();
+                        }
+                } else if (num_files < 2 && (argv[i][0] != '-' ||
+                                             strcmp(argv[i], STDIN) == 0)) {
+                        files[num_files++] = argv[i];
+                } else {
+                        usage();
+                }
         }
-        
-        if ((strcmp(argv[1], STDIN) == 0) && (strcmp(argv[2], STDIN) == 0)) {
+        if (num_files != 2 ||
+            (strcmp(files[0], STDIN) == 0 && strcmp(files[1], STDIN) == 0)) {
                 usage();
         }
-                
-        filename1 = argv[1];
-        filename2 = argv[2];
-        
-        Pnm ppm1 = process_file(fp1, filename1);
-        Pnm ppm2 = process_file(fp2, filename2);
-        
-        compare(fp1, fp2, ppm1, ppm2);
-
-        free_ppm(ppm1, ppm2);
-        close_files(fp1, fp2);
-        
+
+        struct pixmap pix1, pix2;
+        open_pixmap(files[0], &pix1);
+        open_pixmap(files[1], &pix2);
+
+        if (abs((int)pix1.width  - (int)pix2.width)  > 1 ||
+            abs((int)pix1.height - (int)pix2.height) > 1) {
+                printf("1.0\n");
+                close_pixmap(&pix1);
+                close_pixmap(&pix2);
+                exit(EXIT_FAILURE);
+        }
+
+        struct diff_job job;
+        memset(&job, 0, sizeof(job));
+        job.pix1 = &pix1;
+        job.pix2 = &pix2;
+        job.ssim = all;
+        job.tile = heatmap != NULL ? tile : 0;
+        compare(&job);
+
+        if (all) {
+                print_metrics(&job);
+        } else {
+                printf("%.4f\n", rms(&job, 3));
+        }
+        if (heatmap != NULL) {
+                write_heatmap(&job, heatmap);
+        }
+
+        if (job.tile_sums != NULL) {
+                FREE(job.tile_sums);
+        }
+        close_pixmap(&pix1);
+        close_pixmap(&pix2);
+
         return 0;
 }
 
-void free_ppm(Pnm ppm1, Pnm ppm2)
+
+/*---------------------------------------------------------------
+ |                       INPUT FUNCTIONS                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       usage
+ * [Parameters]: None
+ * [Return]:     void (exits)
+ * [Purpose]:    Explains the command line and fails
+ * [Errors]:     None
+ */
+void usage(void)
 {
-        Pnmrdr_free(&ppm1);
-        Pnmrdr_free(&ppm2);
+        fprintf(stderr, "Usage: ppmdiff [--all] [--heatmap FILE [--tile N]] "
+                "file1 file2\n"
+                "       (either file, but not both, may be -)\n");
+        exit(EXIT_FAILURE);
 }
 
-void close_files(FILE* fp1, FILE* fp2)
+/*
+ * [Name]:       open_pixmap
+ * [Parameters]: 1 const char* (filename, or "-"), 1 struct pixmap* (pix,
+ *               filled)
+ * [Return]:     void
+ * [Purpose]:    Maps a regular file into memory (or reads standard input, or
+ *               a file that cannot be mapped, whole) and parses it
+ * [Errors]:     CRE if the file cannot be opened or is not a pixmap
+ */
+void open_pixmap(const char *filename, struct pixmap *pix)
 {
-        if (fp1 != NULL) {
-                fclose(fp1);
+        FILE *fp = strcmp(filename, STDIN) == 0 ? stdin
+                                                : fopen(filename, "rb");
+        assert(fp != NULL);
+
+        pix->map  = NULL;
+        pix->copy = NULL;
+
+        struct stat info;
+        if (fp != stdin && fstat(fileno(fp), &info) == 0 &&
+            S_ISREG(info.st_mode) && info.st_size > 0) {
+                pix->map_len = info.st_size;
+                pix->map = mmap(NULL, pix->map_len, PROT_READ, MAP_PRIVATE,
+                                fileno(fp), 0);
+                if (pix->map == MAP_FAILED) {
+                        pix->map = NULL;
+                } else {
+                        madvise(pix->map, pix->map_len, MADV_SEQUENTIAL);
+                }
+        }
+
+        const unsigned char *bytes = pix->map;
+        size_t               len   = pix->map_len;
+        if (pix->map == NULL) {
+                size_t cap = 1 << 20, got;
+                len       = 0;
+                pix->copy = ALLOC(cap);
+                while ((got = fread(pix->copy + len, 1, cap - len, fp)) > 0) {
+                        len += got;
+                        if (len == cap) {
+                                cap *= 2;
+                                RESIZE(pix->copy, cap);
+                        }
+                }
+                bytes = pix->copy;
         }
 
-        if (fp2 != NULL) {
-                fclose(fp2);
+        if (fp != stdin) {
+                fclose(fp);
         }
+        parse_pixmap(bytes, len, pix);
 }
 
-void usage() 
+/*
+ * [Name]:       parse_pixmap
+ * [Parameters]: 1 const unsigned char* (bytes of a whole file), 1 size_t
+ *               (len), 1 struct pixmap* (pix, filled)
+ * [Return]:     void
+ * [Purpose]:    Reads the header; a raw (P6) raster is used where it lies,
+ *               and a plain (P3) one is converted to 16-bit samples
+ * [Errors]:     CRE if the bytes are not a complete pixmap
+ */
+void parse_pixmap(const unsigned char *bytes, size_t len, struct pixmap *pix)
 {
-        fprintf(stderr, "ERRRRROR\n");
-        exit(EXIT_FAILURE);
+        assert(len >= 2 && bytes[0] == 'P' &&
+               (bytes[1] == '6' || bytes[1] == '3'));
+
+        size_t pos = 2;
+        pix->width  = read_number(bytes, len, &pos);
+        pix->height = read_number(bytes, len, &pos);
+        pix->maxval = read_number(bytes, len, &pos);
+        assert(pix->maxval > 0 && pix->maxval < 65536);
+        pix->sample_bytes = pix->maxval > 255 ? 2 : 1;
+        pix->plain        = NULL;
+
+        size_t samples = (size_t)pix->width * pix->height * 3;
+        if (bytes[1] == '6') {
+                pos++;                /* single whitespace after maxval */
+                assert(pos + samples * pix->sample_bytes <= len);
+                pix->raster = bytes + pos;
+        } else {
+                pix->plain = ALLOC(samples * sizeof(uint16_t) + 1);
+                for (size_t i = 0; i < samples; i++) {
+                        pix->plain[i] = read_number(bytes, len, &pos);
+                }
+                pix->raster = NULL;
+        }
+}
+
+/*
+ * [Name]:       read_number
+ * [Parameters]: 1 const unsigned char* (bytes), 1 size_t (len), 1 size_t*
+ *               (pos: where to start, advanced past the number)
+ * [Return]:     the next decimal number, skipping whitespace and comments
+ * [Purpose]:    Header (and plain raster) tokenizer
+ * [Errors]:     CRE if there is no number before the end
+ */
+unsigned read_number(const unsigned char *bytes, size_t len, size_t *pos)
+{
+        size_t i = *pos;
+        while (i < len && (bytes[i] == ' ' || bytes[i] == '\t' ||
+                           bytes[i] == '\n' || bytes[i] == '\r' ||
+                           bytes[i] == '#')) {
+                if (bytes[i] == '#') {
+                        while (i < len && bytes[i] != '\n') {
+                                i++;
+                        }
+                } else {
+                        i++;
+                }
+        }
+        assert(i < len && bytes[i] >= '0' && bytes[i] <= '9');
+
+        unsigned value = 0;
+        while (i < len && bytes[i] >= '0' && bytes[i] <= '9') {
+                value = value * 10 + (bytes[i] - '0');
+                i++;
+        }
+        *pos = i;
+
+        return value;
+}
+
+/*
+ * [Name]:       close_pixmap
+ * [Parameters]: 1 struct pixmap*
+ * [Return]:     void
+ * [Purpose]:    Unmaps or frees everything open_pixmap made
+ * [Errors]:     None
+ */
+void close_pixmap(struct pixmap *pix)
+{
+        if (pix->map != NULL) {
+                munmap(pix->map, pix->map_len);
+        }
+        if (pix->copy != NULL) {
+                FREE(pix->copy);
+        }
+        if (pix->plain != NULL) {
+                FREE(pix->plain);
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+
+/*---------------------------------------------------------------
+ |                    COMPARISON FUNCTIONS                      |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       compare
+ * [Parameters]: 1 struct diff_job* (pixmaps, ssim and tile set by caller;
+ *               everything else filled)
+ * [Return]:     void
+ * [Purpose]:    Spreads bands of rows over threads, which gather every
+ *               requested metric in one pass
+ * [Errors]:     None
+ */
+void compare(struct diff_job *job)
+{
+        const struct pixmap *pix1 = job->pix1, *pix2 = job->pix2;
+
+        job->width  = pix1->width  < pix2->width  ? pix1->width  : pix2->width;
+        job->height = pix1->height < pix2->height ? pix1->height
+                                                  : pix2->height;
+        job->band   = ROW_CHUNK;
+        job->fast   = pix1->raster != NULL && pix2->raster != NULL &&
+                      pix1->sample_bytes == 1 && pix2->sample_bytes == 1 &&
+                      pix1->maxval == pix2->maxval;
+        if (job->tile != 0) {
+                job->band       = (ROW_CHUNK + job->tile - 1) / job->tile *
+                                  job->tile;
+                job->tiles_wide = (job->width  + job->tile - 1) / job->tile;
+                job->tiles_high = (job->height + job->tile - 1) / job->tile;
+                job->tile_sums  = CALLOC((size_t)job->tiles_wide *
+                                         job->tiles_high + 1,
+                                         sizeof(double));
+        }
+        if (job->width == 0 || job->height == 0) {
+                return;
+        }
+        pthread_mutex_init(&job->lock, NULL);
+
+        int        threads = cpu_threads((job->height + job->band - 1) /
+                                         job->band);
+        pthread_t *workers = ALLOC(threads * sizeof(pthread_t));
+        for (int i = 0; i < threads; i++) {
+                int err = pthread_create(&workers[i], NULL, diff_rows, job);
+                assert(err == 0);
+        }
+        for (int i = 0; i < threads; i++) {
+                pthread_join(workers[i], NULL);
+        }
+        FREE(workers);
+        pthread_mutex_destroy(&job->lock);
+
+        /* Too small for one window: the whole image is the window */
+        if (job->ssim && job->windows == 0) {
+                struct moments m;
+                memset(&m, 0, sizeof(m));
+                add_moments(job, 0, job->height, 0, job->width, &m);
+                job->ssim_sum = window_ssim(&m);
+                job->windows  = 1;
+        }
+}
+
+/*
+ * [Name]:       diff_rows
+ * [Parameters]: 1 void* (closure, the struct diff_job)
+ * [Return]:     NULL
+ * [Purpose]:    Thread body: repeatedly takes the next band of rows and sums
+ *               its squared differences per channel (and per tile), and its
+ *               windows' SSIM, then adds its totals to the job's
+ * [Errors]:     None
+ */
+void *diff_rows(void *cl)
+{
+        struct diff_job     *job  = cl;
+        const struct pixmap *pix1 = job->pix1;
+        const struct pixmap *pix2 = job->pix2;
+        int                  fast = job->fast;
+        double scale = (double)pix1->maxval * pix1->maxval;
+
+        /* Rows are cut into tile-wide segments only for the heatmap */
+        unsigned segment = job->tile != 0 ? job->tile : job->width;
+
+        uint64_t      exact[3] = { 0, 0, 0 };
+        double        sums[3]  = { 0, 0, 0 };
+        double        ssim_sum = 0;
+        unsigned long windows  = 0;
+
+        for (;;) {
+                pthread_mutex_lock(&job->lock);
+                unsigned first = job->next;
+                job->next += job->band;
+                pthread_mutex_unlock(&job->lock);
+
+                if (first >= job->height) {
+                        break;
+                }
+
+                unsigned last = first + job->band < job->height ?
+                                first + job->band : job->height;
+                for (unsigned row = first; row < last; row++) {
+                        for (unsigned x = 0; x < job->width; x += segment) {
+                                unsigned n = job->width - x < segment ?
+                                             job->width - x : segment;
+                                double   part;
+
+                                if (fast) {
+                                        uint64_t seg[3] = { 0, 0, 0 };
+                                        sum_row_fast(pix1->raster + 3 *
+                                                ((size_t)row * pix1->width + x),
+                                                pix2->raster + 3 *
+                                                ((size_t)row * pix2->width + x),
+                                                n, seg);
+                                        for (int c = 0; c < 3; c++) {
+                                                exact[c] += seg[c];
+                                        }
+                                        part = (seg[0] + seg[1] + seg[2]) /
+                                               scale;
+                                } else {
+                                        double seg[3] = { 0, 0, 0 };
+                                        sum_row(pix1, pix2, row, x, n, seg);
+                                        for (int c = 0; c < 3; c++) {
+                                                sums[c] += seg[c];
+                                        }
+                                        part = seg[0] + seg[1] + seg[2];
+                                }
+
+                                if (job->tile != 0) {
+                                        job->tile_sums[row / job->tile *
+                                                       job->tiles_wide +
+                                                       x / job->tile] += part;
+                                }
+                        }
+                }
+
+                if (job->ssim) {
+                        ssim_band(job, first, last, &ssim_sum, &windows);
+                }
+        }
+
+        if (fast) {
+                for (int c = 0; c < 3; c++) {
+                        sums[c] = exact[c] / scale;
+                }
+        }
+
+        pthread_mutex_lock(&job->lock);
+        for (int c = 0; c < 3; c++) {
+                job->sums[c] += sums[c];
+        }
+        job->ssim_sum += ssim_sum;
+        job->windows  += windows;
+        pthread_mutex_unlock(&job->lock);
+
+        return NULL;
+}
+
+/*
+ * [Name]:       sum_row_fast
+ * [Parameters]: 2 const unsigned char* (row1, row2: raw 8-bit rows), 1
+ *               unsigned (width, in pixels), 1 uint64_t array (sums per
+ *               channel, added to)
+ * [Return]:     void
+ * [Purpose]:    Sums exact squared differences of 8 pixels (three vectors of
+ *               samples) at a time; vector k always starts on channel
+ *               (3 - k) % 3 of some pixel, so its lanes map to fixed
+ *               channels. Leftover pixels are summed one at a time
+ * [Errors]:     None
+ */
+void sum_row_fast(const unsigned char *row1, const unsigned char *row2,
+                  unsigned width, uint64_t sums[3])
+{
+        sums_v   acc[3] = { { 0 }, { 0 }, { 0 } };
+        unsigned x      = 0;
+
+        /* Each lane gains at most 255^2 per group: 2^16 groups fit 32 bits */
+        for (unsigned groups = 0; x + VECTOR_BYTES <= width; x += 8) {
+                for (int k = 0; k < 3; k++) {
+                        bytes_v b1, b2;
+                        memcpy(&b1, row1 + 3 * x + k * VECTOR_BYTES,
+                               VECTOR_BYTES);
+                        memcpy(&b2, row2 + 3 * x + k * VECTOR_BYTES,
+                               VECTOR_BYTES);
+                        sums_v d = __builtin_convertvector(b1, sums_v) -
+                                   __builtin_convertvector(b2, sums_v);
+                        acc[k] += d * d;
+                }
+                if (++groups == 1 << 16 || x + 16 > width) {
+                        for (int k = 0; k < 3; k++) {
+                                for (int lane = 0; lane < VECTOR_BYTES;
+                                     lane++) {
+                                        sums[(k * VECTOR_BYTES + lane) % 3]
+                                                += acc[k][lane];
+                                        acc[k][lane] = 0;
+                                }
+                        }
+                        groups = 0;
+                }
+        }
+
+        for (unsigned i = 3 * x; i < 3 * width; i++) {
+                int d = (int)row1[i] - (int)row2[i];
+                sums[i % 3] += d * d;
+        }
 }
 
-Pnm process_file(FILE *fp, char* filename)
+/*
+ * [Name]:       sum_row
+ * [Parameters]: 2 const struct pixmap* (pix1, pix2), 3 unsigned integers
+ *               (row, x0 and width of the segment, in pixels), 1 double
+ *               array (sums per channel, added to)
+ * [Return]:     void
+ * [Purpose]:    Sums squared differences of scaled samples for any pair of
+ *               pixmaps (plain, 16-bit or of different maxvals)
+ * [Errors]:     None
+ */
+void sum_row(const struct pixmap *pix1, const struct pixmap *pix2,
+             unsigned row, unsigned x0, unsigned width, double sums[3])
 {
-        if (strcmp(filename, STDIN) == 0) {
-                return open_file(stdin);
+        for (unsigned i = 3 * x0; i < 3 * (x0 + width); i++) {
+                double d = sample(pix1, row, i) - sample(pix2, row, i);
+                sums[i % 3] += d * d;
+        }
+}
+
+/*
+ * [Name]:       sample
+ * [Parameters]: 1 const struct pixmap*, 2 unsigned integers (row, index of
+ *               the sample in the row)
+ * [Return]:     the sample scaled to [0, 1]
+ * [Purpose]:    Reads a sample of any supported raster
+ * [Errors]:     None
+ */
+double sample(const struct pixmap *pix, unsigned row, unsigned i)
+{
+        size_t   at = (size_t)row * pix->width * 3 + i;
+        unsigned value;
+
+        if (pix->plain != NULL) {
+                value = pix->plain[at];
+        } else if (pix->sample_bytes == 2) {
+                value = pix->raster[2 * at] << 8 | pix->raster[2 * at + 1];
         } else {
-                fp = fopen(filename, "r");
-                assert(fp != NULL);
-                
-                Pnm ppm = open_file(fp);
-                
-                return ppm;
+                value = pix->raster[at];
         }
+
+        return (double)value / pix->maxval;
 }
 
-Pnm open_file(FILE* stream)
+/*
+ * [Name]:       cpu_threads
+ * [Parameters]: 1 unsigned (number of independent pieces of work)
+ * [Return]:     number of threads to run: one per online processor, but
+ *               never more than there is work, and at least 1
+ * [Purpose]:    Sizes the thread pool
+ * [Errors]:     None
+ */
+int cpu_threads(unsigned work)
 {
-        Pnm ppm = Pnmrdr_new(stream);
-        
-        Pnmdata ppmdata = Pnmrdr_data(ppm);
-        assert(ppmdata.type == Pnmrdr_rgb);
-        
-        return ppm;
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (cpus < 1) {
+                cpus = 1;
+        }
+        if ((unsigned long)cpus > work) {
+                cpus = work > 0 ? work : 1;
+        }
+
+        return cpus;
 }
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
-void compare(FILE* fp1, FILE* fp2, Pnm ppm1, Pnm ppm2)
+/*---------------------------------------------------------------
+ |                      METRIC FUNCTIONS                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       ssim_band
+ * [Parameters]: 1 const struct diff_job*, 2 unsigned integers (first and
+ *               last (exclusive) row of the band), 1 double* (sum of SSIM,
+ *               added to), 1 unsigned long* (windows, added to)
+ * [Return]:     void
+ * [Purpose]:    Scores the windows whose top cell row starts in the band; a
+ *               window also reads the cell row below, which may lie in the
+ *               next band
+ * [Errors]:     None
+ */
+void ssim_band(const struct diff_job *job, unsigned first, unsigned last,
+               double *sum, unsigned long *windows)
 {
-        compare_dimensions(fp1, fp2, ppm1, ppm2);
-        compute_E(ppm1, ppm2);
+        unsigned cells_wide = job->width  / SSIM_CELL;
+        unsigned cells_high = job->height / SSIM_CELL;
+        unsigned begin      = (first + SSIM_CELL - 1) / SSIM_CELL;
+        unsigned end        = (last  + SSIM_CELL - 1) / SSIM_CELL;
+
+        if (cells_wide < 2 || cells_high < 2) {
+                return;
+        }
+        if (end > cells_high - 1) {
+                end = cells_high - 1;
+        }
+        if (begin >= end) {
+                return;
+        }
+
+        struct moments *upper = ALLOC(cells_wide * sizeof(*upper));
+        struct moments *lower = ALLOC(cells_wide * sizeof(*lower));
+        cell_row(job, begin, upper, cells_wide);
+
+        for (unsigned cy = begin; cy < end; cy++) {
+                cell_row(job, cy + 1, lower, cells_wide);
+                for (unsigned cx = 0; cx + 1 < cells_wide; cx++) {
+                        const struct moments *cells[4] = {
+                                &upper[cx], &upper[cx + 1],
+                                &lower[cx], &lower[cx + 1]
+                        };
+                        struct moments window;
+                        memset(&window, 0, sizeof(window));
+                        for (int i = 0; i < 4; i++) {
+                                window.x  += cells[i]->x;
+                                window.y  += cells[i]->y;
+                                window.xx += cells[i]->xx;
+                                window.yy += cells[i]->yy;
+                                window.xy += cells[i]->xy;
+                                window.n  += cells[i]->n;
+                        }
+                        *sum += window_ssim(&window);
+                        (*windows)++;
+                }
+
+                struct moments *swap = upper;
+                upper = lower;
+                lower = swap;
+        }
+
+        FREE(upper);
+        FREE(lower);
 }
 
-void compare_dimensions(FILE* fp1, FILE* fp2, Pnm ppm1, Pnm ppm2)
+/*
+ * [Name]:       cell_row
+ * [Parameters]: 1 const struct diff_job*, 1 unsigned (cell_y: row of cells),
+ *               1 struct moments* (cells, filled), 1 unsigned (num_cells)
+ * [Return]:     void
+ * [Purpose]:    Gathers the moments of every SSIM_CELL-square cell of a row,
+ *               converting each pixel row to lumas once
+ * [Errors]:     None
+ */
+void cell_row(const struct diff_job *job, unsigned cell_y,
+              struct moments *cells, unsigned num_cells)
 {
-        Pnmdata ppmdata1 = Pnmrdr_data(ppm1);
-        Pnmdata ppmdata2 = Pnmrdr_data(ppm2);
-        
-        if (abs(ppmdata1.width  - ppmdata2.width)  > 1 ||
-            abs(ppmdata1.height - ppmdata2.height) > 1) {
-                printf("1.0\n");
-                free_ppm(ppm1, ppm2);
-                close_files(fp1, fp2);
-                usage();
+        if (job->fast) {
+                cell_row_fast(job, cell_y, cells, num_cells);
+                return;
+        }
+
+        unsigned width = num_cells * SSIM_CELL;
+        double  *lx    = ALLOC(2 * width * sizeof(double));
+        double  *ly    = lx + width;
+
+        memset(cells, 0, num_cells * sizeof(*cells));
+        for (unsigned y = cell_y * SSIM_CELL; y < (cell_y + 1) * SSIM_CELL;
+             y++) {
+                row_lumas(job->pix1, y, 0, width, lx);
+                row_lumas(job->pix2, y, 0, width, ly);
+                for (unsigned x = 0; x < width; x++) {
+                        struct moments *m = &cells[x / SSIM_CELL];
+                        m->x  += lx[x];
+                        m->y  += ly[x];
+                        m->xx += lx[x] * lx[x];
+                        m->yy += ly[x] * ly[x];
+                        m->xy += lx[x] * ly[x];
+                }
+        }
+        for (unsigned cx = 0; cx < num_cells; cx++) {
+                cells[cx].n = SSIM_CELL * SSIM_CELL;
+        }
+
+        FREE(lx);
+}
+
+/*
+ * [Name]:       cell_row_fast
+ * [Parameters]: same as cell_row (both pixmaps raw 8-bit, same maxval)
+ * [Return]:     void
+ * [Purpose]:    cell_row in exact integers: lumas are 1000 * maxval times the
+ *               true luma (weights 299, 587 and 114), summed per cell in 64
+ *               bits and scaled to [0, 1] once per cell
+ * [Errors]:     None
+ */
+void cell_row_fast(const struct diff_job *job, unsigned cell_y,
+                   struct moments *cells, unsigned num_cells)
+{
+        const struct pixmap *pix[2] = { job->pix1, job->pix2 };
+        double scale = 1.0 / (1000.0 * job->pix1->maxval);
+
+        for (unsigned cx = 0; cx < num_cells; cx++) {
+                int64_t x = 0, y = 0, xx = 0, yy = 0, xy = 0;
+
+                for (unsigned row = cell_y * SSIM_CELL;
+                     row < (cell_y + 1) * SSIM_CELL; row++) {
+                        const unsigned char *rgb[2];
+                        for (int k = 0; k < 2; k++) {
+                                rgb[k] = pix[k]->raster + 3 *
+                                         ((size_t)row * pix[k]->width +
+                                          cx * SSIM_CELL);
+                        }
+                        for (int i = 0; i < 3 * SSIM_CELL; i += 3) {
+                                int64_t lx = 299 * rgb[0][i] +
+                                             587 * rgb[0][i + 1] +
+                                             114 * rgb[0][i + 2];
+                                int64_t ly = 299 * rgb[1][i] +
+                                             587 * rgb[1][i + 1] +
+                                             114 * rgb[1][i + 2];
+                                x  += lx;
+                                y  += ly;
+                                xx += lx * lx;
+                                yy += ly * ly;
+                                xy += lx * ly;
+                        }
+                }
+
+                cells[cx].x  = x  * scale;
+                cells[cx].y  = y  * scale;
+                cells[cx].xx = xx * scale * scale;
+                cells[cx].yy = yy * scale * scale;
+                cells[cx].xy = xy * scale * scale;
+                cells[cx].n  = SSIM_CELL * SSIM_CELL;
         }
 }
 
-void compute_E(Pnm ppm1, Pnm ppm2)
+/*
+ * [Name]:       add_moments
+ * [Parameters]: 1 const struct diff_job*, 4 unsigned integers (y0, y1, x0,
+ *               x1: the pixels [x0, x1) x [y0, y1)), 1 struct moments* (m,
+ *               added to)
+ * [Return]:     void
+ * [Purpose]:    Sums both images' lumas, their squares and their product
+ *               over any rectangle
+ * [Errors]:     None
+ */
+void add_moments(const struct diff_job *job, unsigned y0, unsigned y1,
+                 unsigned x0, unsigned x1, struct moments *m)
 {
-        Pnmdata ppmdata1 = Pnmrdr_data(ppm1);
-        Pnmdata ppmdata2 = Pnmrdr_data(ppm2);
-        unsigned width  = ppmdata1.width;
-        unsigned height = ppmdata1.height;
-        float sum = 0.0;
-        float E;
+        double *lx = ALLOC(2 * (x1 - x0 + 1) * sizeof(double));
+        double *ly = lx + (x1 - x0 + 1);
 
-        if (width > ppmdata2.width) {
-                width = ppmdata2.width;
+        for (unsigned y = y0; y < y1; y++) {
+                row_lumas(job->pix1, y, x0, x1, lx);
+                row_lumas(job->pix2, y, x0, x1, ly);
+                for (unsigned i = 0; i < x1 - x0; i++) {
+                        m->x  += lx[i];
+                        m->y  += ly[i];
+                        m->xx += lx[i] * lx[i];
+                        m->yy += ly[i] * ly[i];
+                        m->xy += lx[i] * ly[i];
+                }
         }
+        m->n += (y1 - y0) * (x1 - x0);
+
+        FREE(lx);
+}
 
-        if (height > ppmdata2.height) {
-                height = ppmdata2.height;
+/*
+ * [Name]:       row_lumas
+ * [Parameters]: 1 const struct pixmap*, 3 unsigned integers (row, x0, x1),
+ *               1 double* (lumas: filled with x1 - x0 values)
+ * [Return]:     void
+ * [Purpose]:    Lumas in [0, 1] of the pixels [x0, x1) of a row, with the
+ *               compressor's RGB to Y weights; raw 8-bit rows are read
+ *               directly
+ * [Errors]:     None
+ */
+void row_lumas(const struct pixmap *pix, unsigned row, unsigned x0,
+               unsigned x1, double *lumas)
+{
+        if (pix->raster != NULL && pix->sample_bytes == 1) {
+                double               scale = 1.0 / pix->maxval;
+                const unsigned char *rgb   = pix->raster + 3 *
+                                             ((size_t)row * pix->width + x0);
+                for (unsigned i = 0; i < x1 - x0; i++, rgb += 3) {
+                        lumas[i] = (0.299 * rgb[0] + 0.587 * rgb[1] +
+                                    0.114 * rgb[2]) * scale;
+                }
+                return;
         }
-        
-        for (unsigned i = 0; i < width * height; i++) {
-                unsigned red1 = Pnmrdr_get(ppm1) / ppmdata1.denominator;
-                unsigned blue1 = Pnmrdr_get(ppm1) / ppmdata1.denominator;
-                unsigned green1 = Pnmrdr_get(ppm1) / ppmdata1.denominator;         
-                
-                unsigned red2 = Pnmrdr_get(ppm2) / ppmdata2.denominator;
-                unsigned blue2 = Pnmrdr_get(ppm2) / ppmdata2.denominator;
-                unsigned green2 = Pnmrdr_get(ppm2) / ppmdata2.denominator;     
 
-                sum += ((red1 - red2) * (red1 - red2));
-                sum += ((green1 - green2) * (green1 - green2));
-                sum += ((blue1 - blue2) * (blue1 - blue2));
+        for (unsigned x = x0; x < x1; x++) {
+                lumas[x - x0] = 0.299 * sample(pix, row, 3 * x) +
+                                0.587 * sample(pix, row, 3 * x + 1) +
+                                0.114 * sample(pix, row, 3 * x + 2);
         }
+}
+
+/*
+ * [Name]:       window_ssim
+ * [Parameters]: 1 const struct moments* (sums over a window)
+ * [Return]:     the window's structural similarity, at most 1
+ * [Purpose]:    SSIM = (2 mx my + C1)(2 sxy + C2) /
+ *                      ((mx^2 + my^2 + C1)(sx^2 + sy^2 + C2))
+ * [Errors]:     None
+ */
+double window_ssim(const struct moments *m)
+{
+        if (m->n == 0) {
+                return 1.0;
+        }
+
+        double mx  = m->x / m->n,  my  = m->y / m->n;
+        double sxx = m->xx / m->n - mx * mx;
+        double syy = m->yy / m->n - my * my;
+        double sxy = m->xy / m->n - mx * my;
 
-        E = sum / ((float)(3 * width * height));
-        E = sqrt(E);
-        print_E(E);
+        return ((2 * mx * my + SSIM_C1) * (2 * sxy + SSIM_C2)) /
+               ((mx * mx + my * my + SSIM_C1) * (sxx + syy + SSIM_C2));
 }
 
-void print_E(float E)
+/*
+ * [Name]:       rms
+ * [Parameters]: 1 const struct diff_job* (compared), 1 int (channel: 0, 1
+ *               or 2 for red, green or blue, 3 for all)
+ * [Return]:     RMS difference of the channel, in [0, 1]
+ * [Purpose]:    E (channel 3) and the per-channel errors
+ * [Errors]:     None
+ */
+double rms(const struct diff_job *job, int channel)
 {
-        printf("%.4f\n", E);
-}
\ No newline at end of file
+        double pixels = (double)job->width * job->height;
+
+        if (pixels == 0) {
+                return 0.0;
+        }
+        if (channel < 3) {
+                return sqrt(job->sums[channel] / pixels);
+        }
+
+        return sqrt((job->sums[0] + job->sums[1] + job->sums[2]) /
+                    (3.0 * pixels));
+}
+
+/*
+ * [Name]:       print_metrics
+ * [Parameters]: 1 const struct diff_job* (compared, with SSIM)
+ * [Return]:     void
+ * [Purpose]:    Prints every metric on standard output, one per line as
+ *               "name value"
+ * [Errors]:     None
+ */
+void print_metrics(const struct diff_job *job)
+{
+        double E = rms(job, 3);
+
+        printf("E %.4f\n", E);
+        printf("rms_red %.4f\n",   rms(job, 0));
+        printf("rms_green %.4f\n", rms(job, 1));
+        printf("rms_blue %.4f\n",  rms(job, 2));
+        if (E == 0) {
+                printf("psnr inf\n");
+        } else {
+                printf("psnr %.2f\n", -20 * log10(E));
+        }
+        printf("ssim %.4f\n", job->ssim_sum / job->windows);
+}
+
+/*
+ * [Name]:       write_heatmap
+ * [Parameters]: 1 const struct diff_job* (compared, with tiles), 1 const
+ *               char* (path of the PGM to write)
+ * [Return]:     void
+ * [Purpose]:    Writes one gray pixel per tile, its RMS difference scaled to
+ *               [0, 255]; edge tiles are averaged over their own pixels
+ * [Errors]:     CRE if the file cannot be written
+ */
+void write_heatmap(const struct diff_job *job, const char *path)
+{
+        FILE *fp = fopen(path, "wb");
+        assert(fp != NULL);
+
+        fprintf(fp, "P5\n%u %u\n255\n", job->tiles_wide, job->tiles_high);
+        for (unsigned ty = 0; ty < job->tiles_high; ty++) {
+                unsigned h = job->height - ty * job->tile < job->tile ?
+                             job->height - ty * job->tile : job->tile;
+                for (unsigned tx = 0; tx < job->tiles_wide; tx++) {
+                        unsigned w = job->width - tx * job->tile < job->tile ?
+                                     job->width - tx * job->tile : job->tile;
+                        double sum = job->tile_sums[ty * job->tiles_wide +
+                                                    tx];
+                        double e   = sqrt(sum / (3.0 * w * h));
+                        putc((int)(255 * e + 0.5), fp);
+                }
+        }
+
+        int err = fclose(fp);
+        assert(err == 0);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -0,0 +1,144 @@
+/*
+ *      ppmread.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Component file defining all extern and helper functions for the
+ *        ppmread component
+ *      - Component-wide invariants:
+ *              ~ The header is read up to and including the single
+ *                whitespace after maxval, so input is left at the raster
+ *              ~ Rows past the last one read are left unread on input
+ */
+
+#include <stdio.h>
+
+#include "a2methods.h"
+#include "assert.h"
+#include "ppmread.h"
+
+/* -- READER HELPER FUNCTIONS -- */
+unsigned read_number(FILE *input);
+unsigned read_sample(Ppm_reader *reader);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                       READER FUNCTIONS                       |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       Ppm_open
+ * [Parameters]: 1 FILE* (input, at a portable pixmap), 1 Ppm_reader*
+ *               (reader, filled)
+ * [Return]:     void
+ * [Purpose]:    Reads the pixmap's header
+ * [Errors]:     CRE if input or reader is NULL, or the header is not of a
+ *                   plain or raw pixmap
+ */
+void Ppm_open(FILE *input, Ppm_reader *reader)
+{
+        assert(input != NULL && reader != NULL);
+
+        int p     = getc(input);
+        int magic = getc(input);
+        assert(p == 'P' && (magic == '6' || magic == '3'));
+
+        reader->input  = input;
+        reader->raw    = magic == '6';
+        reader->width  = read_number(input);
+        reader->height = read_number(input);
+
+        reader->maxval = read_number(input);
+        assert(reader->maxval > 0 && reader->maxval < 65536);
+        reader->sample_bytes = reader->maxval > 255 ? 2 : 1;
+}
+
+/*
+ * [Name]:       Ppm_read
+ * [Parameters]: 1 Ppm_reader*, 1 Pnm_ppm (pixmap, filled), 1 unsigned
+ *               (rows: number of pixel rows to read)
+ * [Return]:     void
+ * [Purpose]:    Reads the next rows of the raster into pixmap, resetting
+ *               its size and denominator (the compress pipeline trims and
+ *               scales a pixmap in place, so a reused one needs both)
+ * [Errors]:     CRE if reader or pixmap is NULL, pixmap's pixel array is
+ *                   too small, or the input ends early
+ */
+void Ppm_read(Ppm_reader *reader, Pnm_ppm pixmap, unsigned rows)
+{
+        assert(reader != NULL && pixmap != NULL);
+        A2Methods_T methods = pixmap->methods;
+        assert((unsigned)methods->width (pixmap->pixels) >= reader->width &&
+               (unsigned)methods->height(pixmap->pixels) >= rows);
+
+        pixmap->width       = reader->width;
+        pixmap->height      = rows;
+        pixmap->denominator = reader->maxval;
+
+        for (unsigned row = 0; row < rows; row++) {
+                for (unsigned col = 0; col < reader->width; col++) {
+                        Pnm_rgb px = methods->at(pixmap->pixels, col, row);
+                        px->red   = read_sample(reader);
+                        px->green = read_sample(reader);
+                        px->blue  = read_sample(reader);
+                }
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                   READER HELPER FUNCTIONS                    |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       read_number
+ * [Parameters]: 1 FILE* (input)
+ * [Return]:     the next decimal number, skipping whitespace and comments
+ * [Purpose]:    Header (and plain raster) tokenizer
+ *               Note: Consumes the character after the number, which after
+ *                     a raw pixmap's maxval is the single whitespace before
+ *                     the raster
+ * [Errors]:     CRE if there is no number before the end
+ */
+unsigned read_number(FILE *input)
+{
+        int c = getc(input);
+        while (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '#') {
+                if (c == '#') {
+                        while (c != '\n' && c != EOF) {
+                                c = getc(input);
+                        }
+                }
+                c = getc(input);
+        }
+        assert(c >= '0' && c <= '9');
+
+        unsigned value = 0;
+        while (c >= '0' && c <= '9') {
+                value = value * 10 + (c - '0');
+                c = getc(input);
+        }
+
+        return value;
+}
+
+/*
+ * [Name]:       read_sample
+ * [Parameters]: 1 Ppm_reader*
+ * [Return]:     the next sample of the raster
+ * [Purpose]:    Reads a raw sample (big-endian if 2 bytes) or a plain one
+ * [Errors]:     CRE if the input ends early
+ */
+unsigned read_sample(Ppm_reader *reader)
+{
+        if (!reader->raw) {
+                return read_number(reader->input);
+        }
+
+        unsigned value = 0;
+        for (unsigned b = 0; b < reader->sample_bytes; b++) {
+                int c = getc(reader->input);
+                assert(c != EOF);
+                value = (value << 8) | c;
+        }
+
+        return value;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -0,0 +1,46 @@
+/*
+ *      ppmread.h
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Header file declaring client-accessible functions for the
+ *        ppmread component
+ *      - Component reads a portable pixmap (plain P3 or raw P6, 8 or 16 bit
+ *        samples) a given number of pixel rows at a time, into a pixmap
+ *        the client owns, so that one pixmap can be reused for every band
+ *        of an image, or for every frame of a stream of the same size
+ */
+
+#ifndef PPMREAD_INCLUDED
+#define PPMREAD_INCLUDED
+
+#include <stdio.h>
+
+#include "pnm.h"
+
+/* -- A portable pixmap being read, its header already parsed -- */
+typedef struct Ppm_reader {
+        FILE     *input;
+        unsigned  width, height;     /* of the whole pixmap           */
+        unsigned  maxval;
+        int       raw;               /* nonzero: P6, else P3          */
+        unsigned  sample_bytes;      /* raw: 1, or 2 (maxval > 255)   */
+} Ppm_reader;
+
+/*
+ * Reads the header of the pixmap at input into reader, leaving input at
+ * the first sample of the raster
+ * CRE: input and reader cannot be NULL, the header must be of a plain or
+ *      raw pixmap with a maxval from 1 to 65535
+ */
+extern void Ppm_open(FILE *input, Ppm_reader *reader);
+
+/*
+ * Reads the next rows pixel rows of the raster into the top of pixmap,
+ * which is set to reader's width, rows high, with reader's maxval as its
+ * denominator (its pixel array is kept, and must be at least that large)
+ * CRE: parameters cannot be NULL, pixmap's pixel array must be large
+ *      enough, the input cannot end early
+ */
+extern void Ppm_read(Ppm_reader *reader, Pnm_ppm pixmap, unsigned rows);
+
+#endif /* PPMREAD_INCLUDED */
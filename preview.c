@@ -0,0 +1,163 @@
+/*
+ *      preview.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the preview decompress function for 40image
+ *      - Preview: Reads a compressed COMP40 image from the input stream and
+ *                 sends a 1/2, 1/4 or 1/8 scale portable pixmap of it on
+ *                 standard output
+ *      - A codeword's a field is the average luma of its 2x2 block, and its
+ *        Pb/Pr indices are the block's average chroma, so each codeword
+ *        already is one pixel of the 1/2 scale image: preview never runs the
+ *        inverse DCT or builds full-resolution blocks
+ *      - Invariants:
+ *              ~ Compressed image is never modified
+ *              ~ Works on both flat (2) and tiled (3) COMP40 formats
+ *              ~ At 1/scale, each output pixel averages a (scale/2)x(scale/2)
+ *                square of blocks (fewer along the right/bottom edges)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arith40.h"
+#include "assert.h"
+#include "codeword_io.h"
+#include "compress40ext.h"
+#include "imagemethods.h"
+#include "luma_bit.h"
+#include "mem.h"
+#include "pixpack.h"
+#include "rgb_xyz.h"
+#include "uarray.h"
+
+/* -- struct Pnm_ppm is from pnm.h -- */
+typedef struct Pnm_ppm *ppm;
+
+/* -- PREVIEW HELPER FUNCTIONS -- */
+void add_preview_row  (UArray_T codewords, struct XYZ_px *sums,
+                       unsigned *counts, unsigned span);
+void store_preview_row(ppm image, unsigned row, struct XYZ_px *sums,
+                       unsigned *counts);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                      PREVIEW FUNCTION                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       decompress40_preview
+ * [Parameters]: 1 FILE* (input), 1 unsigned (scale: 2, 4 or 8)
+ * [Return]:     void
+ * [Purpose]:    Decompresses image on input stream at 1/scale of its full
+ *               resolution and sends it on standard output in a portable
+ *               pixmap format
+ *               Note: Does not modify or close input
+ *                     Codewords are read one block row at a time, and only
+ *                      their a, Pb and Pr fields are unpacked
+ * [Errors]:     CRE if input is NULL or scale is not 2, 4 or 8
+ */
+void decompress40_preview(FILE *input, unsigned scale)
+{
+        assert(input != NULL);
+        assert(scale == 2 || scale == 4 || scale == 8);
+
+        /* Reading file header */
+        Comp40_T      comp40 = Comp40_open(input);
+        Comp40_header header = Comp40_info(comp40);
+
+        unsigned blocks_wide = header.width  / 2;
+        unsigned blocks_high = header.height / 2;
+        unsigned span        = scale  / 2;    /* blocks per pixel, each way */
+        unsigned out_width   = (blocks_wide + span - 1) / span;
+        unsigned out_height  = (blocks_high + span - 1) / span;
+
+        ppm image = new_ppm(out_width, out_height);
+        UArray_T codewords    = UArray_new(blocks_wide, sizeof(uint32_t));
+        struct XYZ_px *sums   = CALLOC(out_width + 1, sizeof(*sums));
+        unsigned      *counts = CALLOC(out_width + 1, sizeof(*counts));
+
+        for (unsigned row = 0; row < out_height; row++) {
+                for (unsigned i = 0; i < out_width; i++) {
+                        sums[i].luma = sums[i].Pb = sums[i].Pr = 0;
+                        counts[i]    = 0;
+                }
+
+                for (unsigned j = 0; j < span && row * span + j < blocks_high;
+                     j++) {
+                        codewords = Comp40_rect(comp40, 0, row * span + j,
+                                                blocks_wide, 1, codewords);
+                        add_preview_row(codewords, sums, counts, span);
+                }
+
+                store_preview_row(image, row, sums, counts);
+        }
+
+        Pnm_ppmwrite(stdout, image);
+
+        FREE(sums);
+        FREE(counts);
+        UArray_free(&codewords);
+        Pnm_ppmfree(&image);
+        Comp40_close(&comp40);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                  PREVIEW HELPER FUNCTIONS                    |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       add_preview_row
+ * [Parameters]: 1 UArray (one block row of codewords), 1 struct XYZ_px*
+ *               (running sums per output pixel), 1 unsigned* (counts per
+ *               output pixel), 1 unsigned (span: blocks per output pixel)
+ * [Return]:     void
+ * [Purpose]:    Adds the average luma and chroma of every block in the row
+ *               to the sums of the output pixel that covers it
+ * [Errors]:     CRE if codewords is NULL
+ */
+void add_preview_row(UArray_T codewords, struct XYZ_px *sums,
+                     unsigned *counts, unsigned span)
+{
+        assert(codewords != NULL);
+
+        struct bit_block bit;
+
+        for (int i = 0; i < UArray_length(codewords); i++) {
+                unpack_dc(*(uint32_t *)UArray_at(codewords, i), &bit);
+
+                struct XYZ_px *sum = &sums[i / span];
+                sum->luma += bit_to_avg_luma(bit.a);
+                sum->Pb   += Arith40_chroma_of_index(bit.Pb);
+                sum->Pr   += Arith40_chroma_of_index(bit.Pr);
+                counts[i / span]++;
+        }
+}
+
+/*
+ * [Name]:       store_preview_row
+ * [Parameters]: 1 Pnm_ppm (image), 1 unsigned (row), 1 struct XYZ_px*
+ *               (sums per output pixel), 1 unsigned* (counts per pixel)
+ * [Return]:     void
+ * [Purpose]:    Converts each averaged XYZ pixel in the row to RGB and stores
+ *               it in the image
+ * [Errors]:     CRE if image is NULL
+ */
+void store_preview_row(ppm image, unsigned row, struct XYZ_px *sums,
+                       unsigned *counts)
+{
+        assert(image != NULL);
+
+        for (unsigned col = 0; col < image->width; col++) {
+                struct XYZ_px xyz = { sums[col].luma / counts[col],
+                                      sums[col].Pb   / counts[col],
+                                      sums[col].Pr   / counts[col] };
+                struct RGB_px rgb = XYZ_px_to_RGB(xyz);
+
+                Pnm_rgb px = image->methods->at(image->pixels, col, row);
+                px->red    = rgb.r;
+                px->green  = rgb.g;
+                px->blue   = rgb.b;
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -0,0 +1,881 @@
+/*
+ *      profile.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Component file defining all extern and helper functions for the
+ *        profile component
+ *      - Component keeps, for each stage of each direction, its number of
+ *        calls, wall and CPU time, blocks and bytes in and out, and the
+ *        allocations made on the calling thread during the stage
+ *      - With counters on, each stage also adds the change in the calling
+ *        thread's hardware counters (counters component) over each call
+ *      - With tracing on, each stage call and each named span is also
+ *        appended to its thread's chunk of trace events: chunks are pushed
+ *        on a lock-free list when a thread starts one, so recording an
+ *        event takes no lock and no atomic operation
+ *      - The Makefile links Mem_alloc, Mem_calloc, Mem_resize and Mem_free
+ *        (under NEW, ALLOC, CALLOC, RESIZE, FREE and CII's UArray_new) to
+ *        the __wrap_ functions here, which count each block's usable size
+ *      - Component-wide invariants:
+ *              ~ Totals are only added to, with relaxed atomic adds, so the
+ *                threads of a parallel decode can record at once
+ *              ~ Wall and CPU times are summed over threads, so a stage run
+ *                on several threads can exceed the elapsed time
+ *              ~ A stage's peak live bytes is the most its allocations grew
+ *                on one thread in one call; the run's peak counts every
+ *                thread, from the bytes live when profiling began
+ *              ~ Tracing alone reads only the monotonic clock: CPU time,
+ *                allocations and counters are kept only with profile_enable
+ *              ~ Trace chunks are malloc'd, not ALLOC'd, so that they are
+ *                not counted as the codec's allocations
+ *              ~ Without COMP40_PROFILE, only profile_compiled,
+ *                profile_enable, profile_print, profile_quality,
+ *                profile_trace and profile_trace_write exist, and do
+ *                nothing
+ */
+
+#define _GNU_SOURCE
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "profile.h"
+
+#ifdef COMP40_PROFILE
+
+/* -- Totals of one stage -- */
+struct stage_totals {
+        uint64_t calls;
+        uint64_t wall_ns, cpu_ns;
+        uint64_t blocks;
+        uint64_t bytes_in, bytes_out;
+        uint64_t allocs, alloc_bytes;
+        int64_t  peak_live;
+        uint64_t counts[COUNTERS];
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+static const char *DIRECTION_NAMES[PROFILE_DIRECTIONS] = {
+        "compress", "decompress"
+};
+static const char *STAGE_NAMES[PROFILE_STAGES] = {
+        "read", "rgb_xyz", "chroma", "luma", "pixpack", "write"
+};
+
+/* Pipeline order of the stages in each direction */
+static const int ORDER[PROFILE_DIRECTIONS][PROFILE_STAGES] = {
+        { PROFILE_READ, PROFILE_RGB_XYZ, PROFILE_CHROMA,
+          PROFILE_LUMA, PROFILE_PIXPACK, PROFILE_WRITE },
+        { PROFILE_READ, PROFILE_PIXPACK, PROFILE_LUMA,
+          PROFILE_CHROMA, PROFILE_RGB_XYZ, PROFILE_WRITE }
+};
+
+static int                 enabled = 0;        /* profile_enable  */
+static int                 tracing = 0;        /* profile_trace   */
+static uint64_t            started = 0;
+static struct stage_totals totals[PROFILE_DIRECTIONS][PROFILE_STAGES];
+
+/* -- One span of the trace, and a thread's chunk of them -- */
+#define TRACE_CHUNK  4096
+#define TRACE_BUFFER (64 * 1024)    /* bytes written at once */
+#define TRACE_LINE   256            /* longest event written */
+struct trace_event {
+        const char *name, *cat;
+        uint64_t    start, end;                /* monotonic ns */
+};
+struct trace_chunk {
+        struct trace_chunk *next;              /* in the list of all chunks */
+        long                tid;
+        int                 first;             /* thread's first chunk */
+        unsigned            used;
+        struct trace_event  events[TRACE_CHUNK];
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+static struct trace_chunk          *chunks   = NULL;
+static __thread struct trace_chunk *my_chunk = NULL;
+
+/* Whether to read hardware counters, and those counting on every thread */
+static int      counters = 0;
+static unsigned counting = (1u << COUNTERS) - 1;
+
+/* Allocations of the whole run, and of this thread (read by the marks) */
+static uint64_t mem_allocs = 0, mem_bytes = 0;
+static int64_t  mem_live   = 0, mem_peak  = 0;
+static __thread struct {
+        uint64_t allocs, bytes;
+        int64_t  live, peak;
+} mine;
+
+/* Round-trip error of a --verify run, if profile_quality recorded one */
+static struct {
+        int      recorded;
+        double   rms, rms_low, rms_high;
+        unsigned sampled, blocks;
+} quality;
+
+/* -- CLOCK & COUNTING HELPER FUNCTIONS -- */
+uint64_t clock_ns    (clockid_t clock);
+void     count_alloc (void *ptr);
+void     count_free  (void *ptr);
+void     raise_to    (int64_t *peak, int64_t value);
+void     trace_add   (const char *name, const char *cat, uint64_t start,
+                      uint64_t end);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- TRACE WRITING HELPER FUNCTIONS -- */
+char *put_text  (char *at, const char *text);
+char *put_number(char *at, unsigned long long value);
+char *put_micros(char *at, uint64_t ns);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- REPORT HELPER FUNCTIONS -- */
+void print_counters(FILE *out);
+void json_counters (FILE *out, const struct stage_totals *t);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- HANSON ALLOCATOR, AND ITS WRAPPERS (ld --wrap) -- */
+extern void *__real_Mem_alloc (long nbytes, const char *file, int line);
+extern void *__real_Mem_calloc(long count, long nbytes, const char *file,
+                               int line);
+extern void *__real_Mem_resize(void *ptr, long nbytes, const char *file,
+                               int line);
+extern void  __real_Mem_free  (void *ptr, const char *file, int line);
+
+void *__wrap_Mem_alloc (long nbytes, const char *file, int line);
+void *__wrap_Mem_calloc(long count, long nbytes, const char *file, int line);
+void *__wrap_Mem_resize(void *ptr, long nbytes, const char *file, int line);
+void  __wrap_Mem_free  (void *ptr, const char *file, int line);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                      RECORDING FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       profile_start
+ * [Parameters]: None
+ * [Return]:     Profile_mark of now (zero if neither profiling nor tracing
+ *               is enabled)
+ * [Purpose]:    Starts timing one call of a stage
+ * [Errors]:     None
+ */
+Profile_mark profile_start(void)
+{
+        Profile_mark mark = { 0 };
+
+        if (enabled || tracing) {
+                mark.wall   = clock_ns(CLOCK_MONOTONIC);
+        }
+        if (enabled) {
+                mark.cpu    = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+                mark.allocs = mine.allocs;
+                mark.bytes  = mine.bytes;
+                mark.live   = mine.live;
+                mark.peak   = mine.peak;
+                mine.peak   = mine.live;
+                if (counters) {
+                        unsigned opened = counters_open();
+                        if ((__atomic_load_n(&counting, __ATOMIC_RELAXED) &
+                             ~opened) != 0) {
+                                __atomic_fetch_and(&counting, opened,
+                                                   __ATOMIC_RELAXED);
+                        }
+                        counters_read(mark.counts);
+                }
+        }
+
+        return mark;
+}
+
+/*
+ * [Name]:       profile_stop
+ * [Parameters]: 1 Profile_mark (from profile_start on this thread), 2 ints
+ *               (direction, stage), 3 uint64_t (blocks processed, bytes in
+ *               and out)
+ * [Return]:     void
+ * [Purpose]:    Adds one call of a stage to its totals, with the
+ *               allocations this thread made since the mark, and to the
+ *               trace if tracing
+ * [Errors]:     CRE if direction or stage is out of range
+ */
+void profile_stop(Profile_mark mark, int direction, int stage,
+                  uint64_t blocks, uint64_t bytes_in, uint64_t bytes_out)
+{
+        if (!enabled && !tracing) {
+                return;
+        }
+        assert(direction >= 0 && direction < PROFILE_DIRECTIONS);
+        assert(stage >= 0 && stage < PROFILE_STAGES);
+
+        uint64_t counts[COUNTERS] = { 0 };
+        if (counters) {
+                counters_read(counts);
+        }
+        uint64_t end = clock_ns(CLOCK_MONOTONIC);
+        if (tracing) {
+                trace_add(STAGE_NAMES[stage], DIRECTION_NAMES[direction],
+                          mark.wall, end);
+        }
+        if (!enabled) {
+                return;
+        }
+
+        uint64_t wall = end - mark.wall;
+        uint64_t cpu  = clock_ns(CLOCK_THREAD_CPUTIME_ID) - mark.cpu;
+        uint64_t allocs = mine.allocs - mark.allocs;
+        uint64_t bytes  = mine.bytes - mark.bytes;
+        int64_t  peak   = mine.peak - mark.live;
+
+        /* An enclosing mark's peak includes this one's */
+        if (mark.peak > mine.peak) {
+                mine.peak = mark.peak;
+        }
+
+        struct stage_totals *t = &totals[direction][stage];
+        __atomic_fetch_add(&t->calls,     1,         __ATOMIC_RELAXED);
+        __atomic_fetch_add(&t->wall_ns,   wall,      __ATOMIC_RELAXED);
+        __atomic_fetch_add(&t->cpu_ns,    cpu,       __ATOMIC_RELAXED);
+        __atomic_fetch_add(&t->blocks,    blocks,    __ATOMIC_RELAXED);
+        __atomic_fetch_add(&t->bytes_in,  bytes_in,  __ATOMIC_RELAXED);
+        __atomic_fetch_add(&t->bytes_out, bytes_out, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&t->allocs,    allocs,    __ATOMIC_RELAXED);
+        __atomic_fetch_add(&t->alloc_bytes, bytes,   __ATOMIC_RELAXED);
+        raise_to(&t->peak_live, peak);
+        for (int i = 0; counters && i < COUNTERS; i++) {
+                __atomic_fetch_add(&t->counts[i], counts[i] - mark.counts[i],
+                                   __ATOMIC_RELAXED);
+        }
+}
+
+/*
+ * [Name]:       profile_span_start
+ * [Parameters]: None
+ * [Return]:     the monotonic clock in ns if tracing, 0 otherwise
+ * [Purpose]:    Starts a named span of the trace
+ * [Errors]:     None
+ */
+uint64_t profile_span_start(void)
+{
+        return tracing ? clock_ns(CLOCK_MONOTONIC) : 0;
+}
+
+/*
+ * [Name]:       profile_span_stop
+ * [Parameters]: 1 uint64_t (start: from profile_span_start on this thread),
+ *               1 const char* (name: a string constant)
+ * [Return]:     void
+ * [Purpose]:    Records the span from start to now in the trace, if tracing
+ * [Errors]:     None
+ */
+void profile_span_stop(uint64_t start, const char *name)
+{
+        if (tracing) {
+                trace_add(name, "span", start, clock_ns(CLOCK_MONOTONIC));
+        }
+}
+
+/*
+ * [Name]:       trace_add
+ * [Parameters]: 2 const char* (name, cat: kept, not copied), 2 uint64_t
+ *               (start, end: monotonic ns)
+ * [Return]:     void
+ * [Purpose]:    Appends an event to this thread's chunk, starting a new
+ *               chunk (and pushing it on the list) when there is none or it
+ *               is full
+ * [Errors]:     None (the event is dropped if no chunk can be malloc'd)
+ */
+void trace_add(const char *name, const char *cat, uint64_t start,
+               uint64_t end)
+{
+        struct trace_chunk *chunk = my_chunk;
+
+        if (chunk == NULL || chunk->used == TRACE_CHUNK) {
+                struct trace_chunk *fresh = malloc(sizeof(*fresh));
+                if (fresh == NULL) {
+                        return;
+                }
+                fresh->tid   = syscall(SYS_gettid);
+                fresh->first = chunk == NULL;
+                fresh->used  = 0;
+                fresh->next  = __atomic_load_n(&chunks, __ATOMIC_RELAXED);
+                while (!__atomic_compare_exchange_n(&chunks, &fresh->next,
+                                                    fresh, 1,
+                                                    __ATOMIC_RELEASE,
+                                                    __ATOMIC_RELAXED)) {
+                }
+                my_chunk = chunk = fresh;
+        }
+
+        struct trace_event *event = &chunk->events[chunk->used++];
+        event->name  = name;
+        event->cat   = cat;
+        event->start = start;
+        event->end   = end;
+}
+
+/*
+ * [Name]:       clock_ns
+ * [Parameters]: 1 clockid_t
+ * [Return]:     the clock's time in nanoseconds
+ * [Purpose]:    Reads the clocks of profile_start and profile_stop
+ * [Errors]:     None
+ */
+uint64_t clock_ns(clockid_t clock)
+{
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+
+        return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                  ALLOCATION COUNTING FUNCTIONS               |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       __wrap_Mem_alloc, __wrap_Mem_calloc, __wrap_Mem_resize,
+ *               __wrap_Mem_free
+ * [Parameters]: Those of Mem_alloc, Mem_calloc, Mem_resize and Mem_free
+ * [Return]:     What the Hanson function returns
+ * [Purpose]:    Call the Hanson function (raising Mem_Failed as it does), and
+ *               count the block allocated or freed; a resize counts as one
+ *               allocation of the new block and a free of the old
+ * [Errors]:     Those of the Hanson functions
+ */
+void *__wrap_Mem_alloc(long nbytes, const char *file, int line)
+{
+        void *ptr = __real_Mem_alloc(nbytes, file, line);
+        count_alloc(ptr);
+
+        return ptr;
+}
+
+void *__wrap_Mem_calloc(long count, long nbytes, const char *file, int line)
+{
+        void *ptr = __real_Mem_calloc(count, nbytes, file, line);
+        count_alloc(ptr);
+
+        return ptr;
+}
+
+void *__wrap_Mem_resize(void *ptr, long nbytes, const char *file, int line)
+{
+        count_free(ptr);
+        ptr = __real_Mem_resize(ptr, nbytes, file, line);
+        count_alloc(ptr);
+
+        return ptr;
+}
+
+void __wrap_Mem_free(void *ptr, const char *file, int line)
+{
+        count_free(ptr);
+        __real_Mem_free(ptr, file, line);
+}
+
+/*
+ * [Name]:       count_alloc
+ * [Parameters]: 1 void* (block just allocated; NULL is ignored)
+ * [Return]:     void
+ * [Purpose]:    Adds the block's usable size to this thread's and the run's
+ *               allocations and live bytes, and raises their peaks
+ * [Errors]:     None
+ */
+void count_alloc(void *ptr)
+{
+        if (!enabled || ptr == NULL) {
+                return;
+        }
+        int64_t size = malloc_usable_size(ptr);
+
+        mine.allocs++;
+        mine.bytes += size;
+        mine.live  += size;
+        if (mine.live > mine.peak) {
+                mine.peak = mine.live;
+        }
+
+        __atomic_fetch_add(&mem_allocs, 1,    __ATOMIC_RELAXED);
+        __atomic_fetch_add(&mem_bytes,  size, __ATOMIC_RELAXED);
+        raise_to(&mem_peak, __atomic_add_fetch(&mem_live, size,
+                                               __ATOMIC_RELAXED));
+}
+
+/*
+ * [Name]:       count_free
+ * [Parameters]: 1 void* (block about to be freed; NULL is ignored)
+ * [Return]:     void
+ * [Purpose]:    Takes the block's usable size off this thread's and the run's
+ *               live bytes
+ * [Errors]:     None
+ */
+void count_free(void *ptr)
+{
+        if (!enabled || ptr == NULL) {
+                return;
+        }
+        int64_t size = malloc_usable_size(ptr);
+
+        mine.live -= size;
+        __atomic_fetch_sub(&mem_live, size, __ATOMIC_RELAXED);
+}
+
+/*
+ * [Name]:       raise_to
+ * [Parameters]: 1 int64_t* (peak, shared by threads), 1 int64_t (value)
+ * [Return]:     void
+ * [Purpose]:    Atomically sets *peak to value if value is larger
+ * [Errors]:     None
+ */
+void raise_to(int64_t *peak, int64_t value)
+{
+        int64_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+        while (value > old &&
+               !__atomic_compare_exchange_n(peak, &old, value, 1,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+#endif /* COMP40_PROFILE */
+
+/*--------------------------------------------------------------*
+ |                       REPORT FUNCTIONS                       |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       profile_compiled
+ * [Parameters]: None
+ * [Return]:     1 if built with COMP40_PROFILE, 0 otherwise
+ * [Purpose]:    Lets 40image refuse --profile when it would print nothing
+ * [Errors]:     None
+ */
+int profile_compiled(void)
+{
+#ifdef COMP40_PROFILE
+        return 1;
+#else
+        return 0;
+#endif
+}
+
+/*
+ * [Name]:       profile_enable
+ * [Parameters]: 1 int (counters: nonzero to read hardware counters too)
+ * [Return]:     void
+ * [Purpose]:    Starts recording, and the elapsed time profile_print reports
+ * [Errors]:     None
+ */
+void profile_enable(int use_counters)
+{
+#ifdef COMP40_PROFILE
+        started  = clock_ns(CLOCK_MONOTONIC);
+        counters = use_counters;
+        enabled  = 1;
+#else
+        (void)use_counters;
+#endif
+}
+
+/*
+ * [Name]:       profile_print
+ * [Parameters]: 1 FILE* (out), 1 int (json: nonzero for JSON)
+ * [Return]:     void
+ * [Purpose]:    Prints the elapsed time since profile_enable, the totals
+ *               of every stage called at least once, in pipeline order, and
+ *               the allocations of the run with the process's peak RSS:
+ *               ~ As tables (times, memory, and counters if enabled) with
+ *                 one line per stage, or
+ *               ~ As { "elapsed_s", "stages": [ { "direction", "stage",
+ *                 "calls", "wall_s", "cpu_s", "blocks", "bytes_in",
+ *                 "bytes_out", "allocs", "alloc_bytes", "peak_live_bytes"
+ *                 [, "counters_per_block": { name: count }] } ], "memory":
+ *                 { "allocs", "alloc_bytes", "peak_live_bytes",
+ *                 "peak_rss_bytes" } [, "quality": { "rms", "rms_low",
+ *                 "rms_high", "sampled", "blocks" }] [, "counters": {
+ *                 "available": [ name ], "error" }] }
+ *               The quality, if recorded, follows the memory tables
+ * [Errors]:     CRE if out is NULL
+ */
+void profile_print(FILE *out, int json)
+{
+        assert(out != NULL);
+#ifdef COMP40_PROFILE
+        double elapsed = (clock_ns(CLOCK_MONOTONIC) - started) / 1e9;
+        int    first   = 1;
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        unsigned long long rss = (unsigned long long)usage.ru_maxrss * 1024;
+
+        if (json) {
+                fprintf(out, "{\"elapsed_s\": %.6f, \"stages\": [", elapsed);
+        } else {
+                fprintf(out, "profile: %.4f s elapsed (stage times are "
+                        "summed over threads)\n%-10s %-8s %7s %10s %10s "
+                        "%10s %12s %12s\n", elapsed, "direction", "stage",
+                        "calls", "wall s", "cpu s", "blocks", "bytes in",
+                        "bytes out");
+        }
+        for (int dir = 0; dir < PROFILE_DIRECTIONS; dir++) {
+                for (int i = 0; i < PROFILE_STAGES; i++) {
+                        int                        s = ORDER[dir][i];
+                        const struct stage_totals *t = &totals[dir][s];
+                        if (t->calls == 0) {
+                                continue;
+                        }
+
+                        unsigned long long calls  = t->calls;
+                        unsigned long long blocks = t->blocks;
+                        unsigned long long in     = t->bytes_in;
+                        unsigned long long out_b  = t->bytes_out;
+                        if (json) {
+                                fprintf(out, "%s\n  {\"direction\": \"%s\", "
+                                        "\"stage\": \"%s\", \"calls\": %llu, "
+                                        "\"wall_s\": %.6f, \"cpu_s\": %.6f, "
+                                        "\"blocks\": %llu, \"bytes_in\": "
+                                        "%llu, \"bytes_out\": %llu, "
+                                        "\"allocs\": %llu, \"alloc_bytes\": "
+                                        "%llu, \"peak_live_bytes\": %lld",
+                                        first ? "" : ",",
+                                        DIRECTION_NAMES[dir], STAGE_NAMES[s],
+                                        calls, t->wall_ns / 1e9,
+                                        t->cpu_ns / 1e9, blocks, in, out_b,
+                                        (unsigned long long)t->allocs,
+                                        (unsigned long long)t->alloc_bytes,
+                                        (long long)t->peak_live);
+                                json_counters(out, t);
+                                fprintf(out, "}");
+                        } else {
+                                fprintf(out, "%-10s %-8s %7llu %10.4f %10.4f "
+                                        "%10llu %12llu %12llu\n",
+                                        DIRECTION_NAMES[dir], STAGE_NAMES[s],
+                                        calls, t->wall_ns / 1e9,
+                                        t->cpu_ns / 1e9, blocks, in, out_b);
+                        }
+                        first = 0;
+                }
+        }
+        if (json) {
+                fprintf(out, "\n], \"memory\": {\"allocs\": %llu, "
+                        "\"alloc_bytes\": %llu, \"peak_live_bytes\": %lld, "
+                        "\"peak_rss_bytes\": %llu}",
+                        (unsigned long long)mem_allocs,
+                        (unsigned long long)mem_bytes, (long long)mem_peak,
+                        rss);
+                if (quality.recorded) {
+                        fprintf(out, ", \"quality\": {\"rms\": %.6f, "
+                                "\"rms_low\": %.6f, \"rms_high\": %.6f, "
+                                "\"sampled\": %u, \"blocks\": %u}",
+                                quality.rms, quality.rms_low,
+                                quality.rms_high, quality.sampled,
+                                quality.blocks);
+                }
+                if (counters) {
+                        fprintf(out, ", \"counters\": {\"available\": [");
+                        for (int i = 0, n = 0; i < COUNTERS; i++) {
+                                if ((counting & (1u << i)) != 0) {
+                                        fprintf(out, "%s\"%s\"",
+                                                n++ > 0 ? ", " : "",
+                                                counter_name(i));
+                                }
+                        }
+                        fprintf(out, "], \"error\": \"%s\"}",
+                                counters_error());
+                }
+                fprintf(out, "}\n");
+                return;
+        }
+
+        fprintf(out, "memory: %llu allocations, %llu bytes, %lld peak live "
+                "bytes, %llu bytes peak RSS\n%-10s %-8s %10s %14s %14s\n",
+                (unsigned long long)mem_allocs, (unsigned long long)mem_bytes,
+                (long long)mem_peak, rss, "direction", "stage", "allocs",
+                "alloc bytes", "peak live");
+        for (int dir = 0; dir < PROFILE_DIRECTIONS; dir++) {
+                for (int i = 0; i < PROFILE_STAGES; i++) {
+                        int                        s = ORDER[dir][i];
+                        const struct stage_totals *t = &totals[dir][s];
+                        if (t->calls == 0) {
+                                continue;
+                        }
+                        fprintf(out, "%-10s %-8s %10llu %14llu %14lld\n",
+                                DIRECTION_NAMES[dir], STAGE_NAMES[s],
+                                (unsigned long long)t->allocs,
+                                (unsigned long long)t->alloc_bytes,
+                                (long long)t->peak_live);
+                }
+        }
+        if (quality.recorded) {
+                fprintf(out, "quality: rms %.4f (95%% bounds %.4f to %.4f), "
+                        "%u of %u blocks sampled\n", quality.rms,
+                        quality.rms_low, quality.rms_high, quality.sampled,
+                        quality.blocks);
+        }
+        if (counters) {
+                print_counters(out);
+        }
+#else
+        (void)json;
+#endif
+}
+
+/*
+ * [Name]:       profile_quality
+ * [Parameters]: 3 doubles (rms, rms_low, rms_high), 2 unsigned integers
+ *               (sampled, blocks): the fields of a Comp40_quality
+ * [Return]:     void
+ * [Purpose]:    Records a --verify run's round-trip error, so monitoring
+ *               reads it from the same report as the stage totals
+ * [Errors]:     None
+ */
+void profile_quality(double rms, double rms_low, double rms_high,
+                     unsigned sampled, unsigned blocks)
+{
+#ifdef COMP40_PROFILE
+        if (!enabled) {
+                return;
+        }
+        quality.rms      = rms;
+        quality.rms_low  = rms_low;
+        quality.rms_high = rms_high;
+        quality.sampled  = sampled;
+        quality.blocks   = blocks;
+        quality.recorded = 1;
+#else
+        (void)rms;
+        (void)rms_low;
+        (void)rms_high;
+        (void)sampled;
+        (void)blocks;
+#endif
+}
+
+/*
+ * [Name]:       profile_trace
+ * [Parameters]: None
+ * [Return]:     void
+ * [Purpose]:    Starts recording the trace
+ * [Errors]:     None
+ */
+void profile_trace(void)
+{
+#ifdef COMP40_PROFILE
+        if (!enabled) {
+                started = clock_ns(CLOCK_MONOTONIC);
+        }
+        tracing = 1;
+#endif
+}
+
+/*
+ * [Name]:       profile_trace_write
+ * [Parameters]: 1 FILE* (out)
+ * [Return]:     void
+ * [Purpose]:    Writes { "displayTimeUnit", "traceEvents": [ ... ] }: a
+ *               thread_name event for each thread ("main" or "worker"),
+ *               then a complete ("X") event per span, named after its stage
+ *               (category: its direction) or its span name (category
+ *               "span"), timed in microseconds from profile_trace; frees
+ *               the events and stops tracing
+ * [Errors]:     CRE if out is NULL
+ */
+void profile_trace_write(FILE *out)
+{
+        assert(out != NULL);
+#ifdef COMP40_PROFILE
+        long pid   = getpid();
+        int  first = 1;
+
+        tracing = 0;
+        fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+        for (struct trace_chunk *c = chunks; c != NULL; c = c->next) {
+                if (!c->first) {
+                        continue;
+                }
+                fprintf(out, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+                        "\"pid\": %ld, \"tid\": %ld, \"args\": {\"name\": "
+                        "\"%s\"}}", first ? "" : ",", pid, c->tid,
+                        c->tid == pid ? "main" : "worker");
+                first = 0;
+        }
+        /* Events are built by hand, many to a write: fprintf would take
+         * longer than the run's recording did */
+        char *buffer = malloc(TRACE_BUFFER);
+        char *at     = buffer;
+        assert(buffer != NULL);
+        while (chunks != NULL) {
+                struct trace_chunk *c = chunks;
+                for (unsigned i = 0; i < c->used; i++) {
+                        const struct trace_event *e = &c->events[i];
+                        if (at - buffer > TRACE_BUFFER - TRACE_LINE) {
+                                fwrite(buffer, 1, at - buffer, out);
+                                at = buffer;
+                        }
+                        at = put_text  (at, first ? "\n{\"name\":\""
+                                                  : ",\n{\"name\":\"");
+                        at = put_text  (at, e->name);
+                        at = put_text  (at, "\",\"cat\":\"");
+                        at = put_text  (at, e->cat);
+                        at = put_text  (at, "\",\"ph\":\"X\",\"pid\":");
+                        at = put_number(at, pid);
+                        at = put_text  (at, ",\"tid\":");
+                        at = put_number(at, c->tid);
+                        at = put_text  (at, ",\"ts\":");
+                        at = put_micros(at, e->start - started);
+                        at = put_text  (at, ",\"dur\":");
+                        at = put_micros(at, e->end - e->start);
+                        at = put_text  (at, "}");
+                        first = 0;
+                }
+                chunks = c->next;
+                free(c);
+        }
+        fwrite(buffer, 1, at - buffer, out);
+        free(buffer);
+        fprintf(out, "\n]}\n");
+        my_chunk = NULL;
+#endif
+}
+
+#ifdef COMP40_PROFILE
+/*
+ * [Name]:       put_text
+ * [Parameters]: 1 char* (at: where to write), 1 const char* (text)
+ * [Return]:     the end of what was written
+ * [Purpose]:    Copies text, without its terminating null, into a trace line
+ * [Errors]:     None (the line must have room)
+ */
+char *put_text(char *at, const char *text)
+{
+        while (*text != '\0') {
+                *at++ = *text++;
+        }
+
+        return at;
+}
+
+/*
+ * [Name]:       put_number
+ * [Parameters]: 1 char* (at: where to write), 1 unsigned long long (value)
+ * [Return]:     the end of what was written
+ * [Purpose]:    Writes value in decimal into a trace line
+ * [Errors]:     None (the line must have room for 20 digits)
+ */
+char *put_number(char *at, unsigned long long value)
+{
+        char digits[20];
+        int  n = 0;
+
+        do {
+                digits[n++] = '0' + value % 10;
+                value /= 10;
+        } while (value != 0);
+        while (n > 0) {
+                *at++ = digits[--n];
+        }
+
+        return at;
+}
+
+/*
+ * [Name]:       put_micros
+ * [Parameters]: 1 char* (at: where to write), 1 uint64_t (ns)
+ * [Return]:     the end of what was written
+ * [Purpose]:    Writes ns as microseconds with three decimals, the unit of
+ *               Chrome trace timestamps, into a trace line
+ * [Errors]:     None (the line must have room)
+ */
+char *put_micros(char *at, uint64_t ns)
+{
+        at    = put_number(at, ns / 1000);
+        *at++ = '.';
+        *at++ = '0' + ns / 100 % 10;
+        *at++ = '0' + ns / 10 % 10;
+        *at++ = '0' + ns % 10;
+
+        return at;
+}
+
+/*
+ * [Name]:       print_counters
+ * [Parameters]: 1 FILE* (out)
+ * [Return]:     void
+ * [Purpose]:    Prints the table of each stage's hardware counts per block,
+ *               one column per counter that counted on every thread, or
+ *               why there are none
+ * [Errors]:     None
+ */
+void print_counters(FILE *out)
+{
+        if (counting == 0) {
+                fprintf(out, "counters: unavailable (%s)\n",
+                        counters_error());
+                return;
+        }
+
+        fprintf(out, "counters: per block, user space only\n%-10s %-8s",
+                "direction", "stage");
+        for (int i = 0; i < COUNTERS; i++) {
+                if ((counting & (1u << i)) != 0) {
+                        fprintf(out, " %13s", counter_name(i));
+                }
+        }
+        fprintf(out, "\n");
+
+        for (int dir = 0; dir < PROFILE_DIRECTIONS; dir++) {
+                for (int i = 0; i < PROFILE_STAGES; i++) {
+                        int                        s = ORDER[dir][i];
+                        const struct stage_totals *t = &totals[dir][s];
+                        if (t->calls == 0) {
+                                continue;
+                        }
+                        double blocks = t->blocks > 0 ? t->blocks : 1;
+
+                        fprintf(out, "%-10s %-8s", DIRECTION_NAMES[dir],
+                                STAGE_NAMES[s]);
+                        for (int c = 0; c < COUNTERS; c++) {
+                                if ((counting & (1u << c)) != 0) {
+                                        fprintf(out, " %13.2f",
+                                                t->counts[c] / blocks);
+                                }
+                        }
+                        fprintf(out, "\n");
+                }
+        }
+}
+
+/*
+ * [Name]:       json_counters
+ * [Parameters]: 1 FILE* (out), 1 const struct stage_totals* (t)
+ * [Return]:     void
+ * [Purpose]:    Writes , "counters_per_block": { name: count } for one
+ *               stage, if counters are on, with every counter that counted
+ *               on every thread
+ * [Errors]:     None
+ */
+void json_counters(FILE *out, const struct stage_totals *t)
+{
+        if (!counters) {
+                return;
+        }
+        double blocks = t->blocks > 0 ? t->blocks : 1;
+
+        fprintf(out, ", \"counters_per_block\": {");
+        for (int c = 0, n = 0; c < COUNTERS; c++) {
+                if ((counting & (1u << c)) != 0) {
+                        fprintf(out, "%s\"%s\": %.3f", n++ > 0 ? ", " : "",
+                                counter_name(c), t->counts[c] / blocks);
+                }
+        }
+        fprintf(out, "}");
+}
+#endif /* COMP40_PROFILE */
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -0,0 +1,118 @@
+/*
+ *      profile.h
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Header file declaring client-accessible functions for the
+ *        profile component
+ *      - Component times each stage of the compress and decompress
+ *        pipelines where compress40.c dispatches to ImageMethods_T (and
+ *        reads and writes codewords), on every thread, and reports the
+ *        totals (40image --profile, --profile-json)
+ *      - The same build counts every call of the Hanson allocator (the
+ *        Makefile links the Mem_* functions through profile.c's wrappers):
+ *        allocations, bytes and peak live bytes of each stage, and of the
+ *        whole run next to the process's peak RSS
+ *      - On request (40image --counters), also the hardware counters of the
+ *        counters component around each stage, reported per block; counters
+ *        the system refuses are reported as unavailable
+ *      - With 40image -c --verify, also the round trip's sampled quality
+ *        (RMS error, its 95% bounds, blocks sampled and in the image)
+ *      - With tracing on (40image --trace FILE), every stage call, and the
+ *        named spans around tiles, frames and queue waits, is recorded as a
+ *        Chrome trace event of its thread, for chrome://tracing or Perfetto
+ *      - Instrumentation is built only with -DCOMP40_PROFILE (make profile;
+ *        default builds leave it out): otherwise PROFILE_START and
+ *        PROFILE_STOP compile to nothing, and profile_compiled returns 0
+ */
+
+#ifndef PROFILE_INCLUDED
+#define PROFILE_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "counters.h"
+#include "pixelblock.h"
+
+/* Directions, and the stages of each (named after the ImageMethods_T) */
+enum { PROFILE_COMPRESS, PROFILE_DECOMPRESS, PROFILE_DIRECTIONS };
+enum { PROFILE_READ, PROFILE_RGB_XYZ, PROFILE_CHROMA, PROFILE_LUMA,
+       PROFILE_PIXPACK, PROFILE_WRITE, PROFILE_STAGES };
+
+/* Bytes of n blocks in each form the stages pass on: pixmap samples, RGB
+ * and XYZ pixels, bit_blocks and codewords (before any tile coding) */
+#define PROFILE_PIXMAP_BYTES(n) ((uint64_t)(n) * 12)
+#define PROFILE_RGB_BYTES(n)    ((uint64_t)(n) * 4 * sizeof(struct RGB_px))
+#define PROFILE_XYZ_BYTES(n)    ((uint64_t)(n) * 4 * sizeof(struct XYZ_px))
+#define PROFILE_BIT_BYTES(n)    ((uint64_t)(n) * sizeof(struct bit_block))
+#define PROFILE_WORD_BYTES(n)   ((uint64_t)(n) * sizeof(uint32_t))
+
+#ifdef COMP40_PROFILE
+
+/* Clocks and this thread's allocation counts at the start of a stage */
+typedef struct Profile_mark {
+        uint64_t wall, cpu;          /* ns: monotonic, and this thread's */
+        uint64_t allocs, bytes;      /* allocations made, and their bytes */
+        int64_t  live, peak;         /* live bytes, and the enclosing peak */
+        uint64_t counts[COUNTERS];   /* this thread's hardware counters */
+} Profile_mark;
+
+extern Profile_mark profile_start(void);
+extern void         profile_stop (Profile_mark mark, int direction,
+                                  int stage, uint64_t blocks,
+                                  uint64_t bytes_in, uint64_t bytes_out);
+
+/*
+ * PROFILE_START declares mark and starts timing a stage; PROFILE_STOP adds
+ * its wall and CPU time, blocks, bytes, allocations and counters to the
+ * stage's totals (only once profile_enable has been called)
+ */
+#define PROFILE_START(mark) Profile_mark mark = profile_start()
+#define PROFILE_STOP(mark, direction, stage, blocks, bytes_in, bytes_out) \
+        profile_stop(mark, direction, stage, blocks, bytes_in, bytes_out)
+
+extern uint64_t profile_span_start(void);
+extern void     profile_span_stop (uint64_t start, const char *name);
+
+/*
+ * PROFILE_SPAN_START declares mark and starts a span of the trace (only
+ * if tracing); PROFILE_SPAN_STOP records it under name, which must be a
+ * string constant (it is kept, not copied)
+ */
+#define PROFILE_SPAN_START(mark) uint64_t mark = profile_span_start()
+#define PROFILE_SPAN_STOP(mark, name) profile_span_stop(mark, name)
+
+#else
+
+/* Nothing is evaluated (sizeof only marks the arguments as used) */
+#define PROFILE_START(mark)
+#define PROFILE_STOP(mark, direction, stage, blocks, bytes_in, bytes_out) \
+        ((void)sizeof((blocks) + (bytes_in) + (bytes_out)))
+#define PROFILE_SPAN_START(mark)
+#define PROFILE_SPAN_STOP(mark, name) ((void)0)
+
+#endif /* COMP40_PROFILE */
+
+/*
+ * profile_compiled tells whether the instrumentation was built in;
+ * profile_enable starts recording and counting allocations (before any
+ * pipeline runs), and hardware counters too if counters is nonzero; and
+ * profile_print prints every stage that ran, the memory totals and the
+ * counters, as tables or (if json is nonzero) a JSON object;
+ * profile_quality records the fields of a --verify run's Comp40_quality
+ * (only once profile_enable has been called) for profile_print to report
+ * profile_trace starts recording the trace alone (with or without
+ * profile_enable, which it does not imply), and profile_trace_write
+ * writes every event recorded, once all threads that recorded have been
+ * joined, in the Chrome trace-event JSON format, then frees them
+ * CRE: out cannot be NULL
+ */
+extern int  profile_compiled   (void);
+extern void profile_enable     (int counters);
+extern void profile_print      (FILE *out, int json);
+extern void profile_quality    (double rms, double rms_low, double rms_high,
+                                unsigned sampled, unsigned blocks);
+extern void profile_trace      (void);
+extern void profile_trace_write(FILE *out);
+
+#endif /* PROFILE_INCLUDED */
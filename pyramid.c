@@ -0,0 +1,390 @@
+/*
+ *      pyramid.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the pyramid function for 40image
+ *      - Pyramid: Reads a COMP40 image (or a portable pixmap, compressed
+ *                 once) from the input stream, and writes it and every
+ *                 halving of it as COMP40 files "<prefix>-<level>.c40",
+ *                 level 0 being the full image
+ *      - Each block of level k + 1 covers a 2x2 square of blocks of level k,
+ *        and its four pixels are those blocks' means: their a fields are the
+ *        pixels' lumas, and their Pb and Pr the pixels' chromas. The block
+ *        is quantized by the same luma_to_bit and chroma_to_bit as the
+ *        compress pipeline, so its b, c and d come from the four a fields
+ *      - Invariants:
+ *              ~ No codeword is decoded with the inverse DCT
+ *              ~ All levels are written in one pass over the block rows of
+ *                level 0; a portable pixmap is read and compressed two
+ *                pixel rows at a time, and each level holds only the block
+ *                row waiting for its pair, so memory is bounded by a few
+ *                rows (format 2)
+ *              ~ Like compress40, a level with an odd number of block rows
+ *                or columns drops the last one from the next level
+ *              ~ Levels stop before one is less than 1 block wide or high
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arith40.h"
+#include "assert.h"
+#include "chroma_bit.h"
+#include "codeword_io.h"
+#include "compress40ext.h"
+#include "imagemethods.h"
+#include "luma_bit.h"
+#include "mem.h"
+#include "pixpack.h"
+#include "ppmread.h"
+#include "uarray.h"
+
+/* -- struct Pnm_ppm is from pnm.h -- */
+typedef struct Pnm_ppm *ppm;
+
+/* -- One level of the pyramid being written -- */
+struct level {
+        unsigned       bw, bh;        /* in blocks                         */
+        unsigned       rows;          /* block rows written so far         */
+        FILE          *output;
+        int            tiled;         /* nonzero: format 3                 */
+        UArray_T       codewords;     /* one row, or (tiled) all rows      */
+        struct XYZ_px *upper;         /* means of the row awaiting a pair, */
+        int            have_upper;    /*  one per block of the level below */
+        struct XYZ_px *lower;         /* means of its pair (scratch)       */
+        UArray_T       next;          /* row made for the level above      */
+};
+
+/* -- A portable pixmap, read one block row (two pixel rows) at a time -- */
+struct ppm_rows {
+        Ppm_reader     reader;
+        ppm            band;             /* width x 2 pixels, reused      */
+};
+
+/* -- Output format of every level -- */
+struct pyramid_format {
+        unsigned    tile;             /* 0 for format 2                    */
+        const char *coding;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- PYRAMID HELPER FUNCTIONS -- */
+struct level *open_levels (const char *prefix, unsigned bw, unsigned bh,
+                           const struct pyramid_format *format,
+                           unsigned *num_levels);
+void          close_levels(struct level *levels, unsigned num_levels,
+                           const struct pyramid_format *format);
+void          put_row     (struct level *levels, unsigned k,
+                           unsigned num_levels, UArray_T row);
+void          halve_rows  (const struct XYZ_px *upper,
+                           const struct XYZ_px *lower, UArray_T row);
+void          row_means   (UArray_T row, struct XYZ_px *means);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- PIXMAP HELPER FUNCTIONS -- */
+void open_rows (FILE *input, struct ppm_rows *rows);
+void read_rows (struct ppm_rows *rows, UArray_T codewords);
+void close_rows(struct ppm_rows *rows);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                      PYRAMID FUNCTION                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       pyramid40
+ * [Parameters]: 1 FILE* (input), 1 const char* (prefix of the levels' file
+ *               names), 1 unsigned (tile side in blocks, or 0 for format 2),
+ *               1 const char* (coding of the tiles)
+ * [Return]:     void
+ * [Purpose]:    Writes the pyramid of the image on input stream, a COMP40
+ *               image or a portable pixmap (told apart by its first byte),
+ *               one file per level
+ *               Note: Does not modify or close input
+ * [Errors]:     CRE if input or prefix is NULL, tile is not 0 and coding is
+ *                   not known, or a level cannot be written
+ */
+void pyramid40(FILE *input, const char *prefix, unsigned tile,
+               const char *coding)
+{
+        assert(input != NULL && prefix != NULL);
+
+        struct pyramid_format format = { tile, coding };
+        int first = getc(input);
+        assert(first != EOF);
+        ungetc(first, input);
+
+        Comp40_T        comp40 = NULL;
+        struct ppm_rows pixmap = { .band = NULL };
+        unsigned        bw, bh;
+        if (first == 'P') {
+                open_rows(input, &pixmap);
+                bw = pixmap.reader.width  / 2;
+                bh = pixmap.reader.height / 2;
+        } else {
+                comp40 = Comp40_open(input);
+                bw     = Comp40_info(comp40).width  / 2;
+                bh     = Comp40_info(comp40).height / 2;
+        }
+
+        unsigned      num_levels;
+        struct level *levels = open_levels(prefix, bw, bh, &format,
+                                           &num_levels);
+
+        /* Feed level 0 one block row at a time; it cascades upwards */
+        UArray_T row = UArray_new(bw, sizeof(uint32_t));
+        for (unsigned y = 0; y < bh; y++) {
+                if (comp40 != NULL) {
+                        row = Comp40_rect(comp40, 0, y, bw, 1, row);
+                } else {
+                        read_rows(&pixmap, row);
+                }
+                put_row(levels, 0, num_levels, row);
+        }
+
+        close_levels(levels, num_levels, &format);
+        UArray_free(&row);
+        if (comp40 != NULL) {
+                Comp40_close(&comp40);
+        } else {
+                close_rows(&pixmap);
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                  PYRAMID HELPER FUNCTIONS                    |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       open_levels
+ * [Parameters]: 1 const char* (prefix), 2 unsigned integers (size of level
+ *               0 in blocks), 1 const struct pyramid_format*, 1 unsigned*
+ *               (num_levels, set)
+ * [Return]:     malloc'd array of the levels, each with its file open (and,
+ *               for format 2, its header written)
+ * [Purpose]:    Sizes every level up front, since headers come first
+ * [Errors]:     CRE if a level's file cannot be opened
+ */
+struct level *open_levels(const char *prefix, unsigned bw, unsigned bh,
+                          const struct pyramid_format *format,
+                          unsigned *num_levels)
+{
+        unsigned n = 1;
+        for (unsigned w = bw, h = bh; w / 2 > 0 && h / 2 > 0; w /= 2, h /= 2) {
+                n++;
+        }
+
+        struct level *levels = ALLOC(n * sizeof(*levels));
+        char         *path   = ALLOC(strlen(prefix) + 32);
+
+        for (unsigned k = 0; k < n; k++, bw /= 2, bh /= 2) {
+                struct level *level = &levels[k];
+                level->bw   = bw;
+                level->bh   = bh;
+                level->rows = 0;
+
+                sprintf(path, "%s-%u.c40", prefix, k);
+                level->output = fopen(path, "wb");
+                assert(level->output != NULL);
+                level->tiled  = format->tile != 0;
+
+                if (!level->tiled) {
+                        write_header(level->output, 2 * bw, 2 * bh);
+                        level->codewords = UArray_new(bw, sizeof(uint32_t));
+                } else {
+                        level->codewords = UArray_new(bw * bh,
+                                                      sizeof(uint32_t));
+                }
+
+                /* The level above pairs up this level's rows */
+                level->upper      = ALLOC((bw + 1) * sizeof(*level->upper));
+                level->have_upper = 0;
+                level->lower      = ALLOC((bw + 1) * sizeof(*level->lower));
+                level->next       = UArray_new(bw / 2, sizeof(uint32_t));
+        }
+
+        FREE(path);
+        *num_levels = n;
+
+        return levels;
+}
+
+/*
+ * [Name]:       close_levels
+ * [Parameters]: 1 struct level* (levels), 1 unsigned (num_levels), 1 const
+ *               struct pyramid_format*
+ * [Return]:     void
+ * [Purpose]:    Finishes every level's file (format 3 writes its tiles now)
+ *               and frees the levels
+ * [Errors]:     CRE if a file cannot be written
+ */
+void close_levels(struct level *levels, unsigned num_levels,
+                  const struct pyramid_format *format)
+{
+        for (unsigned k = 0; k < num_levels; k++) {
+                struct level *level = &levels[k];
+                assert(level->rows == level->bh);
+
+                if (level->tiled) {
+                        write_tiled(level->output, level->codewords,
+                                    2 * level->bw, 2 * level->bh,
+                                    format->tile, format->coding);
+                }
+                int err = fclose(level->output);
+                assert(err == 0);
+
+                UArray_free(&level->codewords);
+                UArray_free(&level->next);
+                FREE(level->upper);
+                FREE(level->lower);
+        }
+
+        FREE(levels);
+}
+
+/*
+ * [Name]:       put_row
+ * [Parameters]: 1 struct level* (levels), 1 unsigned (k, level of the row),
+ *               1 unsigned (num_levels), 1 UArray_T (row: one block row of
+ *               level k's codewords)
+ * [Return]:     void
+ * [Purpose]:    Writes the row to level k; every second row, also makes the
+ *               matching row of level k + 1 from this row and the one
+ *               before, and puts that
+ * [Errors]:     None
+ */
+void put_row(struct level *levels, unsigned k, unsigned num_levels,
+             UArray_T row)
+{
+        struct level *level = &levels[k];
+        if (level->rows == level->bh) {
+                return;       /* odd last row, trimmed by the level below */
+        }
+
+        if (level->tiled) {
+                memcpy(UArray_at(level->codewords, level->rows * level->bw),
+                       UArray_at(row, 0), level->bw * sizeof(uint32_t));
+        } else {
+                write_codewords(level->output, row);
+        }
+        level->rows++;
+
+        if (k + 1 == num_levels) {
+                return;
+        }
+
+        if (!level->have_upper) {
+                row_means(row, level->upper);
+                level->have_upper = 1;
+                return;
+        }
+
+        row_means(row, level->lower);
+        level->have_upper = 0;
+
+        halve_rows(level->upper, level->lower, level->next);
+        put_row(levels, k + 1, num_levels, level->next);
+}
+
+/*
+ * [Name]:       halve_rows
+ * [Parameters]: 2 const struct XYZ_px* (means of two consecutive block rows
+ *               of a level), 1 UArray_T (row: filled with the row of the
+ *               level above)
+ * [Return]:     void
+ * [Purpose]:    Quantizes each 2x2 square of block means as one block
+ * [Errors]:     None
+ */
+void halve_rows(const struct XYZ_px *upper, const struct XYZ_px *lower,
+                UArray_T row)
+{
+        struct XYZ_px    px[4];
+        struct XYZ_block xyz = { &px[0], &px[1], &px[2], &px[3] };
+        struct bit_block bit;
+
+        for (int j = 0; j < UArray_length(row); j++) {
+                px[0] = upper[2 * j];
+                px[1] = upper[2 * j + 1];
+                px[2] = lower[2 * j];
+                px[3] = lower[2 * j + 1];
+
+                luma_to_bit(&xyz, &bit);
+                chroma_to_bit(&xyz, &bit);
+                *(uint32_t *)UArray_at(row, j) = pack(&bit);
+        }
+}
+
+/*
+ * [Name]:       row_means
+ * [Parameters]: 1 UArray_T (one block row of codewords), 1 struct XYZ_px*
+ *               (means: filled, one per block)
+ * [Return]:     void
+ * [Purpose]:    Gets each block's mean luma and chroma from its a, Pb and Pr
+ *               fields alone
+ * [Errors]:     None
+ */
+void row_means(UArray_T row, struct XYZ_px *means)
+{
+        struct bit_block bit;
+
+        for (int j = 0; j < UArray_length(row); j++) {
+                unpack_dc(*(uint32_t *)UArray_at(row, j), &bit);
+                means[j].luma = bit_to_avg_luma(bit.a);
+                means[j].Pb   = Arith40_chroma_of_index(bit.Pb);
+                means[j].Pr   = Arith40_chroma_of_index(bit.Pr);
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                   PIXMAP HELPER FUNCTIONS                    |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       open_rows
+ * [Parameters]: 1 FILE* (input, at a portable pixmap), 1 struct ppm_rows*
+ *               (rows, filled)
+ * [Return]:     void
+ * [Purpose]:    Reads the pixmap's header, and makes the two-row band its
+ *               block rows are read into
+ * [Errors]:     CRE if the header is not of a plain or raw pixmap, or the
+ *                   pixmap has no block
+ */
+void open_rows(FILE *input, struct ppm_rows *rows)
+{
+        Ppm_open(input, &rows->reader);
+        assert(rows->reader.width >= 2 && rows->reader.height >= 2);
+
+        rows->band = new_ppm(rows->reader.width, 2);
+}
+
+/*
+ * [Name]:       read_rows
+ * [Parameters]: 1 struct ppm_rows*, 1 UArray_T (codewords: one block row)
+ * [Return]:     void
+ * [Purpose]:    Reads the next two pixel rows into the band and runs the
+ *               compress pipeline on them, filling codewords
+ *               Note: The pipeline trims the band (a last, odd column is
+ *                     read, then dropped, as compress40 drops it) and
+ *                     scales it; Ppm_read resets both for every block row
+ * [Errors]:     CRE if the input ends early
+ */
+void read_rows(struct ppm_rows *rows, UArray_T codewords)
+{
+        Ppm_read(&rows->reader, rows->band, 2);
+        compress_pixmap(rows->band, codewords);
+}
+
+/*
+ * [Name]:       close_rows
+ * [Parameters]: 1 struct ppm_rows*
+ * [Return]:     void
+ * [Purpose]:    Frees the band (rows of the pixmap past the last block row
+ *               are left unread)
+ * [Errors]:     None
+ */
+void close_rows(struct ppm_rows *rows)
+{
+        Pnm_ppmfree(&rows->band);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
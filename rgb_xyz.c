@@ -26,7 +26,6 @@ XYZ_px to_float    (RGB_px rgb);
 
 /* -- DECOMPRESS HELPER FUNCTIONS -- */
 RGB_px to_int      (XYZ_px xyz);
-RGB_px quantize_RGB(float r, float g, float b);
 float  scale_RGB   (float value);
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
@@ -116,7 +115,7 @@ RGB_block XYZ_to_RGB(XYZ_block xyz, RGB_block rgb)
 }
 
 /*
- * [Name]:       to_float
+ * [Name]:       to_int
  * [Parameters]: 1 XYZ_px
  * [Return]:     RGB_px, containing values converted from XYZ_px
  *               Note: Range of rgb values is [0, RGB_MAX]
@@ -130,36 +129,35 @@ RGB_px to_int(XYZ_px xyz)
 {
         assert(xyz != NULL);
 
-        float y  = xyz->luma;
-        float pb = xyz->Pb;
-        float pr = xyz->Pr;
-        float r, g, b;
+        RGB_px rgb;
+        NEW(rgb);
 
-        r = 1.0 * y + 0.0      * pb + 1.402    * pr;
-        g = 1.0 * y - 0.344136 * pb - 0.714136 * pr;
-        b = 1.0 * y + 1.772    * pb + 0.0      * pr;
+        *rgb = XYZ_px_to_RGB(*xyz);
 
-        return quantize_RGB(r, g, b);
+        return rgb;
 }
 
 /*
- * [Name]:       quantize_RGB
- * [Parameters]: 3 floats (red, green, blue values)
- * [Return]:     RGB_px, containing quantized RGB values
+ * [Name]:       XYZ_px_to_RGB
+ * [Parameters]: 1 struct XYZ_px
+ * [Return]:     struct RGB_px, containing quantized RGB values
  *               Note: Range of rgb values is [0, RGB_MAX]
- * [Purpose]:    Converts pixel values from scaled to quantized RGB
- *               Note: Memory for pixel needs to be freed (free_RGB_block)
- * [Errors]:     URE if client loses pointer to returned pixel
+ * [Purpose]:    Converts one pixel value from XYZ to RGB color space by value,
+ *               for callers that don't keep pixels in blocks
+ * [Errors]:     None
  */
-RGB_px quantize_RGB(float r, float g, float b)
+struct RGB_px XYZ_px_to_RGB(struct XYZ_px xyz)
 {
-        RGB_px rgb;
-        NEW(rgb);
+        float y  = xyz.luma;
+        float pb = xyz.Pb;
+        float pr = xyz.Pr;
+        float r, g, b;
 
-        rgb->r = scale_RGB(r);
-        rgb->g = scale_RGB(g);
-        rgb->b = scale_RGB(b);
+        r = 1.0 * y + 0.0      * pb + 1.402    * pr;
+        g = 1.0 * y - 0.344136 * pb - 0.714136 * pr;
+        b = 1.0 * y + 1.772    * pb + 0.0      * pr;
 
+        struct RGB_px rgb = { scale_RGB(r), scale_RGB(g), scale_RGB(b) };
         return rgb;
 }
 
@@ -224,4 +222,4 @@ void free_RGB_block(RGB_block rgb)
         FREE(rgb->botL);
         FREE(rgb->botR);
 }
-/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
\ No newline at end of file
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
\ No newline at end of file
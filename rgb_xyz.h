@@ -25,6 +25,11 @@ extern XYZ_block RGB_to_XYZ(RGB_block rgb, XYZ_block xyz);
  * CRE: parameters cannot be NULL
  */
 extern RGB_block XYZ_to_RGB(XYZ_block xyz, RGB_block rgb);
+
+/*
+ * Returns the RGB value (range [0, RGB_MAX]) of a single XYZ pixel
+ */
+extern struct RGB_px XYZ_px_to_RGB(struct XYZ_px xyz);
 /* ^^^^^^^^^^^^^^^^^^^^^^^^^^ */
 
 /* -- MEMORY FUNCTIONS -- */
@@ -36,4 +41,4 @@ extern void free_XYZ_block(XYZ_block xyz);
 extern void free_RGB_block(RGB_block rgb);
 /* ^^^^^^^^^^^^^^^^^^^^^^ */
 
-#endif /* RGBXYZ_INCLUDED */
\ No newline at end of file
+#endif /* RGBXYZ_INCLUDED */
\ No newline at end of file
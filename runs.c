@@ -0,0 +1,97 @@
+/*
+ *      runs.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Component file defining all extern functions for the runs component
+ *      - Component finds runs of identical consecutive blocks, and moves
+ *        blocks between a full UArray and a UArray of one block per run
+ *      - Component-wide invariants:
+ *              ~ Run numbers start at 0 and never decrease along the UArray,
+ *                so runs[i] is also the index of block i's run in the
+ *                gathered UArray
+ */
+
+#include <string.h>
+
+#include "assert.h"
+#include "runs.h"
+
+/*---------------------------------------------------------------
+ |                        RUNS FUNCTIONS                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       find_runs
+ * [Parameters]: 1 UArray (blocks), 1 Runs_equal* (block comparison), 1
+ *               UArray (runs, of unsigned)
+ * [Return]:     number of runs found
+ * [Purpose]:    Numbers the runs of identical consecutive blocks, storing
+ *               each block's run number in runs
+ * [Errors]:     CRE if any parameter is NULL or runs has the wrong length
+ */
+unsigned find_runs(UArray_T blocks, Runs_equal *equal, UArray_T runs)
+{
+        assert(blocks != NULL && equal != NULL && runs != NULL);
+        assert(UArray_length(runs) == UArray_length(blocks));
+        assert(UArray_size(runs) == sizeof(unsigned));
+
+        unsigned num_runs = 0;
+
+        for (int i = 0; i < UArray_length(blocks); i++) {
+                if (i == 0 || !equal(UArray_at(blocks, i - 1),
+                                     UArray_at(blocks, i))) {
+                        num_runs++;
+                }
+                *(unsigned *)UArray_at(runs, i) = num_runs - 1;
+        }
+
+        return num_runs;
+}
+
+/*
+ * [Name]:       gather_runs
+ * [Parameters]: 2 UArrays (blocks, runs), 1 unsigned (number of runs)
+ * [Return]:     new UArray with the first block of every run
+ * [Purpose]:    Picks out the blocks a pipeline has to work on
+ * [Errors]:     CRE if any parameter is NULL
+ */
+UArray_T gather_runs(UArray_T blocks, UArray_T runs, unsigned num_runs)
+{
+        assert(blocks != NULL && runs != NULL);
+
+        int      size       = UArray_size(blocks);
+        UArray_T run_blocks = UArray_new(num_runs, size);
+
+        for (int i = UArray_length(blocks) - 1; i >= 0; i--) {
+                unsigned run = *(unsigned *)UArray_at(runs, i);
+                memcpy(UArray_at(run_blocks, run), UArray_at(blocks, i),
+                       size);
+        }
+
+        return run_blocks;
+}
+
+/*
+ * [Name]:       scatter_runs
+ * [Parameters]: 3 UArrays (run_blocks, runs, blocks)
+ * [Return]:     blocks, with every block set to the block of its run
+ * [Purpose]:    Copies a pipeline's result for each run to all of the run's
+ *               blocks
+ * [Errors]:     CRE if any parameter is NULL or the UArrays do not match
+ */
+UArray_T scatter_runs(UArray_T run_blocks, UArray_T runs, UArray_T blocks)
+{
+        assert(run_blocks != NULL && runs != NULL && blocks != NULL);
+        assert(UArray_length(blocks) == UArray_length(runs));
+        assert(UArray_size(blocks) == UArray_size(run_blocks));
+
+        int size = UArray_size(blocks);
+
+        for (int i = 0; i < UArray_length(blocks); i++) {
+                unsigned run = *(unsigned *)UArray_at(runs, i);
+                memcpy(UArray_at(blocks, i), UArray_at(run_blocks, run),
+                       size);
+        }
+
+        return blocks;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -0,0 +1,45 @@
+/*
+ *      runs.h
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - Header file declaring client-accessible functions for the
+ *        runs component
+ *      - Component finds runs of identical consecutive blocks (as found in
+ *        screenshots and other synthetic images), so that a pipeline can
+ *        work on one block per run and copy the result to the rest
+ *      - Blocks are compared and copied shallowly: a gathered or scattered
+ *        UArray shares any memory its elements point to with the original,
+ *        and must be freed with UArray_free alone
+ */
+
+#ifndef RUNS_INCLUDED
+#define RUNS_INCLUDED
+
+#include "uarray.h"
+
+/* Tells whether two blocks (elements of the same UArray) are identical */
+typedef int Runs_equal(const void *block1, const void *block2);
+
+/*
+ * Fills runs (a UArray of unsigned, as long as blocks) with the run number of
+ * each block: a block identical to the one before it shares its run
+ * Returns the number of runs
+ * CRE: parameters cannot be NULL, runs must be as long as blocks
+ */
+extern unsigned find_runs(UArray_T blocks, Runs_equal *equal, UArray_T runs);
+
+/*
+ * Returns a new UArray holding the first block of each of the num_runs runs
+ * CRE: parameters cannot be NULL
+ */
+extern UArray_T gather_runs(UArray_T blocks, UArray_T runs, unsigned num_runs);
+
+/*
+ * Inverse of gather_runs: fills blocks (as long as runs) with the block of
+ * each block's run from run_blocks, then returns blocks
+ * CRE: parameters cannot be NULL, element sizes must match
+ */
+extern UArray_T scatter_runs(UArray_T run_blocks, UArray_T runs,
+                             UArray_T blocks);
+
+#endif /* RUNS_INCLUDED */
@@ -0,0 +1,378 @@
+/*
+ *      stats.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the statistics functions for 40image
+ *      - Stats: Reads a compressed COMP40 image from the input stream and
+ *               computes, from its codeword fields alone:
+ *              ~ A histogram of block mean lumas (the a field)
+ *              ~ The mean luma, chroma and RGB color of the image
+ *              ~ The mean variance of the luma within a block: the 2x2 DCT
+ *                is orthogonal, so it is b^2 + c^2 + d^2
+ *              ~ A 64-bit perceptual hash of the image's block means: the
+ *                a fields are averaged down to HASH_SIDE x HASH_SIDE, and
+ *                each bit tells whether one of the lowest-frequency DCT
+ *                coefficients of that thumbnail is above their median
+ *      - Fields are extracted from LANES codewords at a time with vector
+ *        shifts and masks; chroma is histogrammed by index, so no float is
+ *        computed per block
+ *      - Invariants:
+ *              ~ No codeword is decoded, and input is read one block row
+ *                at a time
+ *              ~ Works on both flat (2) and tiled (3) COMP40 formats
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arith40.h"
+#include "assert.h"
+#include "codeword_io.h"
+#include "compress40ext.h"
+#include "luma_bit.h"
+#include "mem.h"
+#include "rgb_xyz.h"
+#include "uarray.h"
+
+/* -- Codewords handled per vector operation -- */
+#define LANES 4
+typedef uint32_t lanes_u __attribute__((vector_size(LANES * 4)));
+typedef int32_t  lanes_s __attribute__((vector_size(LANES * 4)));
+
+/* Side of the thumbnail of block means the perceptual hash is taken of, and
+ * of the square of its DCT coefficients that makes up the hash's 64 bits */
+#define HASH_SIDE 32
+#define HASH_FREQ 8
+
+/* Least significant bits of the fields in a codeword */
+static const int PB_LSB = PR_WIDTH;
+static const int D_LSB  = PR_WIDTH + PB_WIDTH;
+static const int C_LSB  = PR_WIDTH + PB_WIDTH + D_WIDTH;
+static const int B_LSB  = PR_WIDTH + PB_WIDTH + D_WIDTH + C_WIDTH;
+static const int A_LSB  = PR_WIDTH + PB_WIDTH + D_WIDTH + C_WIDTH + B_WIDTH;
+
+/* -- Running totals over the blocks read so far -- */
+struct stats_sums {
+        unsigned long a_count[1 << 6];     /* per value of a (A_WIDTH)   */
+        unsigned long pb_count[1 << 4];    /* per index (PB_WIDTH)       */
+        unsigned long pr_count[1 << 4];    /* per index (PR_WIDTH)       */
+        uint64_t      energy;              /* sum of b^2 + c^2 + d^2     */
+        double        thumb[HASH_SIDE][HASH_SIDE];   /* sums of a        */
+        unsigned long thumb_count[HASH_SIDE][HASH_SIDE];
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- STATS HELPER FUNCTIONS -- */
+void     add_stats_row(const uint32_t *words, unsigned n,
+                       struct stats_sums *sums, unsigned char *row_a);
+void     add_thumb_row(const unsigned char *row_a, unsigned row,
+                       unsigned blocks_wide, unsigned blocks_high,
+                       struct stats_sums *sums);
+void     cell_span    (unsigned cell, unsigned blocks, unsigned *lo,
+                       unsigned *hi);
+uint64_t thumb_hash   (struct stats_sums *sums);
+int      less_double  (const void *x, const void *y);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                       STATS FUNCTIONS                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       stats_of
+ * [Parameters]: 1 FILE* (input)
+ * [Return]:     Comp40_stats of the compressed image on input stream
+ * [Purpose]:    Library call: computes the statistics of an image from its
+ *               codeword fields, without decoding it
+ *               Note: Does not modify or close input
+ * [Errors]:     CRE if input is NULL or the image is malformed
+ */
+Comp40_stats stats_of(FILE *input)
+{
+        assert(input != NULL);
+
+        /* Reading file header */
+        Comp40_T      image  = Comp40_open(input);
+        Comp40_header header = Comp40_info(image);
+
+        unsigned bw = header.width  / 2;
+        unsigned bh = header.height / 2;
+
+        struct stats_sums *sums;
+        NEW0(sums);
+        UArray_T       codewords = UArray_new(bw, sizeof(uint32_t));
+        unsigned char *row_a     = ALLOC(bw + 1);
+
+        for (unsigned row = 0; row < bh; row++) {
+                codewords = Comp40_rect(image, 0, row, bw, 1, codewords);
+                add_stats_row(UArray_at(codewords, 0), bw, sums, row_a);
+                add_thumb_row(row_a, row, bw, bh, sums);
+        }
+        Comp40_close(&image);
+
+        Comp40_stats stats;
+        memset(&stats, 0, sizeof(stats));
+        stats.width  = header.width;
+        stats.height = header.height;
+
+        double blocks = (double)bw * bh;
+        for (unsigned a = 0; a < 1u << A_WIDTH; a++) {
+                stats.luma_histogram[a] = sums->a_count[a];
+                stats.mean_luma += sums->a_count[a] * bit_to_avg_luma(a);
+        }
+        for (unsigned i = 0; i < 1u << PB_WIDTH; i++) {
+                stats.mean_Pb += sums->pb_count[i] *
+                                 Arith40_chroma_of_index(i);
+        }
+        for (unsigned i = 0; i < 1u << PR_WIDTH; i++) {
+                stats.mean_Pr += sums->pr_count[i] *
+                                 Arith40_chroma_of_index(i);
+        }
+        stats.mean_luma /= blocks;
+        stats.mean_Pb   /= blocks;
+        stats.mean_Pr   /= blocks;
+
+        struct XYZ_px mean = { stats.mean_luma, stats.mean_Pb, stats.mean_Pr };
+        struct RGB_px rgb  = XYZ_px_to_RGB(mean);
+        stats.mean_red   = rgb.r;
+        stats.mean_green = rgb.g;
+        stats.mean_blue  = rgb.b;
+
+        double step = bit_to_bcd(1, B_WIDTH);
+        stats.block_variance = sums->energy * step * step / blocks;
+        stats.phash          = thumb_hash(sums);
+
+        FREE(row_a);
+        FREE(sums);
+        UArray_free(&codewords);
+
+        return stats;
+}
+
+/*
+ * [Name]:       stats40
+ * [Parameters]: 1 FILE* (input)
+ * [Return]:     void
+ * [Purpose]:    Sends the statistics of the compressed image on input
+ *               stream on standard output, one "name value..." line each
+ * [Errors]:     CRE if input is NULL or the image is malformed
+ */
+void stats40(FILE *input)
+{
+        Comp40_stats stats = stats_of(input);
+
+        printf("size %u %u\n", stats.width, stats.height);
+        printf("mean_luma %.4f\n", stats.mean_luma);
+        printf("mean_chroma %.4f %.4f\n", stats.mean_Pb, stats.mean_Pr);
+        printf("mean_rgb %.1f %.1f %.1f\n", stats.mean_red, stats.mean_green,
+               stats.mean_blue);
+        printf("block_variance %.6f\n", stats.block_variance);
+        printf("phash %016llx\n", (unsigned long long)stats.phash);
+        printf("luma_histogram");
+        for (unsigned a = 0; a < 1u << A_WIDTH; a++) {
+                printf(" %lu", stats.luma_histogram[a]);
+        }
+        printf("\n");
+}
+
+/*
+ * [Name]:       phash_distance
+ * [Parameters]: 2 uint64_t (perceptual hashes)
+ * [Return]:     number of bits in which the hashes differ
+ * [Purpose]:    Compares hashes: near-duplicate images differ in few bits
+ * [Errors]:     None
+ */
+unsigned phash_distance(uint64_t hash1, uint64_t hash2)
+{
+        return __builtin_popcountll(hash1 ^ hash2);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                    STATS HELPER FUNCTIONS                    |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       add_stats_row
+ * [Parameters]: 1 const uint32_t* (n codewords), 1 unsigned (n), 1 struct
+ *               stats_sums*, 1 unsigned char* (row_a: n a fields, filled)
+ * [Return]:     void
+ * [Purpose]:    Extracts the fields of LANES codewords at once, adding them
+ *               to the histograms and the AC energy, and keeps each a for
+ *               the thumbnail
+ * [Errors]:     None
+ */
+void add_stats_row(const uint32_t *words, unsigned n, struct stats_sums *sums,
+                   unsigned char *row_a)
+{
+        lanes_u energy = { 0 };
+
+        for (unsigned i = 0; i < n; i += LANES) {
+                unsigned count = n - i < LANES ? n - i : LANES;
+                uint32_t group[LANES] = { 0 };
+                memcpy(group, words + i, count * sizeof(uint32_t));
+
+                lanes_u w;
+                memcpy(&w, group, sizeof(w));
+
+                /* Signed fields: move to the top, then shift back down */
+                lanes_s b = (lanes_s)(w << (32 - B_LSB - B_WIDTH))
+                            >> (32 - B_WIDTH);
+                lanes_s c = (lanes_s)(w << (32 - C_LSB - C_WIDTH))
+                            >> (32 - C_WIDTH);
+                lanes_s d = (lanes_s)(w << (32 - D_LSB - D_WIDTH))
+                            >> (32 - D_WIDTH);
+                energy += (lanes_u)(b * b + c * c + d * d);
+
+                lanes_u a  = w >> A_LSB;
+                lanes_u pb = (w >> PB_LSB) & ((1u << PB_WIDTH) - 1);
+                lanes_u pr = w & ((1u << PR_WIDTH) - 1);
+                for (unsigned k = 0; k < count; k++) {
+                        sums->a_count[a[k]]++;
+                        sums->pb_count[pb[k]]++;
+                        sums->pr_count[pr[k]]++;
+                        row_a[i + k] = a[k];
+                }
+
+                /* Each lane gains at most 3 * 32^2 per group: flush early
+                 * enough that no lane can overflow */
+                if ((i / LANES) % (1 << 20) == (1 << 20) - 1) {
+                        for (unsigned k = 0; k < LANES; k++) {
+                                sums->energy += energy[k];
+                                energy[k] = 0;
+                        }
+                }
+        }
+
+        for (unsigned k = 0; k < LANES; k++) {
+                sums->energy += energy[k];
+        }
+}
+
+/*
+ * [Name]:       add_thumb_row
+ * [Parameters]: 1 const unsigned char* (a fields of one block row), 1
+ *               unsigned (the row), 2 unsigned integers (image size in
+ *               blocks), 1 struct stats_sums*
+ * [Return]:     void
+ * [Purpose]:    Adds the row's block means to every thumbnail cell that
+ *               covers them
+ * [Errors]:     None
+ */
+void add_thumb_row(const unsigned char *row_a, unsigned row,
+                   unsigned blocks_wide, unsigned blocks_high,
+                   struct stats_sums *sums)
+{
+        for (unsigned cy = 0; cy < HASH_SIDE; cy++) {
+                unsigned lo_y, hi_y;
+                cell_span(cy, blocks_high, &lo_y, &hi_y);
+                if (row < lo_y || row >= hi_y) {
+                        continue;
+                }
+
+                for (unsigned cx = 0; cx < HASH_SIDE; cx++) {
+                        unsigned lo_x, hi_x;
+                        cell_span(cx, blocks_wide, &lo_x, &hi_x);
+                        for (unsigned bx = lo_x; bx < hi_x; bx++) {
+                                sums->thumb[cy][cx] += row_a[bx];
+                        }
+                        sums->thumb_count[cy][cx] += hi_x - lo_x;
+                }
+        }
+}
+
+/*
+ * [Name]:       cell_span
+ * [Parameters]: 2 unsigned integers (a thumbnail cell along one axis, the
+ *               number of blocks along it), 2 unsigned* (lo, hi: set)
+ * [Return]:     void
+ * [Purpose]:    Gives the blocks [lo, hi) a cell covers: an equal share of
+ *               a large image, and at least one block of a small one
+ * [Errors]:     None
+ */
+void cell_span(unsigned cell, unsigned blocks, unsigned *lo, unsigned *hi)
+{
+        *lo = (uint64_t)cell * blocks / HASH_SIDE;
+        *hi = (uint64_t)(cell + 1) * blocks / HASH_SIDE;
+        if (*hi <= *lo) {
+                *hi = *lo + 1;
+        }
+        if (*hi > blocks) {
+                *lo = blocks - 1;
+                *hi = blocks;
+        }
+}
+
+/*
+ * [Name]:       thumb_hash
+ * [Parameters]: 1 struct stats_sums* (with the thumbnail summed)
+ * [Return]:     the perceptual hash
+ * [Purpose]:    Takes the 2D DCT of the thumbnail of block means, and sets
+ *               one bit per coefficient of the lowest HASH_FREQ x HASH_FREQ
+ *               frequencies (but the mean) that is above their median
+ * [Errors]:     None
+ */
+uint64_t thumb_hash(struct stats_sums *sums)
+{
+        double cosines[HASH_FREQ + 1][HASH_SIDE];
+        for (unsigned u = 0; u <= HASH_FREQ; u++) {
+                for (unsigned x = 0; x < HASH_SIDE; x++) {
+                        cosines[u][x] = cos(M_PI * (2 * x + 1) * u /
+                                            (2 * HASH_SIDE));
+                }
+        }
+
+        /* Means per cell, then the DCT along rows, then along columns */
+        double rows[HASH_SIDE][HASH_FREQ + 1];
+        for (unsigned y = 0; y < HASH_SIDE; y++) {
+                for (unsigned u = 1; u <= HASH_FREQ; u++) {
+                        rows[y][u] = 0;
+                        for (unsigned x = 0; x < HASH_SIDE; x++) {
+                                rows[y][u] += cosines[u][x] *
+                                              sums->thumb[y][x] /
+                                              sums->thumb_count[y][x];
+                        }
+                }
+        }
+
+        double coefficients[HASH_FREQ * HASH_FREQ];
+        for (unsigned v = 1; v <= HASH_FREQ; v++) {
+                for (unsigned u = 1; u <= HASH_FREQ; u++) {
+                        double sum = 0;
+                        for (unsigned y = 0; y < HASH_SIDE; y++) {
+                                sum += cosines[v][y] * rows[y][u];
+                        }
+                        coefficients[(v - 1) * HASH_FREQ + (u - 1)] = sum;
+                }
+        }
+
+        double sorted[HASH_FREQ * HASH_FREQ];
+        memcpy(sorted, coefficients, sizeof(sorted));
+        qsort(sorted, HASH_FREQ * HASH_FREQ, sizeof(double), less_double);
+        double median = (sorted[HASH_FREQ * HASH_FREQ / 2 - 1] +
+                         sorted[HASH_FREQ * HASH_FREQ / 2]) / 2;
+
+        uint64_t hash = 0;
+        for (unsigned i = 0; i < HASH_FREQ * HASH_FREQ; i++) {
+                hash = hash << 1 | (coefficients[i] > median);
+        }
+
+        return hash;
+}
+
+/*
+ * [Name]:       less_double
+ * [Parameters]: 2 const void* (doubles)
+ * [Return]:     negative, zero or positive as x is below, equal to or above y
+ * [Purpose]:    qsort comparison for the median
+ * [Errors]:     None
+ */
+int less_double(const void *x, const void *y)
+{
+        double dx = *(const double *)x;
+        double dy = *(const double *)y;
+
+        return (dx > dy) - (dx < dy);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
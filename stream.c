@@ -0,0 +1,664 @@
+/*
+ *      stream.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the stream compress/decompress functions for
+ *        40image
+ *      - Compress: Reads consecutive portable pixmaps (e.g. camera or render
+ *                  frames) from the input stream and compresses them into
+ *                  one framed COMP40 stream on standard output
+ *      - Decompress: Reads a framed COMP40 stream from the input stream and
+ *                    sends its frames on standard output as concatenated
+ *                    portable pixmaps
+ *      - Stream layout:
+ *              ~ "COMP40 Compressed stream 1\n"
+ *              ~ Then per frame: "I <width> <height>\n", followed by the
+ *                frame's codewords as in format 2 (big-endian, row-major)
+ *              ~ Or, for a frame the size of the one before it,
+ *                "S <width> <height>\n", followed by a skip bitmap of one bit
+ *                per block (row-major, most significant bit first, set if
+ *                the block changed), then the codewords of the changed
+ *                blocks only; unchanged blocks keep the previous frame's
+ *                pixels (written with 40image -c --stream --temporal)
+ *              ~ The stream ends at end of input; frames may differ in size
+ *      - Invariants:
+ *              ~ A reader thread reads frame N + 1 while frame N is being
+ *                coded, with at most one frame waiting between them (on a
+ *                single processor, frames are read inline instead: there is
+ *                nothing to overlap, and a second thread slows malloc down)
+ *              ~ Buffers are reused from frame to frame while the frame size
+ *                stays the same
+ *              ~ A block is skipped only if its input pixels are identical to
+ *                the previous frame's, so skipping never changes the output
+ *              ~ Only the changed blocks of an "S" frame go through the
+ *                pipeline, when compressing and when decompressing
+ */
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "a2methods.h"
+#include "assert.h"
+#include "codeword_io.h"
+#include "compress40ext.h"
+#include "imagemethods.h"
+#include "mem.h"
+#include "ppmread.h"
+#include "profile.h"
+#include "uarray.h"
+
+/* -- struct Pnm_ppm is from pnm.h -- */
+typedef struct Pnm_ppm *ppm;
+
+/* Version of the stream layout written by compress40_stream */
+static const unsigned STREAM_VERSION = 1;
+
+/* -- One compressed frame, as read by the decompress reader thread -- */
+struct coded_frame {
+        char     type;                /* 'I': all codewords follow,     */
+                                      /* 'S': changed codewords follow  */
+        unsigned width, height;       /* in pixels                      */
+        UArray_T codewords;
+        UArray_T indices;             /* 'S': blocks of the codewords   */
+};
+
+/* -- Byte buffer of the decompress reader thread, reused across frames -- */
+struct byte_buffer {
+        unsigned char *bytes;
+        size_t         cap;
+};
+
+/* -- Input pixmaps done with, kept for the reader thread to read into -- */
+struct pixmap_pool {
+        ppm             spare[2];     /* oldest first; more are freed   */
+        unsigned        count;
+        pthread_mutex_t lock;
+};
+
+/* -- Read-ahead state shared by a reader thread and the coding thread -- */
+struct prefetch {
+        FILE            *input;
+        void          *(*read)(FILE *input, void *cl);
+        void            *cl;          /* closure of read                */
+        void            *frame;       /* frame read ahead, NULL at end  */
+        int              full;        /* frame is waiting to be taken   */
+        int              threaded;    /* 0: next_frame reads inline     */
+        pthread_mutex_t  lock;
+        pthread_cond_t   changed;
+        pthread_t        thread;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- FRAME READER FUNCTIONS -- */
+void *read_pixmap(FILE *input, void *cl);
+void *read_coded (FILE *input, void *cl);
+unsigned char *reserve_buffer(struct byte_buffer *buffer, size_t bytes);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- PIXMAP POOL FUNCTIONS -- */
+ppm  take_pixmap(struct pixmap_pool *pool, unsigned width, unsigned height);
+void give_pixmap(struct pixmap_pool *pool, ppm pixmap);
+void free_pool  (struct pixmap_pool *pool);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- SKIP FRAME FUNCTIONS -- */
+UArray_T changed_blocks(ppm image, ppm previous, struct byte_buffer *bitmap);
+int      same_block    (ppm image, ppm previous, int col, int row);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- PREFETCH FUNCTIONS -- */
+void  start_prefetch(struct prefetch *p, FILE *input,
+                     void *read(FILE *input, void *cl), void *cl);
+void *next_frame    (struct prefetch *p);
+void  stop_prefetch (struct prefetch *p);
+void *prefetch_frames(void *cl);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                      STREAM FUNCTIONS                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       compress40_stream
+ * [Parameters]: 1 FILE* (input), 1 int (temporal: nonzero to send only the
+ *               blocks that changed since the previous frame)
+ * [Return]:     void
+ * [Purpose]:    Compresses every portable pixmap on input stream, in order,
+ *               into one framed COMP40 stream on standard output
+ *               Note: Does not modify or close input
+ *                     An input holding no pixmap gives a stream of no frames
+ *                     In temporal mode, a frame the size of the one before
+ *                      it is sent as an "S" frame, unless every block changed
+ * [Errors]:     CRE if input is NULL or a pixmap is malformed
+ */
+void compress40_stream(FILE *input, int temporal)
+{
+        assert(input != NULL);
+
+        struct pixmap_pool pool = { .count = 0 };
+        pthread_mutex_init(&pool.lock, NULL);
+        struct prefetch    reader;
+        start_prefetch(&reader, input, read_pixmap, &pool);
+
+        printf("COMP40 Compressed stream %u\n", STREAM_VERSION);
+
+        UArray_T           codewords = NULL;
+        ppm                previous  = NULL;
+        struct byte_buffer bitmap    = { NULL, 0 };
+        ppm                image;
+        while ((image = next_frame(&reader)) != NULL) {
+                PROFILE_SPAN_START(frame_mark);
+                int len = (image->width / 2) * (image->height / 2);
+                scale_ppm(image);
+
+                UArray_T indices = NULL;
+                if (temporal && previous != NULL) {
+                        indices = changed_blocks(image, previous, &bitmap);
+                }
+
+                if (indices != NULL && UArray_length(indices) < len) {
+                        int      changed = UArray_length(indices);
+                        UArray_T words   = compress->new_blocks(changed,
+                                                           sizeof(uint32_t));
+                        words = compress_changed(image, indices, words);
+
+                        printf("S %u %u\n", image->width / 2 * 2,
+                               image->height / 2 * 2);
+                        fwrite(bitmap.bytes, 1, (len + 7) / 8, stdout);
+                        write_codewords(stdout, words);
+                        UArray_free(&words);
+                } else {
+                        if (codewords == NULL) {
+                                codewords = compress->new_blocks(len,
+                                                           sizeof(uint32_t));
+                        } else if (UArray_length(codewords) != len) {
+                                UArray_resize(codewords, len);
+                        }
+                        codewords = compress_pixmap(image, codewords);
+
+                        printf("I %u %u\n", image->width, image->height);
+                        write_codewords(stdout, codewords);
+                }
+
+                if (indices != NULL) {
+                        UArray_free(&indices);
+                }
+                if (previous != NULL) {
+                        give_pixmap(&pool, previous);
+                }
+                previous = image;
+                PROFILE_SPAN_STOP(frame_mark, "frame");
+        }
+
+        stop_prefetch(&reader);
+        if (previous != NULL) {
+                Pnm_ppmfree(&previous);
+        }
+        free_pool(&pool);
+        if (codewords != NULL) {
+                UArray_free(&codewords);
+        }
+        if (bitmap.bytes != NULL) {
+                FREE(bitmap.bytes);
+        }
+}
+
+/*
+ * [Name]:       decompress40_stream
+ * [Parameters]: 1 FILE* (input)
+ * [Return]:     void
+ * [Purpose]:    Decompresses every frame of the framed COMP40 stream on input
+ *               stream and sends them on standard output as concatenated
+ *               portable pixmaps
+ *               Note: Does not modify or close input
+ * [Errors]:     CRE if input is NULL or the stream is malformed
+ */
+void decompress40_stream(FILE *input)
+{
+        assert(input != NULL);
+
+        unsigned version;
+        int read = fscanf(input, "COMP40 Compressed stream %u", &version);
+        assert(read == 1 && version == STREAM_VERSION);
+        int c = getc(input);
+        assert(c == '\n');
+
+        struct byte_buffer buffer = { NULL, 0 };
+        struct prefetch    reader;
+        start_prefetch(&reader, input, read_coded, &buffer);
+
+        ppm                 pixmap = NULL;
+        struct coded_frame *frame;
+        while ((frame = next_frame(&reader)) != NULL) {
+                PROFILE_SPAN_START(frame_mark);
+                if (frame->type == 'S') {
+                        assert(pixmap != NULL &&
+                               pixmap->width  == frame->width &&
+                               pixmap->height == frame->height);
+                } else if (pixmap == NULL || pixmap->width  != frame->width ||
+                                             pixmap->height != frame->height) {
+                        if (pixmap != NULL) {
+                                Pnm_ppmfree(&pixmap);
+                        }
+                        pixmap = new_ppm(frame->width, frame->height);
+                }
+
+                if (frame->type == 'S') {
+                        decompress_changed(frame->codewords, frame->indices,
+                                           pixmap);
+                        UArray_free(&frame->indices);
+                } else {
+                        decompress_codewords(frame->codewords, frame->width,
+                                             frame->height, pixmap, 0, 0);
+                }
+                Pnm_ppmwrite(stdout, pixmap);
+                FREE(frame);
+                PROFILE_SPAN_STOP(frame_mark, "frame");
+        }
+
+        stop_prefetch(&reader);
+        if (pixmap != NULL) {
+                Pnm_ppmfree(&pixmap);
+        }
+        if (buffer.bytes != NULL) {
+                FREE(buffer.bytes);
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                   FRAME READER FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       read_pixmap
+ * [Parameters]: 1 FILE* (input), 1 void* (closure, the struct
+ *               pixmap_pool)
+ * [Return]:     next Pnm_ppm on input, or NULL at end of input
+ * [Purpose]:    Frame reader for compress40_stream: reads the frame into a
+ *               pixmap from the pool if one of its size is there, so that
+ *               a stream of same-sized frames allocates no new pixmaps
+ *               Note: Whitespace between pixmaps is skipped
+ * [Errors]:     CRE if a pixmap is malformed
+ */
+void *read_pixmap(FILE *input, void *cl)
+{
+        struct pixmap_pool *pool = cl;
+
+        int c;
+        while ((c = getc(input)) != EOF && isspace(c)) {
+                ;
+        }
+        if (c == EOF) {
+                return NULL;
+        }
+        ungetc(c, input);
+
+        Ppm_reader reader;
+        Ppm_open(input, &reader);
+        ppm image = take_pixmap(pool, reader.width, reader.height);
+        Ppm_read(&reader, image, reader.height);
+
+        return image;
+}
+
+/*
+ * [Name]:       read_coded
+ * [Parameters]: 1 FILE* (input), 1 void* (closure, the struct
+ *               byte_buffer)
+ * [Return]:     malloc'd struct coded_frame for the next frame, or NULL at
+ *               end of input
+ * [Purpose]:    Frame reader for decompress40_stream: reads the frame's
+ *               header, its skip bitmap if it has one, then its codewords
+ *               with a single bulk read into the reusable byte buffer
+ * [Errors]:     CRE if the frame is malformed or input ends early
+ */
+void *read_coded(FILE *input, void *cl)
+{
+        struct byte_buffer *buffer = cl;
+
+        int type = getc(input);
+        if (type == EOF) {
+                return NULL;
+        }
+        assert(type == 'I' || type == 'S');
+
+        struct coded_frame *frame;
+        NEW(frame);
+        frame->type    = type;
+        frame->indices = NULL;
+        int read = fscanf(input, " %u %u", &frame->width, &frame->height);
+        assert(read == 2);
+        int c = getc(input);
+        assert(c == '\n');
+
+        int len = (frame->width / 2) * (frame->height / 2);
+        if (type == 'S') {
+                size_t         bytes  = (len + 7) / 8;
+                unsigned char *bitmap = reserve_buffer(buffer, bytes);
+                size_t         got    = fread(bitmap, 1, bytes, input);
+                assert(got == bytes);
+
+                int changed = 0;
+                for (int i = 0; i < len; i++) {
+                        changed += (bitmap[i / 8] >> (7 - i % 8)) & 1;
+                }
+                frame->indices = UArray_new(changed, sizeof(unsigned));
+                for (int i = 0, j = 0; i < len; i++) {
+                        if ((bitmap[i / 8] >> (7 - i % 8)) & 1) {
+                                *(unsigned *)UArray_at(frame->indices,
+                                                       j++) = i;
+                        }
+                }
+                len = changed;
+        }
+
+        size_t         bytes = (size_t)len * CODEWORD_BYTES;
+        unsigned char *buf   = reserve_buffer(buffer, bytes);
+        size_t         got   = fread(buf, 1, bytes, input);
+        assert(got == bytes);
+
+        frame->codewords = decompress->new_blocks(len, sizeof(uint32_t));
+        for (int i = 0; i < len; i++) {
+                uint32_t *codeword = UArray_at(frame->codewords, i);
+                *codeword = get_codeword(buf + i * CODEWORD_BYTES);
+        }
+
+        return frame;
+}
+
+/*
+ * [Name]:       reserve_buffer
+ * [Parameters]: 1 struct byte_buffer*, 1 size_t (bytes needed)
+ * [Return]:     the buffer's bytes, at least bytes long
+ * [Purpose]:    Reuses a buffer across frames, growing it only when a frame
+ *               needs more room than any before it
+ * [Errors]:     None
+ */
+unsigned char *reserve_buffer(struct byte_buffer *buffer, size_t bytes)
+{
+        if (buffer->bytes == NULL || bytes > buffer->cap) {
+                if (buffer->bytes != NULL) {
+                        FREE(buffer->bytes);
+                }
+                buffer->bytes = ALLOC(bytes + 1);
+                buffer->cap   = bytes;
+        }
+
+        return buffer->bytes;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                    SKIP FRAME FUNCTIONS                      |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       changed_blocks
+ * [Parameters]: 2 Pnm_ppm (image, and the previous frame, both scaled), 1
+ *               struct byte_buffer* (bitmap, filled)
+ * [Return]:     new UArray of the indices (unsigned, row-major) of the
+ *               blocks of image that differ from previous, or NULL if the
+ *               frames differ in size
+ * [Purpose]:    Finds the blocks an "S" frame has to send, and fills in its
+ *               skip bitmap
+ * [Errors]:     None
+ */
+UArray_T changed_blocks(ppm image, ppm previous, struct byte_buffer *bitmap)
+{
+        int blocks_wide = image->width  / 2;
+        int blocks_high = image->height / 2;
+
+        if (blocks_wide != (int)previous->width  / 2 ||
+            blocks_high != (int)previous->height / 2) {
+                return NULL;
+        }
+
+        int            len   = blocks_wide * blocks_high;
+        unsigned char *bits  = reserve_buffer(bitmap, (len + 7) / 8);
+        int            count = 0;
+        memset(bits, 0, (len + 7) / 8);
+
+        for (int i = 0; i < len; i++) {
+                if (!same_block(image, previous, 2 * (i % blocks_wide),
+                                2 * (i / blocks_wide))) {
+                        bits[i / 8] |= 0x80 >> (i % 8);
+                        count++;
+                }
+        }
+
+        UArray_T indices = UArray_new(count, sizeof(unsigned));
+        for (int i = 0, j = 0; i < len; i++) {
+                if ((bits[i / 8] >> (7 - i % 8)) & 1) {
+                        *(unsigned *)UArray_at(indices, j++) = i;
+                }
+        }
+
+        return indices;
+}
+
+/*
+ * [Name]:       same_block
+ * [Parameters]: 2 Pnm_ppm (image, previous), 2 ints (pixel column and row
+ *               of the block's top-left pixel)
+ * [Return]:     1 if the 2x2 block has the same pixels in both, 0 otherwise
+ * [Purpose]:    Compares one block of two frames of the same size
+ * [Errors]:     None
+ */
+int same_block(ppm image, ppm previous, int col, int row)
+{
+        const struct A2Methods_T m = *(image->methods);
+
+        for (int j = 0; j < 4; j++) {
+                Pnm_rgb now  = m.at(image->pixels,    col + j % 2,
+                                    row + j / 2);
+                Pnm_rgb then = m.at(previous->pixels, col + j % 2,
+                                    row + j / 2);
+
+                if (now->red   != then->red   ||
+                    now->green != then->green ||
+                    now->blue  != then->blue) {
+                        return 0;
+                }
+        }
+
+        return 1;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                    PIXMAP POOL FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       take_pixmap
+ * [Parameters]: 1 struct pixmap_pool*, 2 unsigned (width, height)
+ * [Return]:     a pixmap whose pixel array is width x height: a spare one
+ *               from pool if it has one that size, else a new one
+ * [Purpose]:    Lets the reader thread reuse the pixmaps of frames done with
+ *               Note: Its contents, size and denominator are left for
+ *                     Ppm_read to set
+ * [Errors]:     None
+ */
+ppm take_pixmap(struct pixmap_pool *pool, unsigned width, unsigned height)
+{
+        ppm pixmap = NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        for (unsigned i = 0; i < pool->count; i++) {
+                ppm         spare = pool->spare[i];
+                A2Methods_T m     = spare->methods;
+                if ((unsigned)m->width (spare->pixels) == width &&
+                    (unsigned)m->height(spare->pixels) == height) {
+                        pixmap         = spare;
+                        pool->spare[i] = pool->spare[--pool->count];
+                        break;
+                }
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        return pixmap != NULL ? pixmap : new_ppm(width, height);
+}
+
+/*
+ * [Name]:       give_pixmap
+ * [Parameters]: 1 struct pixmap_pool*, 1 Pnm_ppm (pixmap, done with)
+ * [Return]:     void
+ * [Purpose]:    Keeps pixmap in pool for take_pixmap, replacing the oldest
+ *               spare (freed) if pool is full, as after a change of size
+ * [Errors]:     None
+ */
+void give_pixmap(struct pixmap_pool *pool, ppm pixmap)
+{
+        ppm oldest = NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        if (pool->count == 2) {
+                oldest         = pool->spare[0];
+                pool->spare[0] = pool->spare[1];
+                pool->count    = 1;
+        }
+        pool->spare[pool->count++] = pixmap;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (oldest != NULL) {
+                Pnm_ppmfree(&oldest);
+        }
+}
+
+/*
+ * [Name]:       free_pool
+ * [Parameters]: 1 struct pixmap_pool*
+ * [Return]:     void
+ * [Purpose]:    Frees the spare pixmaps and the lock, once the reader thread
+ *               has stopped
+ * [Errors]:     None
+ */
+void free_pool(struct pixmap_pool *pool)
+{
+        for (unsigned i = 0; i < pool->count; i++) {
+                Pnm_ppmfree(&pool->spare[i]);
+        }
+        pthread_mutex_destroy(&pool->lock);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                     PREFETCH FUNCTIONS                       |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       start_prefetch
+ * [Parameters]: 1 struct prefetch*, 1 FILE* (input), 1 frame reader
+ *               function, 1 void* (closure of the reader)
+ * [Return]:     void
+ * [Purpose]:    Starts a thread that reads frames off input with read, one
+ *               ahead of the frames handed out by next_frame (if there is
+ *               more than one processor)
+ * [Errors]:     CRE if the thread cannot be created
+ */
+void start_prefetch(struct prefetch *p, FILE *input,
+                    void *read(FILE *input, void *cl), void *cl)
+{
+        p->input = input;
+        p->read  = read;
+        p->cl    = cl;
+        p->frame = NULL;
+        p->full  = 0;
+        p->threaded = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+        if (!p->threaded) {
+                return;
+        }
+        pthread_mutex_init(&p->lock, NULL);
+        pthread_cond_init (&p->changed, NULL);
+
+        int err = pthread_create(&p->thread, NULL, prefetch_frames, p);
+        assert(err == 0);
+}
+
+/*
+ * [Name]:       next_frame
+ * [Parameters]: 1 struct prefetch*
+ * [Return]:     next frame read, or NULL once input has ended
+ * [Purpose]:    Takes the frame waiting in p, waiting for it if need be,
+ *               which lets the reader thread go on to the following frame
+ * [Errors]:     None
+ */
+void *next_frame(struct prefetch *p)
+{
+        if (!p->threaded) {
+                if (!p->full) {
+                        p->frame = p->read(p->input, p->cl);
+                        p->full  = p->frame == NULL;
+                }
+                return p->frame;
+        }
+
+        PROFILE_SPAN_START(wait_mark);
+        pthread_mutex_lock(&p->lock);
+        while (!p->full) {
+                pthread_cond_wait(&p->changed, &p->lock);
+        }
+        PROFILE_SPAN_STOP(wait_mark, "wait frame");
+        void *frame = p->frame;
+        if (frame != NULL) {
+                p->full = 0;
+                pthread_cond_signal(&p->changed);
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        return frame;
+}
+
+/*
+ * [Name]:       stop_prefetch
+ * [Parameters]: 1 struct prefetch*
+ * [Return]:     void
+ * [Purpose]:    Waits for the reader thread, once next_frame has returned
+ *               NULL, and frees its synchronization state
+ * [Errors]:     None
+ */
+void stop_prefetch(struct prefetch *p)
+{
+        if (!p->threaded) {
+                return;
+        }
+        pthread_join(p->thread, NULL);
+        pthread_cond_destroy (&p->changed);
+        pthread_mutex_destroy(&p->lock);
+}
+
+/*
+ * [Name]:       prefetch_frames
+ * [Parameters]: 1 void* (closure, the struct prefetch)
+ * [Return]:     NULL
+ * [Purpose]:    Reader thread body: reads frames until the end of input,
+ *               handing each one over as soon as the last has been taken.
+ *               The final NULL stays in p, so next_frame keeps returning it
+ * [Errors]:     None
+ */
+void *prefetch_frames(void *cl)
+{
+        struct prefetch *p = cl;
+        void            *frame;
+
+        do {
+                PROFILE_SPAN_START(read_mark);
+                frame = p->read(p->input, p->cl);
+                PROFILE_SPAN_STOP(read_mark, "read frame");
+
+                PROFILE_SPAN_START(wait_mark);
+                pthread_mutex_lock(&p->lock);
+                while (p->full) {
+                        pthread_cond_wait(&p->changed, &p->lock);
+                }
+                PROFILE_SPAN_STOP(wait_mark, "wait slot");
+                p->frame = frame;
+                p->full  = 1;
+                pthread_cond_signal(&p->changed);
+                pthread_mutex_unlock(&p->lock);
+        } while (frame != NULL);
+
+        return NULL;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
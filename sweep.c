@@ -0,0 +1,353 @@
+/*
+ *      sweep.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the codeword layout sweep of 40image --sweep
+ *      - Sweep: Reports the encoded size and round-trip RMS error (as
+ *               ppmdiff reports it, with color values in [0, 1]) of one
+ *               image under many codeword layouts, without rebuilding 40image
+ *               for each: a layout "A/BCD/C" codes a in A bits, each of b, c
+ *               and d in BCD bits, and each of Pb and Pr in C bits (6/6/4 is
+ *               the COMP40 layout)
+ *              ~ The image is read, scaled, trimmed and converted to YPbPr by
+ *                the compress pipeline once; each block keeps only its
+ *                unquantized DCT coefficients, its mean chroma and its source
+ *                samples
+ *              ~ Each layout then quantizes and dequantizes those (with the
+ *                codec's quantizers, at the layout's widths), runs the
+ *                inverse DCT and XYZ_px_to_RGB, and compares the pixels with
+ *                the source, as verify does for the real codewords
+ *              ~ Size is the format 2 header plus the codewords packed with
+ *                no padding (exactly format 2 for 32-bit layouts)
+ *      - Invariants:
+ *              ~ (layout, chunk of SWEEP_CHUNK blocks) pairs are shared out
+ *                to threads, so one layout or many keep every thread busy;
+ *                each pair's error is added to its layout's total under the
+ *                lock
+ *              ~ Layout 6/6/4 gives the RMS error of 40image -c --verify
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "a2plain.h"
+#include "assert.h"
+#include "chroma_bit.h"
+#include "compress40ext.h"
+#include "imagemethods.h"
+#include "luma_bit.h"
+#include "mem.h"
+#include "pixelblock.h"
+#include "rgb_xyz.h"
+#include "uarray.h"
+
+/* Blocks handed to a thread at a time, for one layout */
+#define SWEEP_CHUNK 16384
+
+/* Field widths a layout may have */
+static const int MIN_WIDTH = 1, MAX_WIDTH = 16;
+
+/* -- struct Pnm_ppm is from pnm.h -- */
+typedef struct Pnm_ppm *ppm;
+
+/* -- A block, converted once for every layout -- */
+struct sweep_block {
+        float         a, b, c, d;     /* unquantized DCT coefficients     */
+        float         Pb, Pr;         /* mean chroma                      */
+        unsigned char src[12];        /* source RGB, row-major, [0, 255]  */
+};
+
+/* -- A codeword layout, and the squared error summed over its blocks -- */
+struct layout {
+        int    a, bcd, chroma;        /* field widths in bits             */
+        double sum;                   /* [0, 1] units                     */
+};
+
+/* -- Shared state of the threads evaluating layouts -- */
+struct sweep_job {
+        struct sweep_block *blocks;
+        unsigned            num_blocks;
+        unsigned            chunks;             /* per layout             */
+        struct layout      *layouts;
+        unsigned            num_layouts;
+        unsigned            next;               /* next pair to hand out  */
+        pthread_mutex_t     lock;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- SWEEP HELPER FUNCTIONS -- */
+unsigned            parse_layouts (const char *layouts, struct layout *out);
+struct sweep_block *convert_image (ppm image, unsigned *num_blocks);
+void               *sweep_chunks  (void *cl);
+double              chunk_error   (const struct sweep_block *blocks,
+                                   unsigned first, unsigned last,
+                                   const struct layout *layout);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                       SWEEP FUNCTIONS                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       sweep40
+ * [Parameters]: 1 FILE* (input, a portable pixmap), 1 const char* (layouts,
+ *               "A/BCD/C" separated by commas)
+ * [Return]:     void
+ * [Purpose]:    Prints, for each layout in the order given, its width in
+ *               bits, bits per pixel, encoded size in bytes, and the RMS
+ *               error and PSNR of the image's round trip through it
+ * [Errors]:     CRE if input is NULL or layouts is not known_layouts
+ */
+void sweep40(FILE *input, const char *layouts)
+{
+        assert(input != NULL && known_layouts(layouts));
+
+        struct sweep_job job;
+        memset(&job, 0, sizeof(job));
+        job.num_layouts = parse_layouts(layouts, NULL);
+        job.layouts     = CALLOC(job.num_layouts, sizeof(struct layout));
+        parse_layouts(layouts, job.layouts);
+
+        ppm image   = Pnm_ppmread(input, uarray2_methods_plain);
+        job.blocks  = convert_image(image, &job.num_blocks);
+        job.chunks  = (job.num_blocks + SWEEP_CHUNK - 1) / SWEEP_CHUNK;
+        unsigned width  = image->width;
+        unsigned height = image->height;
+        Pnm_ppmfree(&image);
+        /* AFTER THIS POINT: Only the converted blocks are needed */
+
+        pthread_mutex_init(&job.lock, NULL);
+        int        threads = num_threads(job.num_layouts * job.chunks);
+        pthread_t *workers = ALLOC(threads * sizeof(pthread_t));
+        for (int i = 0; i < threads; i++) {
+                int err = pthread_create(&workers[i], NULL, sweep_chunks,
+                                         &job);
+                assert(err == 0);
+        }
+        for (int i = 0; i < threads; i++) {
+                pthread_join(workers[i], NULL);
+        }
+        FREE(workers);
+        pthread_mutex_destroy(&job.lock);
+
+        int header = snprintf(NULL, 0, "COMP40 Compressed image format 2\n"
+                              "%u %u\n", width, height);
+        for (unsigned i = 0; i < job.num_layouts; i++) {
+                const struct layout *l = &job.layouts[i];
+                unsigned bits  = l->a + 3 * l->bcd + 2 * l->chroma;
+                uint64_t bytes = header +
+                                 ((uint64_t)bits * job.num_blocks + 7) / 8;
+                double   rms   = job.num_blocks == 0 ? 0 :
+                                 sqrt(l->sum / (12.0 * job.num_blocks));
+
+                printf("layout %d/%d/%d bits %u bpp %.2f bytes %llu "
+                       "rms %.4f psnr ", l->a, l->bcd, l->chroma, bits,
+                       bits / 4.0, (unsigned long long)bytes, rms);
+                if (rms > 0) {
+                        printf("%.2f\n", -20 * log10(rms));
+                } else {
+                        printf("inf\n");
+                }
+        }
+
+        FREE(job.layouts);
+        FREE(job.blocks);
+}
+
+/*
+ * [Name]:       known_layouts
+ * [Parameters]: 1 const char* (layouts)
+ * [Return]:     1 if layouts is a nonempty list of "A/BCD/C" separated by
+ *               commas, with A and C in [1, 16] and BCD in [2, 16]; else 0
+ * [Purpose]:    Lets 40image check --sweep before reading any input
+ * [Errors]:     None
+ */
+int known_layouts(const char *layouts)
+{
+        return layouts != NULL && parse_layouts(layouts, NULL) != 0;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                   SWEEP HELPER FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       parse_layouts
+ * [Parameters]: 1 const char* (layouts), 1 struct layout* (out: filled with
+ *               the layouts, zeroed sums, or NULL only to count them)
+ * [Return]:     number of layouts, or 0 if the list is malformed
+ * [Purpose]:    Parses the argument of --sweep
+ * [Errors]:     None
+ */
+unsigned parse_layouts(const char *layouts, struct layout *out)
+{
+        unsigned n = 0;
+
+        for (const char *s = layouts; ; n++) {
+                struct layout l = { 0, 0, 0, 0 };
+                int used = 0;
+                if (sscanf(s, "%2d/%2d/%2d%n", &l.a, &l.bcd, &l.chroma,
+                           &used) != 3 || used == 0 ||
+                    l.a < MIN_WIDTH || l.a > MAX_WIDTH ||
+                    l.bcd < MIN_WIDTH + 1 || l.bcd > MAX_WIDTH ||
+                    l.chroma < MIN_WIDTH || l.chroma > MAX_WIDTH) {
+                        return 0;
+                }
+                if (out != NULL) {
+                        out[n] = l;
+                }
+
+                s += used;
+                if (*s == '\0') {
+                        return n + 1;
+                } else if (*s != ',') {
+                        return 0;
+                }
+                s++;
+        }
+}
+
+/*
+ * [Name]:       convert_image
+ * [Parameters]: 1 ppm (image), 1 unsigned* (num_blocks: set to the number of
+ *               blocks)
+ * [Return]:     the image's blocks in row-major order (the caller frees them)
+ * [Purpose]:    Does the layout-independent part of compression once: the
+ *               compress pipeline reads (scaling and trimming image) and
+ *               converts to YPbPr, then each block's DCT and mean chroma are
+ *               kept along with its source samples
+ *               Note: Leaves image scaled and trimmed; does not free it
+ * [Errors]:     None
+ */
+struct sweep_block *convert_image(ppm image, unsigned *num_blocks)
+{
+        ImageMethods_T img_m = compress;
+
+        unsigned len        = (image->width / 2) * (image->height / 2);
+        UArray_T rgb_blocks = img_m->new_blocks(len, sizeof(struct RGB_block));
+        UArray_T xyz_blocks = img_m->new_blocks(len, sizeof(struct XYZ_block));
+        rgb_blocks = img_m->read   (rgb_blocks, image);
+        xyz_blocks = img_m->rgb_xyz(xyz_blocks, rgb_blocks);
+
+        struct sweep_block *blocks = CALLOC(len > 0 ? len : 1,
+                                            sizeof(struct sweep_block));
+        unsigned            bw     = image->width / 2;
+        for (unsigned i = 0; i < len; i++) {
+                XYZ_block           xyz   = UArray_at(xyz_blocks, i);
+                struct sweep_block *block = &blocks[i];
+
+                luma_dct(xyz, &block->a, &block->b, &block->c, &block->d);
+                block->Pb = average_Pb(xyz);
+                block->Pr = average_Pr(xyz);
+
+                for (int j = 0; j < 4; j++) {
+                        Pnm_rgb src = image->methods->at(image->pixels,
+                                                         2 * (i % bw) + j % 2,
+                                                         2 * (i / bw) + j / 2);
+                        block->src[3 * j]     = src->red;
+                        block->src[3 * j + 1] = src->green;
+                        block->src[3 * j + 2] = src->blue;
+                }
+
+                free_XYZ_block(xyz);
+                free_RGB_block(UArray_at(rgb_blocks, i));
+        }
+        UArray_free(&rgb_blocks);
+        UArray_free(&xyz_blocks);
+
+        *num_blocks = len;
+        return blocks;
+}
+
+/*
+ * [Name]:       sweep_chunks
+ * [Parameters]: 1 void* (closure, the struct sweep_job)
+ * [Return]:     NULL
+ * [Purpose]:    Thread body: repeatedly takes the next (layout, chunk) pair
+ *               and adds the chunk's error under that layout to its total
+ * [Errors]:     None
+ */
+void *sweep_chunks(void *cl)
+{
+        struct sweep_job *job = cl;
+
+        for (;;) {
+                pthread_mutex_lock(&job->lock);
+                unsigned pair = job->next++;
+                pthread_mutex_unlock(&job->lock);
+
+                if (pair >= job->num_layouts * job->chunks) {
+                        break;
+                }
+
+                struct layout *layout = &job->layouts[pair / job->chunks];
+                unsigned       first  = (pair % job->chunks) * SWEEP_CHUNK;
+                unsigned       last   = job->num_blocks - first < SWEEP_CHUNK ?
+                                        job->num_blocks : first + SWEEP_CHUNK;
+                double         sum    = chunk_error(job->blocks, first, last,
+                                                    layout);
+
+                pthread_mutex_lock(&job->lock);
+                layout->sum += sum;
+                pthread_mutex_unlock(&job->lock);
+        }
+
+        return NULL;
+}
+
+/*
+ * [Name]:       chunk_error
+ * [Parameters]: 1 const struct sweep_block* (blocks), 2 unsigned integers
+ *               (first block, and one past the last), 1 const struct layout*
+ * [Return]:     summed squared error of the blocks' round trip through the
+ *               layout, with color values in [0, 1]
+ * [Purpose]:    Quantizes, dequantizes and decodes each block as the codec
+ *               would with the layout's field widths (the decode arithmetic
+ *               is verify's), and compares it with the source
+ * [Errors]:     None
+ */
+double chunk_error(const struct sweep_block *blocks, unsigned first,
+                   unsigned last, const struct layout *layout)
+{
+        double sum = 0;
+
+        for (unsigned i = first; i < last; i++) {
+                const struct sweep_block *block = &blocks[i];
+
+                float a  = scale_a  (quantize_a  (block->a, layout->a),
+                                     layout->a);
+                float b  = scale_bcd(quantize_bcd(block->b, layout->bcd),
+                                     layout->bcd);
+                float c  = scale_bcd(quantize_bcd(block->c, layout->bcd),
+                                     layout->bcd);
+                float d  = scale_bcd(quantize_bcd(block->d, layout->bcd),
+                                     layout->bcd);
+                float Pb = scale_chroma(quantize_chroma(block->Pb,
+                                                        layout->chroma),
+                                        layout->chroma);
+                float Pr = scale_chroma(quantize_chroma(block->Pr,
+                                                        layout->chroma),
+                                        layout->chroma);
+
+                struct XYZ_px xyz[4] = {
+                        { a - b - c + d, Pb, Pr }, { a - b + c - d, Pb, Pr },
+                        { a + b - c - d, Pb, Pr }, { a + b + c + d, Pb, Pr }
+                };
+
+                for (int j = 0; j < 4; j++) {
+                        struct RGB_px rgb = XYZ_px_to_RGB(xyz[j]);
+                        unsigned      px[3] = { rgb.r, rgb.g, rgb.b };
+                        for (int k = 0; k < 3; k++) {
+                                double diff = ((double)block->src[3 * j + k] -
+                                               px[k]) / RGB_MAX;
+                                sum += diff * diff;
+                        }
+                }
+        }
+
+        return sum;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
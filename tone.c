@@ -0,0 +1,219 @@
+/*
+ *      tone.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the tone adjustment function for 40image
+ *      - Tone: Reads a compressed COMP40 image from the input stream and
+ *              sends it with its brightness, contrast or color changed on
+ *              standard output, still compressed
+ *      - Luma is mapped by Y -> contrast * (Y - 0.5) + 0.5 + brightness,
+ *        which is affine, so it maps the DCT coefficients directly: a (the
+ *        mean) is mapped the same way, and b, c and d (differences) are
+ *        scaled by contrast
+ *      - Grayscale is near-gray: the Arith40 chroma table has no zero, so
+ *        Pb and Pr are set to its two values nearest zero (+-0.011), in a
+ *        checkerboard of blocks and opposite to each other; each block
+ *        keeps a faint tint (R, G and B up to about 9/255 apart), which
+ *        averages out over neighboring blocks
+ *      - Invariants:
+ *              ~ Every possible value of each field is mapped once, into a
+ *                table, before any codeword is read; codewords are then
+ *                rewritten by table lookup
+ *              ~ Mapped coefficients are clamped to the ranges quantize_a
+ *                and quantize_bcd allow
+ *              ~ Output has the input's format (and, for format 3, its tile
+ *                size and coding)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arith40.h"
+#include "assert.h"
+#include "codeword_io.h"
+#include "compress40ext.h"
+#include "luma_bit.h"
+#include "mem.h"
+#include "pixpack.h"
+#include "uarray.h"
+
+/* -- New value of every quantized value of each field -- */
+struct tone_tables {
+        unsigned *a;              /* indexed by a                       */
+        int      *b, *c, *d;      /* indexed by value + 2^(width - 1)   */
+        int       gray;           /* nonzero: Pb and Pr become gray     */
+        unsigned  gray_index[2];  /* chroma indices nearest 0, by parity */
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- TONE HELPER FUNCTIONS -- */
+void build_tables(struct tone_tables *tables, float brightness,
+                  float contrast, int gray);
+int *bcd_table   (int bitsize, float contrast);
+void free_tables (struct tone_tables *tables);
+void tone_row    (UArray_T codewords, unsigned blocks_wide, unsigned row,
+                  const struct tone_tables *tables);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                        TONE FUNCTION                         |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       tone40
+ * [Parameters]: 1 FILE* (input), 2 floats (brightness, added to luma in
+ *               [0, 1]; contrast, the factor on luma around 0.5), 1 int
+ *               (gray: nonzero to remove color, leaving near-gray)
+ * [Return]:     void
+ * [Purpose]:    Rewrites every codeword of the compressed image on input
+ *               stream through the tone tables, and sends the result on
+ *               standard output in the same COMP40 format
+ *               Note: Does not modify or close input
+ *                     Format 2 is rewritten one block row at a time
+ * [Errors]:     CRE if input is NULL or contrast is negative
+ */
+void tone40(FILE *input, float brightness, float contrast, int gray)
+{
+        assert(input != NULL && contrast >= 0);
+
+        struct tone_tables tables;
+        build_tables(&tables, brightness, contrast, gray);
+
+        /* Reading file header */
+        Comp40_T      image  = Comp40_open(input);
+        Comp40_header header = Comp40_info(image);
+
+        unsigned bw = header.width  / 2;
+        unsigned bh = header.height / 2;
+
+        if (header.format == 3) {
+                UArray_T codewords = UArray_new(bw * bh, sizeof(uint32_t));
+                codewords = Comp40_rect(image, 0, 0, bw, bh, codewords);
+                tone_row(codewords, bw, 0, &tables);
+                write_tiled(stdout, codewords, header.width, header.height,
+                            header.tile, header.coding);
+                UArray_free(&codewords);
+        } else {
+                UArray_T codewords = UArray_new(bw, sizeof(uint32_t));
+                write_header(stdout, header.width, header.height);
+                for (unsigned row = 0; row < bh; row++) {
+                        codewords = Comp40_rect(image, 0, row, bw, 1,
+                                                codewords);
+                        tone_row(codewords, bw, row, &tables);
+                        write_codewords(stdout, codewords);
+                }
+                UArray_free(&codewords);
+        }
+
+        Comp40_close(&image);
+        free_tables(&tables);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                    TONE HELPER FUNCTIONS                     |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       build_tables
+ * [Parameters]: 1 struct tone_tables* (filled), 2 floats (brightness,
+ *               contrast), 1 int (gray)
+ * [Return]:     void
+ * [Purpose]:    Maps every quantized value of a, b, c and d through the
+ *               luma map once, and finds the two chroma indices nearest
+ *               zero, on either side of it
+ * [Errors]:     None
+ */
+void build_tables(struct tone_tables *tables, float brightness,
+                  float contrast, int gray)
+{
+        unsigned a_values = 1u << A_WIDTH;
+
+        tables->a = ALLOC(a_values * sizeof(*tables->a));
+        for (unsigned a = 0; a < a_values; a++) {
+                tables->a[a] = adjust_a(a, contrast, brightness);
+        }
+        tables->b          = bcd_table(B_WIDTH, contrast);
+        tables->c          = bcd_table(C_WIDTH, contrast);
+        tables->d          = bcd_table(D_WIDTH, contrast);
+        tables->gray       = gray;
+
+        unsigned nearest = Arith40_index_of_chroma(0.0);
+        tables->gray_index[0] = nearest;
+        tables->gray_index[1] = Arith40_index_of_chroma(
+                                        -Arith40_chroma_of_index(nearest));
+}
+
+/*
+ * [Name]:       bcd_table
+ * [Parameters]: 1 int (width of a b, c or d field in bits), 1 float
+ *               (contrast)
+ * [Return]:     malloc'd table of the new value of every value of the field,
+ *               indexed by value + 2^(bitsize - 1)
+ * [Purpose]:    Maps b, c or d through the luma map once
+ * [Errors]:     None
+ */
+int *bcd_table(int bitsize, float contrast)
+{
+        int  half  = 1 << (bitsize - 1);
+        int *table = ALLOC(2 * half * sizeof(*table));
+
+        for (int value = -half; value < half; value++) {
+                table[value + half] = adjust_bcd(value, bitsize, contrast);
+        }
+
+        return table;
+}
+
+/*
+ * [Name]:       free_tables
+ * [Parameters]: 1 struct tone_tables*
+ * [Return]:     void
+ * [Purpose]:    Frees the tables of build_tables
+ * [Errors]:     None
+ */
+void free_tables(struct tone_tables *tables)
+{
+        FREE(tables->a);
+        FREE(tables->b);
+        FREE(tables->c);
+        FREE(tables->d);
+}
+
+/*
+ * [Name]:       tone_row
+ * [Parameters]: 1 UArray_T (codewords: whole block rows, row-major), 2
+ *               unsigned integers (blocks_wide, the image's width in
+ *               blocks; row, the block row of the first codeword), 1 const
+ *               struct tone_tables*
+ * [Return]:     void
+ * [Purpose]:    Rewrites every codeword in place through the tables; the
+ *               position of a block picks its gray chroma
+ * [Errors]:     None
+ */
+void tone_row(UArray_T codewords, unsigned blocks_wide, unsigned row,
+              const struct tone_tables *tables)
+{
+        struct bit_block bit;
+        int              half_b = 1 << (B_WIDTH - 1);
+        int              half_c = 1 << (C_WIDTH - 1);
+        int              half_d = 1 << (D_WIDTH - 1);
+
+        for (int i = 0; i < UArray_length(codewords); i++) {
+                uint32_t *codeword = UArray_at(codewords, i);
+                unpack(*codeword, &bit);
+
+                bit.a = tables->a[bit.a];
+                bit.b = tables->b[bit.b + half_b];
+                bit.c = tables->c[bit.c + half_c];
+                bit.d = tables->d[bit.d + half_d];
+                if (tables->gray) {
+                        unsigned parity = (i % blocks_wide + i / blocks_wide
+                                           + row) % 2;
+                        bit.Pb = tables->gray_index[parity];
+                        bit.Pr = tables->gray_index[1 - parity];
+                }
+
+                *codeword = pack(&bit);
+        }
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
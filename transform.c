@@ -0,0 +1,229 @@
+/*
+ *      transform.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the lossless transform function for 40image
+ *      - Transform: Reads a compressed COMP40 image from the input stream and
+ *                   sends it flipped, transposed or rotated by a multiple of
+ *                   90 degrees on standard output, still compressed
+ *      - In a codeword, b is the block's top-to-bottom luma gradient, c its
+ *        left-to-right gradient and d its diagonal (see luma_bit.c), so
+ *        every transform is a composition of:
+ *              ~ Transpose: blocks move from (x, y) to (y, x); b and c swap
+ *              ~ Mirror left-right: blocks move from x to (width - 1 - x);
+ *                c and d are negated
+ *              ~ Mirror top-bottom: blocks move from y to (height - 1 - y);
+ *                b and d are negated
+ *        a, Pb and Pr are averages over the block, and never change
+ *      - Invariants:
+ *              ~ No codeword is decoded or re-quantized, so a transform adds
+ *                no loss, and applying its inverse restores the input
+ *              ~ Output has the input's format (and, for format 3, its tile
+ *                size and coding)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assert.h"
+#include "codeword_io.h"
+#include "compress40ext.h"
+#include "pixelblock.h"
+#include "uarray.h"
+
+/* -- A transform, as a transpose followed by mirrors -- */
+struct transform {
+        const char *name;
+        int         transpose;
+        int         mirror_x, mirror_y;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* Rotations are clockwise */
+static const struct transform TRANSFORMS[] = {
+        { "fliph",     0, 1, 0 },
+        { "flipv",     0, 0, 1 },
+        { "transpose", 1, 0, 0 },
+        { "rot90",     1, 1, 0 },
+        { "rot180",    0, 1, 1 },
+        { "rot270",    1, 0, 1 },
+};
+
+/* Least significant bits of the b, c and d fields in a codeword */
+static const int D_LSB = PR_WIDTH + PB_WIDTH;
+static const int C_LSB = PR_WIDTH + PB_WIDTH + D_WIDTH;
+static const int B_LSB = PR_WIDTH + PB_WIDTH + D_WIDTH + C_WIDTH;
+
+/* -- TRANSFORM HELPER FUNCTIONS -- */
+const struct transform *find_transform(const char *name);
+uint32_t                transform_codeword(uint32_t codeword,
+                                           const struct transform *how);
+uint32_t                get_field(uint32_t codeword, int width, int lsb);
+uint32_t                negate_field(uint32_t field, int width);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                     TRANSFORM FUNCTIONS                      |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       known_transform
+ * [Parameters]: 1 const char* (name of a transform)
+ * [Return]:     1 if transform40 supports the named transform, else 0
+ * [Purpose]:    Lets clients validate a transform before opening any input
+ * [Errors]:     CRE if name is NULL
+ */
+int known_transform(const char *name)
+{
+        assert(name != NULL);
+
+        return find_transform(name) != NULL;
+}
+
+/*
+ * [Name]:       transform40
+ * [Parameters]: 1 FILE* (input), 1 const char* (name of the transform)
+ * [Return]:     void
+ * [Purpose]:    Transforms the compressed image on input stream by moving
+ *               and rewriting its codewords, and sends the result on
+ *               standard output in the same COMP40 format
+ *               Note: Does not modify or close input
+ * [Errors]:     CRE if input is NULL or the transform is unknown
+ */
+void transform40(FILE *input, const char *name)
+{
+        assert(input != NULL && name != NULL);
+        const struct transform *how = find_transform(name);
+        assert(how != NULL);
+
+        /* Reading file header */
+        Comp40_T      image  = Comp40_open(input);
+        Comp40_header header = Comp40_info(image);
+
+        unsigned bw = header.width  / 2;
+        unsigned bh = header.height / 2;
+        UArray_T in = UArray_new(bw * bh, sizeof(uint32_t));
+        in = Comp40_rect(image, 0, 0, bw, bh, in);
+        Comp40_close(&image);
+
+        /* Output is (out_bw x out_bh) blocks; fill it in row-major order */
+        unsigned out_bw = how->transpose ? bh : bw;
+        unsigned out_bh = how->transpose ? bw : bh;
+        UArray_T out    = UArray_new(bw * bh, sizeof(uint32_t));
+        const uint32_t *src = UArray_at(in, 0);
+        uint32_t       *dst = UArray_at(out, 0);
+
+        for (unsigned y = 0; y < out_bh; y++) {
+                unsigned ty = how->mirror_y ? out_bh - 1 - y : y;
+                for (unsigned x = 0; x < out_bw; x++) {
+                        unsigned tx = how->mirror_x ? out_bw - 1 - x : x;
+                        size_t   i  = how->transpose ? (size_t)tx * bw + ty
+                                                     : (size_t)ty * bw + tx;
+                        *dst++ = transform_codeword(src[i], how);
+                }
+        }
+
+        unsigned width  = how->transpose ? header.height : header.width;
+        unsigned height = how->transpose ? header.width  : header.height;
+        if (header.format == 3) {
+                write_tiled(stdout, out, width, height, header.tile,
+                            header.coding);
+        } else {
+                write_header(stdout, width, height);
+                write_codewords(stdout, out);
+        }
+
+        UArray_free(&in);
+        UArray_free(&out);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                 TRANSFORM HELPER FUNCTIONS                   |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       find_transform
+ * [Parameters]: 1 const char* (name of a transform)
+ * [Return]:     the named transform, or NULL if there is none
+ * [Purpose]:    Looks a transform up in TRANSFORMS
+ * [Errors]:     None
+ */
+const struct transform *find_transform(const char *name)
+{
+        for (size_t i = 0; i < sizeof(TRANSFORMS) / sizeof(*TRANSFORMS);
+             i++) {
+                if (strcmp(TRANSFORMS[i].name, name) == 0) {
+                        return &TRANSFORMS[i];
+                }
+        }
+
+        return NULL;
+}
+
+/*
+ * [Name]:       transform_codeword
+ * [Parameters]: 1 uint32_t (codeword), 1 const struct transform* (how)
+ * [Return]:     the codeword of the same block after the transform
+ * [Purpose]:    Swaps and negates the b, c and d fields as the transform
+ *               moves the block's pixels, leaving a, Pb and Pr as they are
+ * [Errors]:     None
+ */
+uint32_t transform_codeword(uint32_t codeword, const struct transform *how)
+{
+        uint32_t b = get_field(codeword, B_WIDTH, B_LSB);
+        uint32_t c = get_field(codeword, C_WIDTH, C_LSB);
+        uint32_t d = get_field(codeword, D_WIDTH, D_LSB);
+
+        if (how->transpose) {
+                uint32_t temp = b;
+                b = c;
+                c = temp;
+        }
+        if (how->mirror_x) {
+                c = negate_field(c, C_WIDTH);
+                d = negate_field(d, D_WIDTH);
+        }
+        if (how->mirror_y) {
+                b = negate_field(b, B_WIDTH);
+                d = negate_field(d, D_WIDTH);
+        }
+
+        uint32_t bcd_mask = ((1u << (B_WIDTH + C_WIDTH + D_WIDTH)) - 1)
+                            << D_LSB;
+
+        return (codeword & ~bcd_mask) | b << B_LSB | c << C_LSB | d << D_LSB;
+}
+
+/*
+ * [Name]:       get_field
+ * [Parameters]: 1 uint32_t (codeword), 2 int (width and lsb of a field)
+ * [Return]:     the field's bits, in the low bits of the result
+ * [Purpose]:    Extracts a field without interpreting its sign
+ * [Errors]:     None
+ */
+uint32_t get_field(uint32_t codeword, int width, int lsb)
+{
+        return (codeword >> lsb) & ((1u << width) - 1);
+}
+
+/*
+ * [Name]:       negate_field
+ * [Parameters]: 1 uint32_t (a signed field, in the low bits), 1 int (width)
+ * [Return]:     the two's complement negation of the field, in width bits
+ * [Purpose]:    Negates b, c or d
+ *               Note: quantize_bcd never produces the most negative value,
+ *                      which has no negation in width bits; it is mapped to
+ *                      the most positive one
+ * [Errors]:     None
+ */
+uint32_t negate_field(uint32_t field, int width)
+{
+        uint32_t mask = (1u << width) - 1;
+
+        if (field == 1u << (width - 1)) {
+                return field - 1;
+        }
+        return (0u - field) & mask;
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
@@ -0,0 +1,351 @@
+/*
+ *      verify.c
+ *      by Jia Wen Goh (jgoh01) & Sean Ong (song02), 10/20/2017
+ *
+ *      - File that defines the round-trip check of 40image -c --verify
+ *      - Verify: Decodes the codewords compress40 just made, while they and
+ *                the source pixels are still in memory, and measures the
+ *                RMS error of the result against the source (as ppmdiff
+ *                reports it, with color values in [0, 1])
+ *      - Each block is decoded on its own with the same arithmetic as the
+ *        decompress pipeline (the dequantizers bit_to_luma uses, its inverse
+ *        DCT, the chroma of each index, XYZ_px_to_RGB, then stored as
+ *        get_pnm_rgb stores it), so it gets the pixels 40image -d would
+ *        write without staging UArrays or allocating pixels
+ *      - Sampled verify: checks only the blocks whose index hashes below
+ *        fraction * 2^64, a pseudo-random sample that is the same on every
+ *        run, and estimates the image-wide mean squared error from them with
+ *        a 95% confidence interval (normal approximation, with the finite
+ *        population correction); images too small to give VERIFY_MIN_SAMPLE
+ *        blocks are checked in full
+ *      - Invariants:
+ *              ~ The source pixmap is the one compress_pixmap read, so it is
+ *                already scaled to RGB_MAX and trimmed to even dimensions
+ *              ~ Block rows are shared out to threads in chunks of
+ *                VERIFY_CHUNK; each thread sums into its own total, merged
+ *                at the end
+ *              ~ A codeword equal to the one before it is not decoded again
+ *              ~ No decoded pixmap is ever built
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arith40.h"
+#include "assert.h"
+#include "compress40ext.h"
+#include "luma_bit.h"
+#include "mem.h"
+#include "pixelblock.h"
+#include "pixpack.h"
+#include "rgb_xyz.h"
+#include "uarray.h"
+
+/* Block rows handed to a thread at a time */
+#define VERIFY_CHUNK 16
+
+/* Fewest blocks a sample may have, and the seed choosing them */
+static const double   VERIFY_MIN_SAMPLE = 32;
+static const uint64_t VERIFY_SEED       = 0x9e3779b97f4a7c15u;
+
+/* Two-sided 95% quantile of the normal distribution */
+static const double Z_95 = 1.959964;
+
+/* -- struct Pnm_ppm is from pnm.h -- */
+typedef struct Pnm_ppm *ppm;
+
+/* -- Shared state of the threads verifying an image -- */
+struct verify_job {
+        ppm             image;       /* source, scaled and trimmed         */
+        UArray_T        codewords;   /* all of them, row-major             */
+        unsigned        bw, bh;      /* in blocks                          */
+        unsigned        next;        /* next block row to hand out         */
+        double          sum;         /* squared errors, [0, 1] units       */
+        pthread_mutex_t lock;
+};
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/* -- VERIFY HELPER FUNCTIONS -- */
+Comp40_quality verify_all   (ppm image, UArray_T codewords);
+Comp40_quality verify_sample(ppm image, UArray_T codewords, double fraction);
+void          *verify_rows  (void *cl);
+double         row_error    (const struct verify_job *job, unsigned row);
+double         block_error  (ppm image, const struct Pnm_rgb px[4],
+                             unsigned col, unsigned row);
+void           decode_block (uint32_t codeword, struct Pnm_rgb px[4]);
+uint64_t       sample_hash  (uint64_t index);
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                       VERIFY FUNCTION                        |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       verify_codewords
+ * [Parameters]: 1 Pnm_ppm (image, as compress_pixmap left it), 1 UArray_T
+ *               (codewords compress_pixmap made of it), 1 double (fraction
+ *               of the blocks to check, 1 or more for all)
+ * [Return]:     Comp40_quality of the decoded codewords against image
+ * [Purpose]:    Checks a compression round trip without leaving memory
+ *               Note: Does not modify or free either parameter
+ * [Errors]:     CRE if either parameter is NULL, they differ in size, or
+ *                   fraction is not positive
+ */
+Comp40_quality verify_codewords(Pnm_ppm image, UArray_T codewords,
+                                double fraction)
+{
+        assert(image != NULL && codewords != NULL && fraction > 0);
+        assert(UArray_length(codewords) ==
+               (int)((image->width / 2) * (image->height / 2)));
+
+        double blocks = UArray_length(codewords);
+        if (fraction < 1 && fraction * blocks >= VERIFY_MIN_SAMPLE) {
+                return verify_sample(image, codewords, fraction);
+        }
+
+        return verify_all(image, codewords);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */
+
+/*--------------------------------------------------------------*
+ |                   VERIFY HELPER FUNCTIONS                    |
+ *--------------------------------------------------------------*/
+/*
+ * [Name]:       verify_all
+ * [Parameters]: 1 ppm (image), 1 UArray_T (codewords)
+ * [Return]:     exact Comp40_quality, from every block
+ * [Purpose]:    Full check, spread over one thread per processor
+ * [Errors]:     None
+ */
+Comp40_quality verify_all(ppm image, UArray_T codewords)
+{
+        Comp40_quality    quality;
+        struct verify_job job;
+        memset(&quality, 0, sizeof(quality));
+        memset(&job, 0, sizeof(job));
+        job.image     = image;
+        job.codewords = codewords;
+        job.bw        = image->width  / 2;
+        job.bh        = image->height / 2;
+        if (job.bw == 0 || job.bh == 0) {
+                return quality;
+        }
+        pthread_mutex_init(&job.lock, NULL);
+
+        int        threads = num_threads((job.bh + VERIFY_CHUNK - 1) /
+                                         VERIFY_CHUNK);
+        pthread_t *workers = ALLOC(threads * sizeof(pthread_t));
+        for (int i = 0; i < threads; i++) {
+                int err = pthread_create(&workers[i], NULL, verify_rows, &job);
+                assert(err == 0);
+        }
+        for (int i = 0; i < threads; i++) {
+                pthread_join(workers[i], NULL);
+        }
+        FREE(workers);
+        pthread_mutex_destroy(&job.lock);
+
+        quality.blocks  = job.bw * job.bh;
+        quality.sampled = quality.blocks;
+        quality.rms     = sqrt(job.sum / (12.0 * quality.blocks));
+        quality.rms_low = quality.rms_high = quality.rms;
+
+        return quality;
+}
+
+/*
+ * [Name]:       verify_sample
+ * [Parameters]: 1 ppm (image), 1 UArray_T (codewords), 1 double (fraction,
+ *               in (0, 1))
+ * [Return]:     Comp40_quality estimated from the sampled blocks
+ * [Purpose]:    Decodes only the blocks sample_hash picks, on the calling
+ *               thread, and turns the mean and variance of their squared
+ *               errors into an estimate and confidence bounds for the RMS
+ * [Errors]:     None
+ */
+Comp40_quality verify_sample(ppm image, UArray_T codewords, double fraction)
+{
+        Comp40_quality quality;
+        memset(&quality, 0, sizeof(quality));
+
+        unsigned bw        = image->width / 2;
+        unsigned blocks    = UArray_length(codewords);
+        uint64_t threshold = fraction * 18446744073709551616.0;
+        double   sum = 0, sum_sq = 0;
+
+        for (unsigned i = 0; i < blocks; i++) {
+                if (sample_hash(i) >= threshold) {
+                        continue;
+                }
+
+                struct Pnm_rgb px[4];
+                decode_block(*(uint32_t *)UArray_at(codewords, i), px);
+                double error = block_error(image, px, i % bw, i / bw);
+                sum    += error;
+                sum_sq += error * error;
+                quality.sampled++;
+        }
+
+        /* Mean squared error of a block (12 samples), and its std. error */
+        double n        = quality.sampled;
+        double mean     = n > 0 ? sum / n : 0;
+        double variance = n > 1 ? (sum_sq - sum * mean) / (n - 1) : 0;
+        double std_err  = sqrt((variance > 0 ? variance : 0) / (n > 0 ? n : 1) *
+                               (1 - n / blocks));
+        double low      = mean - Z_95 * std_err;
+
+        quality.blocks   = blocks;
+        quality.rms      = sqrt(mean / 12);
+        quality.rms_low  = sqrt((low > 0 ? low : 0) / 12);
+        quality.rms_high = sqrt((mean + Z_95 * std_err) / 12);
+
+        return quality;
+}
+
+/*
+ * [Name]:       verify_rows
+ * [Parameters]: 1 void* (closure, the struct verify_job)
+ * [Return]:     NULL
+ * [Purpose]:    Thread body: repeatedly takes the next VERIFY_CHUNK block
+ *               rows and sums their error, then adds its total to the job's
+ * [Errors]:     None
+ */
+void *verify_rows(void *cl)
+{
+        struct verify_job *job = cl;
+        double             sum = 0;
+
+        for (;;) {
+                pthread_mutex_lock(&job->lock);
+                unsigned row = job->next;
+                job->next += VERIFY_CHUNK;
+                pthread_mutex_unlock(&job->lock);
+
+                if (row >= job->bh) {
+                        break;
+                }
+
+                unsigned last = job->bh - row < VERIFY_CHUNK ?
+                                job->bh : row + VERIFY_CHUNK;
+                for (; row < last; row++) {
+                        sum += row_error(job, row);
+                }
+        }
+
+        pthread_mutex_lock(&job->lock);
+        job->sum += sum;
+        pthread_mutex_unlock(&job->lock);
+
+        return NULL;
+}
+
+/*
+ * [Name]:       row_error
+ * [Parameters]: 1 const struct verify_job*, 1 unsigned (block row)
+ * [Return]:     summed squared error of the decoded block row against the
+ *               source, with color values in [0, 1]
+ * [Purpose]:    Decodes each block of the row and compares its pixels with
+ *               the source's
+ * [Errors]:     None
+ */
+double row_error(const struct verify_job *job, unsigned row)
+{
+        double         sum  = 0;
+        struct Pnm_rgb px[4];
+        uint32_t       last = 0;
+
+        for (unsigned col = 0; col < job->bw; col++) {
+                uint32_t codeword = *(uint32_t *)UArray_at(job->codewords,
+                                                           row * job->bw +
+                                                           col);
+                if (col == 0 || codeword != last) {
+                        decode_block(codeword, px);
+                        last = codeword;
+                }
+                sum += block_error(job->image, px, col, row);
+        }
+
+        return sum;
+}
+
+/*
+ * [Name]:       block_error
+ * [Parameters]: 1 ppm (image, the source), 1 const struct Pnm_rgb array (px:
+ *               the decoded block, as decode_block fills it), 2 unsigned
+ *               integers (col, row of the block)
+ * [Return]:     summed squared error of the block's 12 samples, with color
+ *               values in [0, 1]
+ * [Purpose]:    Compares a decoded block with the source's pixels
+ * [Errors]:     None
+ */
+double block_error(ppm image, const struct Pnm_rgb px[4], unsigned col,
+                   unsigned row)
+{
+        double sum = 0;
+
+        for (int j = 0; j < 4; j++) {
+                Pnm_rgb src = image->methods->at(image->pixels,
+                                                 2 * col + j % 2,
+                                                 2 * row + j / 2);
+                double dr = ((double)src->red   - px[j].red)   / RGB_MAX;
+                double dg = ((double)src->green - px[j].green) / RGB_MAX;
+                double db = ((double)src->blue  - px[j].blue)  / RGB_MAX;
+                sum += dr * dr + dg * dg + db * db;
+        }
+
+        return sum;
+}
+
+/*
+ * [Name]:       decode_block
+ * [Parameters]: 1 uint32_t (codeword), 1 struct Pnm_rgb array (px: filled
+ *               with the top-left, top-right, bottom-left and bottom-right
+ *               pixels)
+ * [Return]:     void
+ * [Purpose]:    Decompresses one codeword exactly as the decompress pipeline
+ *               does
+ * [Errors]:     None
+ */
+void decode_block(uint32_t codeword, struct Pnm_rgb px[4])
+{
+        struct bit_block bit;
+        unpack(codeword, &bit);
+
+        float a = bit_to_avg_luma(bit.a);
+        float b = bit_to_bcd(bit.b, B_WIDTH);
+        float c = bit_to_bcd(bit.c, C_WIDTH);
+        float d = bit_to_bcd(bit.d, D_WIDTH);
+        float Pb = Arith40_chroma_of_index(bit.Pb);
+        float Pr = Arith40_chroma_of_index(bit.Pr);
+
+        struct XYZ_px xyz[4] = {
+                { a - b - c + d, Pb, Pr }, { a - b + c - d, Pb, Pr },
+                { a + b - c - d, Pb, Pr }, { a + b + c + d, Pb, Pr }
+        };
+
+        for (int j = 0; j < 4; j++) {
+                struct RGB_px rgb = XYZ_px_to_RGB(xyz[j]);
+                px[j].red   = rgb.r;
+                px[j].green = rgb.g;
+                px[j].blue  = rgb.b;
+        }
+}
+/*
+ * [Name]:       sample_hash
+ * [Parameters]: 1 uint64_t (index of a block)
+ * [Return]:     a well-mixed 64-bit hash of the index (the splitmix64
+ *               finalizer), uniform enough to pick a sample by threshold
+ * [Purpose]:    Chooses sampled blocks the same way on every run
+ * [Errors]:     None
+ */
+uint64_t sample_hash(uint64_t index)
+{
+        uint64_t z = index + VERIFY_SEED;
+
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+
+        return z ^ (z >> 31);
+}
+/* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ */